@@ -3005,6 +3005,7 @@ public:
 	 *   - **skip_blanks** -- Skip tiles which are nearly equal to the background, int.
 	 *   - **id** -- Resource ID, const char *.
 	 *   - **Q** -- Q factor, int.
+	 *   - **preview_size** -- Make a preview no larger than this, int.
 	 *   - **keep** -- Which metadata to retain, VipsForeignKeep.
 	 *   - **background** -- Background value, std::vector<double>.
 	 *   - **page_height** -- Set page height for multipage save, int.
@@ -3033,6 +3034,7 @@ public:
 	 *   - **skip_blanks** -- Skip tiles which are nearly equal to the background, int.
 	 *   - **id** -- Resource ID, const char *.
 	 *   - **Q** -- Q factor, int.
+	 *   - **preview_size** -- Make a preview no larger than this, int.
 	 *   - **keep** -- Which metadata to retain, VipsForeignKeep.
 	 *   - **background** -- Background value, std::vector<double>.
 	 *   - **page_height** -- Set page height for multipage save, int.
@@ -3061,6 +3063,7 @@ public:
 	 *   - **skip_blanks** -- Skip tiles which are nearly equal to the background, int.
 	 *   - **id** -- Resource ID, const char *.
 	 *   - **Q** -- Q factor, int.
+	 *   - **preview_size** -- Make a preview no larger than this, int.
 	 *   - **keep** -- Which metadata to retain, VipsForeignKeep.
 	 *   - **background** -- Background value, std::vector<double>.
 	 *   - **page_height** -- Set page height for multipage save, int.
@@ -3244,6 +3247,10 @@ public:
 
 	/**
 	 * Frequency-domain filtering.
+	 *
+	 * **Optional parameters**
+	 *   - **disc** -- Transform via temporary files, bool.
+	 *
 	 * @param mask Input mask image.
 	 * @param options Set of options.
 	 * @return Output image.
@@ -3252,6 +3259,10 @@ public:
 
 	/**
 	 * Forward fft.
+	 *
+	 * **Optional parameters**
+	 *   - **disc** -- Transform via temporary files, bool.
+	 *
 	 * @param options Set of options.
 	 * @return Output image.
 	 */
@@ -3848,6 +3859,7 @@ public:
 	 *
 	 * **Optional parameters**
 	 *   - **real** -- Output only the real part of the transform, bool.
+	 *   - **disc** -- Transform via temporary files, bool.
 	 *
 	 * @param options Set of options.
 	 * @return Output image.
@@ -5850,6 +5862,10 @@ public:
 
 	/**
 	 * Make displayable power spectrum.
+	 *
+	 * **Optional parameters**
+	 *   - **disc** -- Transform via temporary files, bool.
+	 *
 	 * @param options Set of options.
 	 * @return Output image.
 	 */
@@ -8,6 +8,8 @@
  * 	  corresponding pixel in the input)
  * 	- LUT-able: ie. arithmetic (image) can be exactly replaced by
  * 	  maplut (image, arithmetic (lut)) for 8/16 bit int images
+ * 	- chains of unary operations feeding an arithmetic operation are run
+ * 	  a line at a time from its sequence, with no intermediate regions
  */
 
 /*
@@ -310,34 +312,144 @@ vips__bandalike(const char *domain,
 	return 0;
 }
 
+/* Up to this many unary operations can be run directly from a sequence.
+ */
+#define MAX_CHAIN (8)
+
+/* A chain of unary arithmetic operations between an input image and us.
+ * Rather than make a region on the output of each one, we run their line
+ * processors ourselves, through line buffers held on the sequence.
+ */
+typedef struct _VipsArithmeticChain {
+	/* The operations to run, nearest the source first.
+	 */
+	int n;
+	VipsArithmetic *op[MAX_CHAIN];
+
+	/* The output of each operation, and the number of bytes we've
+	 * allocated for it.
+	 */
+	VipsPel *line[MAX_CHAIN];
+	size_t size[MAX_CHAIN];
+} VipsArithmeticChain;
+
 /* Our sequence value.
  */
 typedef struct {
 	VipsArithmetic *arithmetic;
 
-	/* Set of input regions.
+	/* Set of input regions. These are on the chain sources, if any.
 	 */
 	VipsRegion **ir;
 
-	/* For each input, an input pointer.
+	/* For each input, a possibly empty chain.
 	 */
+	VipsArithmeticChain *chain;
+
+	/* For each input, a pointer into the region, and a pointer to the
+	 * line we pass to our process_line.
+	 */
+	VipsPel **src;
 	VipsPel **p;
 
 } VipsArithmeticSequence;
 
+static int vips_arithmetic_gen(VipsRegion *out_region,
+	void *vseq, void *a, void *b, gboolean *stop);
+
+/* Walk back from @in through any unary arithmetic operations. Return the
+ * image at the start of the chain.
+ */
+static VipsImage *
+vips_arithmetic_chain_build(VipsImage *in, VipsArithmeticChain *chain)
+{
+	int i;
+
+	chain->n = 0;
+	while (chain->n < MAX_CHAIN &&
+		in->generate_fn == vips_arithmetic_gen) {
+		VipsArithmetic *arithmetic = VIPS_ARITHMETIC(in->client2);
+
+		if (arithmetic->n != 1)
+			break;
+
+		chain->op[chain->n] = arithmetic;
+		chain->n += 1;
+		in = arithmetic->ready[0];
+	}
+
+	/* We found them nearest-us first.
+	 */
+	for (i = 0; i < chain->n / 2; i++)
+		VIPS_SWAP(VipsArithmetic *,
+			chain->op[i], chain->op[chain->n - i - 1]);
+
+	return in;
+}
+
+/* Make sure the chain line buffers can hold @width pixels.
+ */
+static int
+vips_arithmetic_chain_size(VipsArithmeticChain *chain, int width)
+{
+	int i;
+
+	for (i = 0; i < chain->n; i++) {
+		size_t size = (size_t) width *
+			VIPS_IMAGE_SIZEOF_PEL(chain->op[i]->out);
+
+		if (chain->size[i] < size) {
+			VIPS_FREE(chain->line[i]);
+			if (!(chain->line[i] = VIPS_ARRAY(NULL, size, VipsPel)))
+				return -1;
+			chain->size[i] = size;
+		}
+	}
+
+	return 0;
+}
+
+/* Run a line of pixels through a chain.
+ */
+static VipsPel *
+vips_arithmetic_chain_process(VipsArithmeticChain *chain,
+	VipsPel *p, int width)
+{
+	int i;
+
+	for (i = 0; i < chain->n; i++) {
+		VipsArithmetic *arithmetic = chain->op[i];
+		VipsArithmeticClass *class =
+			VIPS_ARITHMETIC_GET_CLASS(arithmetic);
+		VipsPel *in[2] = { p, NULL };
+
+		class->process_line(arithmetic, chain->line[i], in, width);
+		p = chain->line[i];
+	}
+
+	return p;
+}
+
 static int
 vips_arithmetic_stop(void *vseq, void *a, void *b)
 {
 	VipsArithmeticSequence *seq = (VipsArithmeticSequence *) vseq;
 
 	if (seq->ir) {
-		int i;
+		int i, j;
 
-		for (i = 0; seq->ir[i]; i++)
+		for (i = 0; seq->ir[i]; i++) {
 			VIPS_UNREF(seq->ir[i]);
+
+			if (seq->chain)
+				for (j = 0; j < seq->chain[i].n; j++)
+					VIPS_FREE(seq->chain[i].line[j]);
+		}
 		VIPS_FREE(seq->ir);
 	}
 
+	VIPS_FREE(seq->chain);
+	VIPS_FREE(seq->src);
 	VIPS_FREE(seq->p);
 
 	VIPS_FREE(seq);
@@ -359,6 +471,8 @@ vips_arithmetic_start(VipsImage *out, void *a, void *b)
 
 	seq->arithmetic = arithmetic;
 	seq->ir = NULL;
+	seq->chain = NULL;
+	seq->src = NULL;
 	seq->p = NULL;
 
 	/* How many images?
@@ -372,19 +486,32 @@ vips_arithmetic_start(VipsImage *out, void *a, void *b)
 		vips_arithmetic_stop(seq, NULL, NULL);
 		return NULL;
 	}
+	for (i = 0; i <= n; i++)
+		seq->ir[i] = NULL;
 
-	/* Create a set of regions.
+	/* Zeroed, so stop can free a partly built set.
 	 */
-	for (i = 0; i < n; i++)
-		if (!(seq->ir[i] = vips_region_new(in[i]))) {
+	if (!(seq->chain = g_new0(VipsArithmeticChain, n))) {
+		vips_arithmetic_stop(seq, NULL, NULL);
+		return NULL;
+	}
+
+	/* Create a set of regions, each on the source of its chain.
+	 */
+	for (i = 0; i < n; i++) {
+		VipsImage *source =
+			vips_arithmetic_chain_build(in[i], &seq->chain[i]);
+
+		if (!(seq->ir[i] = vips_region_new(source))) {
 			vips_arithmetic_stop(seq, NULL, NULL);
 			return NULL;
 		}
-	seq->ir[n] = NULL;
+	}
 
 	/* Input pointers.
 	 */
-	if (!(seq->p = VIPS_ARRAY(NULL, n + 1, VipsPel *))) {
+	if (!(seq->src = VIPS_ARRAY(NULL, n + 1, VipsPel *)) ||
+		!(seq->p = VIPS_ARRAY(NULL, n + 1, VipsPel *))) {
 		vips_arithmetic_stop(seq, NULL, NULL);
 		return NULL;
 	}
@@ -398,6 +525,7 @@ vips_arithmetic_gen(VipsRegion *out_region,
 {
 	VipsArithmeticSequence *seq = (VipsArithmeticSequence *) vseq;
 	VipsRegion **ir = seq->ir;
+	VipsArithmeticChain *chain = seq->chain;
 	VipsArithmetic *arithmetic = VIPS_ARITHMETIC(b);
 	VipsArithmeticClass *class = VIPS_ARITHMETIC_GET_CLASS(arithmetic);
 	VipsRect *r = &out_region->valid;
@@ -409,19 +537,27 @@ vips_arithmetic_gen(VipsRegion *out_region,
 	 */
 	if (vips_reorder_prepare_many(out_region->im, ir, r))
 		return -1;
-	for (i = 0; ir[i]; i++)
-		seq->p[i] = (VipsPel *)
+	for (i = 0; ir[i]; i++) {
+		seq->src[i] = (VipsPel *)
 			VIPS_REGION_ADDR(ir[i], r->left, r->top);
+		if (vips_arithmetic_chain_size(&chain[i], r->width))
+			return -1;
+	}
+	seq->src[i] = NULL;
 	seq->p[i] = NULL;
 	q = (VipsPel *) VIPS_REGION_ADDR(out_region, r->left, r->top);
 
 	VIPS_GATE_START("vips_arithmetic_gen: work");
 
 	for (y = 0; y < r->height; y++) {
+		for (i = 0; ir[i]; i++)
+			seq->p[i] = vips_arithmetic_chain_process(&chain[i],
+				seq->src[i], r->width);
+
 		class->process_line(arithmetic, q, seq->p, r->width);
 
 		for (i = 0; ir[i]; i++)
-			seq->p[i] += VIPS_REGION_LSKIP(ir[i]);
+			seq->src[i] += VIPS_REGION_LSKIP(ir[i]);
 		q += VIPS_REGION_LSKIP(out_region);
 	}
 
@@ -465,10 +601,15 @@ vips_arithmetic_build(VipsObject *object)
 	size = (VipsImage **)
 		vips_object_local_array(object, arithmetic->n);
 
-	/* Decode RAD/LABQ etc.
+	/* Decode RAD/LABQ etc. Uncoded images are used directly, so a chain of
+	 * arithmetic operations can be found by the sequence.
 	 */
 	for (i = 0; i < arithmetic->n; i++)
-		if (vips_image_decode(arithmetic->in[i], &decode[i]))
+		if (arithmetic->in[i]->Coding == VIPS_CODING_NONE) {
+			decode[i] = arithmetic->in[i];
+			g_object_ref(decode[i]);
+		}
+		else if (vips_image_decode(arithmetic->in[i], &decode[i]))
 			return -1;
 
 	/* Cast our input images up to a common format, bands and size.
@@ -590,6 +731,7 @@ vips_arithmetic_operation_init(void)
 	extern GType vips_complexget_get_type(void);
 	extern GType vips_complexform_get_type(void);
 	extern GType vips_find_trim_get_type(void);
+	extern GType vips_integral_get_type(void);
 
 	vips_add_get_type();
 	vips_clamp_get_type();
@@ -632,4 +774,5 @@ vips_arithmetic_operation_init(void)
 	vips_complexget_get_type();
 	vips_complexform_get_type();
 	vips_find_trim_get_type();
+	vips_integral_get_type();
 }
@@ -7,6 +7,9 @@
  * 	- only flatten if there is an alpha
  * 8/2/23
  *	- add @line_art
+ * 18/10/26
+ * 	- scan in from each edge and stop at the first object pixel
+ * 	- project as before for sequential images
  */
 
 /*
@@ -69,6 +72,252 @@ typedef VipsOperationClass VipsFindTrimClass;
 
 G_DEFINE_TYPE(VipsFindTrim, vips_find_trim, VIPS_TYPE_OPERATION);
 
+/* Search in from an edge this many lines or columns at a time.
+ */
+#define TRIM_STRIP (32)
+
+typedef enum {
+	TRIM_EDGE_TOP,
+	TRIM_EDGE_BOTTOM,
+	TRIM_EDGE_LEFT,
+	TRIM_EDGE_RIGHT
+} TrimEdge;
+
+/* Our state during a search in from one edge.
+ */
+typedef struct _TrimScan {
+	/* The area of the binary object mask still to search.
+	 */
+	VipsRect area;
+	TrimEdge edge;
+
+	/* Distance in from the edge of the next strip to search.
+	 */
+	int pos;
+
+	/* Smallest distance in from the edge of an object pixel, or G_MAXINT
+	 * for none found yet. Workers update this atomically.
+	 */
+	int hit;
+} TrimScan;
+
+static int
+vips_find_trim_extent(TrimScan *scan)
+{
+	return scan->edge == TRIM_EDGE_TOP || scan->edge == TRIM_EDGE_BOTTOM
+		? scan->area.height
+		: scan->area.width;
+}
+
+static int
+vips_find_trim_allocate(VipsThreadState *state, void *a, gboolean *stop)
+{
+	TrimScan *scan = (TrimScan *) a;
+	VipsRect *area = &scan->area;
+	VipsRect *r = &state->pos;
+	const int extent = vips_find_trim_extent(scan);
+
+	int size;
+
+	/* Stop when we've searched everything, or when we've found an object
+	 * nearer the edge than the next strip.
+	 */
+	if (scan->pos >= extent ||
+		g_atomic_int_get(&scan->hit) <= scan->pos) {
+		*stop = TRUE;
+		return 0;
+	}
+
+	size = VIPS_MIN(TRIM_STRIP, extent - scan->pos);
+	*r = *area;
+	switch (scan->edge) {
+	case TRIM_EDGE_TOP:
+		r->top = area->top + scan->pos;
+		r->height = size;
+		break;
+
+	case TRIM_EDGE_BOTTOM:
+		r->top = VIPS_RECT_BOTTOM(area) - scan->pos - size;
+		r->height = size;
+		break;
+
+	case TRIM_EDGE_LEFT:
+		r->left = area->left + scan->pos;
+		r->width = size;
+		break;
+
+	case TRIM_EDGE_RIGHT:
+		r->left = VIPS_RECT_RIGHT(area) - scan->pos - size;
+		r->width = size;
+		break;
+
+	default:
+		g_assert_not_reached();
+	}
+
+	scan->pos += size;
+
+	return 0;
+}
+
+/* Find the object pixel in this strip nearest the edge and record its
+ * distance.
+ */
+static int
+vips_find_trim_work(VipsThreadState *state, void *a)
+{
+	TrimScan *scan = (TrimScan *) a;
+	VipsRect *area = &scan->area;
+	VipsRect *r = &state->pos;
+
+	int x, y;
+	int distance;
+	int old;
+
+	if (vips_region_prepare(state->reg, r))
+		return -1;
+
+	distance = G_MAXINT;
+	switch (scan->edge) {
+	case TRIM_EDGE_TOP:
+		for (y = 0; y < r->height && distance == G_MAXINT; y++) {
+			VipsPel *p = VIPS_REGION_ADDR(state->reg, r->left, r->top + y);
+
+			for (x = 0; x < r->width; x++)
+				if (p[x]) {
+					distance = r->top + y - area->top;
+					break;
+				}
+		}
+		break;
+
+	case TRIM_EDGE_BOTTOM:
+		for (y = r->height - 1; y >= 0 && distance == G_MAXINT; y--) {
+			VipsPel *p = VIPS_REGION_ADDR(state->reg, r->left, r->top + y);
+
+			for (x = 0; x < r->width; x++)
+				if (p[x]) {
+					distance = VIPS_RECT_BOTTOM(area) - 1 - (r->top + y);
+					break;
+				}
+		}
+		break;
+
+	case TRIM_EDGE_LEFT:
+		for (y = 0; y < r->height; y++) {
+			VipsPel *p = VIPS_REGION_ADDR(state->reg, r->left, r->top + y);
+
+			for (x = 0; x < r->width; x++)
+				if (p[x]) {
+					distance = VIPS_MIN(distance, r->left + x - area->left);
+					break;
+				}
+		}
+		break;
+
+	case TRIM_EDGE_RIGHT:
+		for (y = 0; y < r->height; y++) {
+			VipsPel *p = VIPS_REGION_ADDR(state->reg, r->left, r->top + y);
+
+			for (x = r->width - 1; x >= 0; x--)
+				if (p[x]) {
+					distance = VIPS_MIN(distance,
+						VIPS_RECT_RIGHT(area) - 1 - (r->left + x));
+					break;
+				}
+		}
+		break;
+
+	default:
+		g_assert_not_reached();
+	}
+
+	/* Atomic min.
+	 */
+	do
+		old = g_atomic_int_get(&scan->hit);
+	while (distance < old &&
+		!g_atomic_int_compare_and_exchange(&scan->hit, old, distance));
+
+	return 0;
+}
+
+/* Search in from one edge of @area. Return the distance in to the first
+ * object pixel, or G_MAXINT if there are none.
+ */
+static int
+vips_find_trim_edge(VipsImage *mask, VipsRect *area, TrimEdge edge,
+	int *distance)
+{
+	TrimScan scan;
+
+	scan.area = *area;
+	scan.edge = edge;
+	scan.pos = 0;
+	scan.hit = G_MAXINT;
+
+	if (vips_threadpool_run(mask,
+			vips_thread_state_new,
+			vips_find_trim_allocate,
+			vips_find_trim_work,
+			NULL,
+			&scan))
+		return -1;
+
+	*distance = scan.hit;
+
+	return 0;
+}
+
+/* Project the whole mask and search the row and column sums. This reads
+ * the mask once, top to bottom, so it works for sequential images.
+ */
+static int
+vips_find_trim_project(VipsFindTrim *find_trim, VipsImage *mask)
+{
+	VipsImage **t = (VipsImage **)
+		vips_object_local_array(VIPS_OBJECT(find_trim), 12);
+
+	double left;
+	double top;
+	double right;
+	double bottom;
+
+	/* t[0] == column sums, t[1] == row sums.
+	 */
+	if (vips_project(mask, &t[0], &t[1], NULL))
+		return -1;
+
+	/* Search column sums in from left and right.
+	 */
+	if (vips_profile(t[0], &t[2], &t[3], NULL) ||
+		vips_avg(t[3], &left, NULL))
+		return -1;
+	if (vips_flip(t[0], &t[4], VIPS_DIRECTION_HORIZONTAL, NULL) ||
+		vips_profile(t[4], &t[5], &t[6], NULL) ||
+		vips_avg(t[6], &right, NULL))
+		return -1;
+
+	/* Search row sums in from top and bottom.
+	 */
+	if (vips_profile(t[1], &t[7], &t[8], NULL) ||
+		vips_avg(t[7], &top, NULL))
+		return -1;
+	if (vips_flip(t[1], &t[9], VIPS_DIRECTION_VERTICAL, NULL) ||
+		vips_profile(t[9], &t[10], &t[11], NULL) ||
+		vips_avg(t[10], &bottom, NULL))
+		return -1;
+
+	g_object_set(find_trim,
+		"left", (int) left,
+		"top", (int) top,
+		"width", (int) VIPS_MAX(0, (t[0]->Xsize - right) - left),
+		"height", (int) VIPS_MAX(0, (t[1]->Ysize - bottom) - top),
+		NULL);
+
+	return 0;
+}
+
 static int
 vips_find_trim_build(VipsObject *object)
 {
@@ -81,10 +330,8 @@ vips_find_trim_build(VipsObject *object)
 	double *neg_bg;
 	double *ones;
 	int i;
-	double left;
-	double top;
-	double right;
-	double bottom;
+	VipsRect area;
+	int distance;
 
 	if (VIPS_OBJECT_CLASS(vips_find_trim_parent_class)->build(object))
 		return -1;
@@ -135,36 +382,61 @@ vips_find_trim_build(VipsObject *object)
 		return -1;
 	in = t[5];
 
-	/* t[6] == column sums, t[7] == row sums.
+	/* The edge searches read strips out of order, and read some parts of
+	 * the mask more than once. Sequential images must be read top to
+	 * bottom, once.
 	 */
-	if (vips_project(in, &t[6], &t[7], NULL))
-		return -1;
+	if (vips_image_is_sequential(in))
+		return vips_find_trim_project(find_trim, in);
 
-	/* t[8] == search column sums in from left.
+	/* Search in from each edge in turn, shrinking the area as we go, so
+	 * we only compute the parts of the mask we need.
 	 */
-	if (vips_profile(t[6], &t[8], &t[9], NULL) ||
-		vips_avg(t[9], &left, NULL))
-		return -1;
-	if (vips_flip(t[6], &t[10], VIPS_DIRECTION_HORIZONTAL, NULL) ||
-		vips_profile(t[10], &t[11], &t[12], NULL) ||
-		vips_avg(t[12], &right, NULL))
+	area.left = 0;
+	area.top = 0;
+	area.width = in->Xsize;
+	area.height = in->Ysize;
+
+	if (vips_find_trim_edge(in, &area, TRIM_EDGE_TOP, &distance))
 		return -1;
 
-	/* t[8] == search column sums in from left.
+	/* All background.
+	 */
+	if (distance == G_MAXINT) {
+		g_object_set(find_trim,
+			"left", in->Xsize,
+			"top", in->Ysize,
+			"width", 0,
+			"height", 0,
+			NULL);
+
+		return 0;
+	}
+
+	area.top += distance;
+	area.height -= distance;
+
+	/* There's an object pixel on the top line of area, so the other
+	 * edges must all find something.
 	 */
-	if (vips_profile(t[7], &t[13], &t[14], NULL) ||
-		vips_avg(t[13], &top, NULL))
+	if (vips_find_trim_edge(in, &area, TRIM_EDGE_BOTTOM, &distance))
 		return -1;
-	if (vips_flip(t[7], &t[15], VIPS_DIRECTION_VERTICAL, NULL) ||
-		vips_profile(t[15], &t[16], &t[17], NULL) ||
-		vips_avg(t[16], &bottom, NULL))
+	area.height -= distance;
+
+	if (vips_find_trim_edge(in, &area, TRIM_EDGE_LEFT, &distance))
+		return -1;
+	area.left += distance;
+	area.width -= distance;
+
+	if (vips_find_trim_edge(in, &area, TRIM_EDGE_RIGHT, &distance))
 		return -1;
+	area.width -= distance;
 
 	g_object_set(find_trim,
-		"left", (int) left,
-		"top", (int) top,
-		"width", (int) VIPS_MAX(0, (t[6]->Xsize - right) - left),
-		"height", (int) VIPS_MAX(0, (t[7]->Ysize - bottom) - top),
+		"left", area.left,
+		"top", area.top,
+		"width", area.width,
+		"height", area.height,
 		NULL);
 
 	return 0;
@@ -260,9 +532,11 @@ vips_find_trim_init(VipsFindTrim *find_trim)
  *
  * Any alpha is flattened out, then the image is median-filtered (unless
  * @line_art is set, see below). The absolute difference from @background is
- * computed and binarized according to @threshold. Row and column sums of
- * the absolute difference are calculated from this binary image and searched
- * for the first row or column in each direction to obtain the bounding box.
+ * computed and binarized according to @threshold. This binary image is then
+ * searched in from each edge for the first object pixel to obtain the
+ * bounding box. Each search runs in parallel and stops as soon as it finds
+ * something, so only the pixels between the edges and the object are
+ * computed.
  *
  * If the image is entirely background, [method@Image.find_trim] returns
  * @width == 0 and @height == 0.
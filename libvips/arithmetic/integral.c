@@ -0,0 +1,583 @@
+/* summed-area table
+ *
+ * 18/10/26
+ * 	- from project.c
+ * 	- add vips__integral_window() for the correlation tables, and the
+ * 	  streaming vips__window_stats_*() helpers for window filters
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+/*
+#define DEBUG
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vips/vips.h>
+#include <vips/internal.h>
+
+/* Each worker scans a strip this many lines high.
+ */
+#define INTEGRAL_STRIP_HEIGHT (64)
+
+typedef struct _VipsIntegral {
+	VipsOperation parent_instance;
+
+	VipsImage *in;
+	VipsImage *out;
+	gboolean squared;
+
+} VipsIntegral;
+
+typedef VipsOperationClass VipsIntegralClass;
+
+G_DEFINE_TYPE(VipsIntegral, vips_integral, VIPS_TYPE_OPERATION);
+
+/* Our state during a scan.
+ */
+typedef struct _IntegralScan {
+	/* Double input pipeline, and the memory image we build the table in.
+	 */
+	VipsImage *in;
+	VipsImage *table;
+
+	/* Allocate the next strip here.
+	 */
+	int y;
+} IntegralScan;
+
+static int
+vips_integral_allocate(VipsThreadState *state, void *a, gboolean *stop)
+{
+	IntegralScan *scan = (IntegralScan *) a;
+
+	if (scan->y >= scan->in->Ysize) {
+		*stop = TRUE;
+		return 0;
+	}
+
+	state->pos.left = 0;
+	state->pos.top = scan->y;
+	state->pos.width = scan->in->Xsize;
+	state->pos.height =
+		VIPS_MIN(INTEGRAL_STRIP_HEIGHT, scan->in->Ysize - scan->y);
+
+	scan->y += INTEGRAL_STRIP_HEIGHT;
+
+	return 0;
+}
+
+/* First pass: sum along each line, then down each column, within the strip.
+ */
+static int
+vips_integral_strip(VipsThreadState *state, void *a)
+{
+	IntegralScan *scan = (IntegralScan *) a;
+	VipsImage *table = scan->table;
+	VipsRect *r = &state->pos;
+	const int bands = table->Bands;
+	const int ne = r->width * bands;
+
+	int x, y, b;
+
+	if (vips_region_prepare(state->reg, r))
+		return -1;
+
+	for (y = 0; y < r->height; y++) {
+		double *restrict p = (double *)
+			VIPS_REGION_ADDR(state->reg, 0, r->top + y);
+		double *restrict q = (double *)
+			VIPS_IMAGE_ADDR(table, 0, r->top + y);
+
+		for (b = 0; b < bands; b++)
+			q[b] = p[b];
+		for (x = bands; x < ne; x++)
+			q[x] = q[x - bands] + p[x];
+
+		if (y > 0) {
+			double *restrict q1 = (double *)
+				VIPS_IMAGE_ADDR(table, 0, r->top + y - 1);
+
+			for (x = 0; x < ne; x++)
+				q[x] += q1[x];
+		}
+	}
+
+	return 0;
+}
+
+/* Final pass: add the (now complete) last line of the strip above to every
+ * line of this strip except the last, which has already been done.
+ */
+static int
+vips_integral_carry(VipsThreadState *state, void *a)
+{
+	IntegralScan *scan = (IntegralScan *) a;
+	VipsImage *table = scan->table;
+	VipsRect *r = &state->pos;
+	const int ne = r->width * table->Bands;
+
+	double *restrict q1;
+	int x, y;
+
+	if (r->top == 0)
+		return 0;
+
+	q1 = (double *) VIPS_IMAGE_ADDR(table, 0, r->top - 1);
+	for (y = 0; y < r->height - 1; y++) {
+		double *restrict q = (double *)
+			VIPS_IMAGE_ADDR(table, 0, r->top + y);
+
+		for (x = 0; x < ne; x++)
+			q[x] += q1[x];
+	}
+
+	return 0;
+}
+
+static int
+vips_integral_build(VipsObject *object)
+{
+	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(object);
+	VipsIntegral *integral = (VipsIntegral *) object;
+	VipsImage **t = (VipsImage **) vips_object_local_array(object, 4);
+
+	VipsImage *in;
+	IntegralScan scan;
+	int ne;
+	int x, y;
+
+	if (VIPS_OBJECT_CLASS(vips_integral_parent_class)->build(object))
+		return -1;
+
+	in = integral->in;
+	if (vips_image_decode(in, &t[0]))
+		return -1;
+	in = t[0];
+
+	if (vips_check_noncomplex(class->nickname, in))
+		return -1;
+
+	if (vips_cast(in, &t[1], VIPS_FORMAT_DOUBLE, NULL))
+		return -1;
+	in = t[1];
+
+	if (integral->squared) {
+		if (vips_multiply(in, in, &t[2], NULL))
+			return -1;
+		in = t[2];
+	}
+
+	t[3] = vips_image_new_memory();
+	if (vips_image_pipelinev(t[3], VIPS_DEMAND_STYLE_ANY, in, NULL))
+		return -1;
+	t[3]->Type = VIPS_INTERPRETATION_MULTIBAND;
+	if (vips_image_write_prepare(t[3]))
+		return -1;
+
+	/* A parallel prefix sum. Workers build a local table for each strip,
+	 * then we run down the strips propagating the last line of each, then
+	 * workers add the carry to each strip.
+	 */
+	scan.in = in;
+	scan.table = t[3];
+	scan.y = 0;
+	if (vips_threadpool_run(in,
+			vips_thread_state_new,
+			vips_integral_allocate,
+			vips_integral_strip,
+			NULL,
+			&scan))
+		return -1;
+
+	ne = VIPS_IMAGE_N_ELEMENTS(in);
+	for (y = 2 * INTEGRAL_STRIP_HEIGHT - 1; y < in->Ysize;
+		 y += INTEGRAL_STRIP_HEIGHT) {
+		double *q = (double *) VIPS_IMAGE_ADDR(t[3], 0, y);
+		double *q1 = (double *)
+			VIPS_IMAGE_ADDR(t[3], 0, y - INTEGRAL_STRIP_HEIGHT);
+
+		for (x = 0; x < ne; x++)
+			q[x] += q1[x];
+	}
+
+	/* The final strip might be short.
+	 */
+	y = in->Ysize - 1;
+	if (y % INTEGRAL_STRIP_HEIGHT != INTEGRAL_STRIP_HEIGHT - 1 &&
+		y >= INTEGRAL_STRIP_HEIGHT) {
+		double *q = (double *) VIPS_IMAGE_ADDR(t[3], 0, y);
+		double *q1 = (double *) VIPS_IMAGE_ADDR(t[3], 0,
+			y - y % INTEGRAL_STRIP_HEIGHT - 1);
+
+		for (x = 0; x < ne; x++)
+			q[x] += q1[x];
+	}
+
+	scan.y = 0;
+	if (vips_threadpool_run(in,
+			vips_thread_state_new,
+			vips_integral_allocate,
+			vips_integral_carry,
+			NULL,
+			&scan))
+		return -1;
+
+	g_object_set(object, "out", vips_image_new(), NULL);
+	if (vips_image_write(t[3], integral->out))
+		return -1;
+
+	return 0;
+}
+
+static void
+vips_integral_class_init(VipsIntegralClass *class)
+{
+	GObjectClass *gobject_class = G_OBJECT_CLASS(class);
+	VipsObjectClass *object_class = (VipsObjectClass *) class;
+
+	gobject_class->set_property = vips_object_set_property;
+	gobject_class->get_property = vips_object_get_property;
+
+	object_class->nickname = "integral";
+	object_class->description = _("make a summed-area table");
+	object_class->build = vips_integral_build;
+
+	VIPS_ARG_IMAGE(class, "in", 1,
+		_("Input"),
+		_("Input image"),
+		VIPS_ARGUMENT_REQUIRED_INPUT,
+		G_STRUCT_OFFSET(VipsIntegral, in));
+
+	VIPS_ARG_IMAGE(class, "out", 2,
+		_("Output"),
+		_("Output image"),
+		VIPS_ARGUMENT_REQUIRED_OUTPUT,
+		G_STRUCT_OFFSET(VipsIntegral, out));
+
+	VIPS_ARG_BOOL(class, "squared", 3,
+		_("Squared"),
+		_("Sum the squares of pixels"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsIntegral, squared),
+		FALSE);
+}
+
+static void
+vips_integral_init(VipsIntegral *integral)
+{
+}
+
+/**
+ * vips_integral: (method)
+ * @in: input image
+ * @out: (out): output image
+ * @...: `NULL`-terminated list of optional named arguments
+ *
+ * Make a summed-area table (an integral image) from @in. Each pixel in @out
+ * is the sum of all the pixels in @in above and to the left of it,
+ * inclusive, so the sum of any rectangle of @in can be found from just
+ * four pixels of @out.
+ *
+ * Set @squared to sum the squares of the pixels instead. Together, the two
+ * tables give the mean and variance of any window in constant time.
+ *
+ * @out is always [enum@Vips.BandFormat.DOUBLE] and has the same size and
+ * number of bands as @in. Sums of integer images are exact up to 2^53.
+ *
+ * The table is computed in memory with a parallel prefix scan.
+ *
+ * ::: tip "Optional arguments"
+ *     * @squared: `gboolean`, sum the squares of pixels
+ *
+ * ::: seealso
+ *     [method@Image.sum], [method@Image.stdif].
+ *
+ * Returns: 0 on success, -1 on error
+ */
+int
+vips_integral(VipsImage *in, VipsImage **out, ...)
+{
+	va_list ap;
+	int result;
+
+	va_start(ap, out);
+	result = vips_call_split("integral", ap, in, out);
+	va_end(ap);
+
+	return result;
+}
+
+/* Expand @in by copying edge pixels, so there's a @width by @height window
+ * for every pixel. The window centred on (x, y) in @in has its top-left at
+ * (x, y) in @out.
+ */
+int
+vips__window_stats_embed(const char *domain, VipsImage *in,
+	int width, int height, VipsImage **out)
+{
+	if (width > in->Xsize ||
+		height > in->Ysize) {
+		vips_error(domain, "%s", _("window too large"));
+		return -1;
+	}
+
+	return vips_embed(in, out, width / 2, height / 2,
+		in->Xsize + width - 1, in->Ysize + height - 1,
+		"extend", VIPS_EXTEND_COPY,
+		NULL);
+}
+
+/* Start function for window filters. @a is the expanded input made by
+ * vips__window_stats_embed(), so the window size is the difference between
+ * that and @out.
+ */
+void *
+vips__window_stats_start(VipsImage *out, void *a, void *b)
+{
+	VipsImage *in = (VipsImage *) a;
+	VipsWindowStats *stats;
+
+	if (!(stats = VIPS_NEW(NULL, VipsWindowStats)))
+		return NULL;
+	stats->ir = NULL;
+	stats->width = in->Xsize - out->Xsize + 1;
+	stats->height = in->Ysize - out->Ysize + 1;
+	stats->bands = in->Bands;
+	stats->pixels = NULL;
+	stats->sum = NULL;
+	stats->sum2 = NULL;
+	stats->size = 0;
+	stats->offset = NULL;
+
+	if (!(stats->offset = VIPS_ARRAY(NULL, in->Bands, double)) ||
+		!(stats->ir = vips_region_new(in))) {
+		vips__window_stats_stop(stats, NULL, NULL);
+		return NULL;
+	}
+
+	return stats;
+}
+
+int
+vips__window_stats_stop(void *seq, void *a, void *b)
+{
+	VipsWindowStats *stats = (VipsWindowStats *) seq;
+
+	VIPS_UNREF(stats->ir);
+	VIPS_FREE(stats->pixels);
+	VIPS_FREE(stats->sum);
+	VIPS_FREE(stats->sum2);
+	VIPS_FREE(stats->offset);
+	VIPS_FREE(stats);
+
+	return 0;
+}
+
+#define CONVERT(TYPE) \
+	{ \
+		TYPE *restrict p = (TYPE *) \
+			VIPS_REGION_ADDR(stats->ir, s.left, s.top + y); \
+\
+		for (x = 0; x < ne; x++) \
+			q[x] = p[x]; \
+	}
+
+/* Fetch the input for output area @r and make summed-area tables of it and
+ * its square, with a line of zeros along the top and left.
+ *
+ * The tables are of the input less the first pixel of the area in each
+ * band. Without that, a large DC level swamps the window variance when we
+ * subtract the two sums.
+ */
+int
+vips__window_stats_prepare(VipsWindowStats *stats, VipsRect *r)
+{
+	const int bands = stats->bands;
+
+	VipsRect s;
+	int ne;
+	int tw;
+	size_t size;
+	int x, y, b;
+
+	s = *r;
+	s.width += stats->width - 1;
+	s.height += stats->height - 1;
+	if (vips_region_prepare(stats->ir, &s))
+		return -1;
+
+	ne = s.width * bands;
+	tw = (s.width + 1) * bands;
+	size = (size_t) tw * (s.height + 1);
+	if (size > stats->size) {
+		VIPS_FREE(stats->pixels);
+		VIPS_FREE(stats->sum);
+		VIPS_FREE(stats->sum2);
+		if (!(stats->pixels = VIPS_ARRAY(NULL, size, double)) ||
+			!(stats->sum = VIPS_ARRAY(NULL, size, double)) ||
+			!(stats->sum2 = VIPS_ARRAY(NULL, size, double)))
+			return -1;
+		stats->size = size;
+	}
+	stats->area = *r;
+	stats->tw = tw;
+
+	/* Unpack to double, one line of pixels per table line.
+	 */
+	for (y = 0; y < s.height; y++) {
+		double *restrict q = stats->pixels + y * tw;
+
+		switch (stats->ir->im->BandFmt) {
+		case VIPS_FORMAT_UCHAR:
+			CONVERT(unsigned char);
+			break;
+
+		case VIPS_FORMAT_CHAR:
+			CONVERT(signed char);
+			break;
+
+		case VIPS_FORMAT_USHORT:
+			CONVERT(unsigned short);
+			break;
+
+		case VIPS_FORMAT_SHORT:
+			CONVERT(signed short);
+			break;
+
+		case VIPS_FORMAT_UINT:
+			CONVERT(unsigned int);
+			break;
+
+		case VIPS_FORMAT_INT:
+			CONVERT(signed int);
+			break;
+
+		case VIPS_FORMAT_FLOAT:
+			CONVERT(float);
+			break;
+
+		case VIPS_FORMAT_DOUBLE:
+			CONVERT(double);
+			break;
+
+		default:
+			g_assert_not_reached();
+		}
+	}
+
+	for (b = 0; b < bands; b++)
+		stats->offset[b] = stats->pixels[b];
+
+	memset(stats->sum, 0, tw * sizeof(double));
+	memset(stats->sum2, 0, tw * sizeof(double));
+	for (y = 0; y < s.height; y++) {
+		double *restrict p = stats->pixels + y * tw;
+		double *restrict q = stats->sum + (y + 1) * tw;
+		double *restrict q2 = stats->sum2 + (y + 1) * tw;
+
+		for (x = 0; x < bands; x++) {
+			q[x] = 0.0;
+			q2[x] = 0.0;
+		}
+
+		for (x = 0; x < ne; x += bands)
+			for (b = 0; b < bands; b++) {
+				int i = x + b;
+				double v = p[i] - stats->offset[b];
+
+				q[i + bands] = q[i] - q[i - tw] + q[i + bands - tw] + v;
+				q2[i + bands] = q2[i] - q2[i - tw] + q2[i + bands - tw] +
+					v * v;
+			}
+	}
+
+	return 0;
+}
+
+/* The centre pixel, mean and variance for the window around output pixel
+ * (@x, @y) of the area last prepared, in band @b. @centre may be NULL.
+ */
+void
+vips__window_stats_get(VipsWindowStats *stats, int x, int y, int b,
+	double *centre, double *mean, double *variance)
+{
+	const int tw = stats->tw;
+	const int bands = stats->bands;
+	const int npel = stats->width * stats->height;
+	const int x0 = (x - stats->area.left) * bands + b;
+	const int y0 = y - stats->area.top;
+	const int x1 = x0 + stats->width * bands;
+	const int y1 = y0 + stats->height;
+	const double *sum = stats->sum;
+	const double *sum2 = stats->sum2;
+
+	double s = sum[y1 * tw + x1] - sum[y1 * tw + x0] -
+		sum[y0 * tw + x1] + sum[y0 * tw + x0];
+	double s2 = sum2[y1 * tw + x1] - sum2[y1 * tw + x0] -
+		sum2[y0 * tw + x1] + sum2[y0 * tw + x0];
+	double m = s / npel;
+
+	if (centre)
+		*centre = stats->pixels[(y0 + stats->height / 2) * tw +
+			x0 + (stats->width / 2) * bands];
+	*mean = m + stats->offset[b];
+	*variance = VIPS_MAX(0.0, s2 / npel - m * m);
+}
+
+/* The sum of the @width by @height window with top-left at (@x, @y), from a
+ * table made by vips_integral().
+ */
+double
+vips__integral_window(VipsImage *table,
+	int x, int y, int width, int height, int b)
+{
+	int x1 = x + width - 1;
+	int y1 = y + height - 1;
+
+	double sum;
+
+	sum = ((double *) VIPS_IMAGE_ADDR(table, x1, y1))[b];
+	if (x > 0)
+		sum -= ((double *) VIPS_IMAGE_ADDR(table, x - 1, y1))[b];
+	if (y > 0)
+		sum -= ((double *) VIPS_IMAGE_ADDR(table, x1, y - 1))[b];
+	if (x > 0 &&
+		y > 0)
+		sum += ((double *) VIPS_IMAGE_ADDR(table, x - 1, y - 1))[b];
+
+	return sum;
+}
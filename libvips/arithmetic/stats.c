@@ -27,6 +27,8 @@
  * 7/11/11
  * 	- redone as a class
  * 	- track maxpos / minpos too
+ * 18/10/26
+ * 	- add @percent and @hist, found in the same pass
  */
 
 /*
@@ -67,6 +69,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include <vips/vips.h>
@@ -78,8 +81,16 @@ typedef struct _VipsStats {
 	VipsStatistic parent_instance;
 
 	VipsImage *out;
+	VipsArrayDouble *percent;
+	VipsImage *hist;
 
 	gboolean set; /* FALSE means no value yet */
+
+	/* If @percent is set, a histogram per band, and the largest bin
+	 * we've seen.
+	 */
+	guint64 **bins;
+	int mx;
 } VipsStats;
 
 typedef VipsStatisticClass VipsStatsClass;
@@ -102,6 +113,147 @@ enum {
 	COL_LAST = 10
 };
 
+/* Number of columns in @out: the fixed set, plus one per percentile.
+ */
+static int
+vips_stats_ncols(VipsStats *stats)
+{
+	int n;
+
+	n = 0;
+	if (stats->percent)
+		vips_array_double_get(stats->percent, &n);
+
+	return COL_LAST + n;
+}
+
+/* uchar and char histogram to 256 bins, everything else to 65536, as
+ * vips_hist_find().
+ */
+static int
+vips_stats_nbins(VipsStatistic *statistic)
+{
+	VipsBandFormat format = vips_image_get_format(statistic->ready);
+
+	return format == VIPS_FORMAT_UCHAR || format == VIPS_FORMAT_CHAR
+		? 256
+		: 65536;
+}
+
+static guint64 **
+vips_stats_bins_new(VipsStatistic *statistic)
+{
+	const int bands = vips_image_get_bands(statistic->ready);
+	const int nbins = vips_stats_nbins(statistic);
+
+	guint64 **bins;
+	int b;
+
+	bins = g_new0(guint64 *, bands);
+	for (b = 0; b < bands; b++)
+		bins[b] = g_new0(guint64, nbins);
+
+	return bins;
+}
+
+static void
+vips_stats_bins_free(VipsStatistic *statistic, guint64 **bins)
+{
+	int b;
+
+	if (bins) {
+		for (b = 0; b < vips_image_get_bands(statistic->ready); b++)
+			g_free(bins[b]);
+		g_free(bins);
+	}
+}
+
+/* The first bin where the cumulative histogram passes @percent of @total,
+ * as vips_percent().
+ */
+static int
+vips_stats_percentile(guint64 *bins, int nbins, guint64 total,
+	double percent)
+{
+	const double limit = percent / 100.0 * total;
+
+	guint64 cum;
+	int i;
+
+	cum = 0;
+	for (i = 0; i < nbins; i++) {
+		cum += bins[i];
+		if (cum > limit)
+			return i;
+	}
+
+	return nbins;
+}
+
+/* Make @hist and fill the percentile columns of @out.
+ */
+static int
+vips_stats_build_hist(VipsStats *stats)
+{
+	VipsStatistic *statistic = VIPS_STATISTIC(stats);
+	const int bands = vips_image_get_bands(statistic->ready);
+	const int nbins = vips_stats_nbins(statistic) == 256
+		? 256
+		: stats->mx + 1;
+	const guint64 pels = VIPS_IMAGE_N_PELS(statistic->ready);
+	const gboolean large = pels >= ((guint64) 1 << 32);
+
+	double *percent;
+	int n;
+	guint64 *all;
+	VipsImage *hist;
+	VipsPel *line;
+	int b, i, x;
+
+	percent = vips_array_double_get(stats->percent, &n);
+
+	/* The histogram of all bands together, for row 0.
+	 */
+	all = VIPS_ARRAY(stats, nbins, guint64);
+	memset(all, 0, nbins * sizeof(guint64));
+	for (b = 0; b < bands; b++)
+		for (x = 0; x < nbins; x++)
+			all[x] += stats->bins[b][x];
+
+	for (i = 0; i < n; i++) {
+		VIPS_MATRIX(stats->out, COL_LAST + i, 0)[0] =
+			vips_stats_percentile(all, nbins, pels * bands, percent[i]);
+
+		for (b = 0; b < bands; b++)
+			VIPS_MATRIX(stats->out, COL_LAST + i, b + 1)[0] =
+				vips_stats_percentile(stats->bins[b], nbins, pels,
+					percent[i]);
+	}
+
+	/* Interleave for output, as vips_hist_find().
+	 */
+	hist = vips_image_new();
+	g_object_set(stats, "hist", hist, NULL);
+	vips_image_init_fields(hist,
+		nbins, 1, bands,
+		large ? VIPS_FORMAT_DOUBLE : VIPS_FORMAT_UINT,
+		VIPS_CODING_NONE, VIPS_INTERPRETATION_HISTOGRAM, 1.0, 1.0);
+	if (!(line = VIPS_ARRAY(stats, VIPS_IMAGE_SIZEOF_LINE(hist), VipsPel)))
+		return -1;
+
+	for (x = 0; x < nbins; x++)
+		for (b = 0; b < bands; b++)
+			if (large)
+				((double *) line)[x * bands + b] = stats->bins[b][x];
+			else
+				((unsigned int *) line)[x * bands + b] = stats->bins[b][x];
+
+	if (vips_image_write_line(hist, 0, line))
+		return -1;
+
+	return 0;
+}
+
 static int
 vips_stats_build(VipsObject *object)
 {
@@ -119,8 +271,23 @@ vips_stats_build(VipsObject *object)
 		if (vips_check_noncomplex(class->nickname, statistic->in))
 			return -1;
 
+		if (stats->percent) {
+			double *percent;
+			int n;
+
+			percent = vips_array_double_get(stats->percent, &n);
+			for (i = 0; i < n; i++)
+				if (percent[i] < 0 ||
+					percent[i] > 100) {
+					vips_error(class->nickname,
+						"%s", _("percent out of range"));
+					return -1;
+				}
+		}
+
 		g_object_set(object,
-			"out", vips_image_new_matrix(COL_LAST, bands + 1),
+			"out",
+			vips_image_new_matrix(vips_stats_ncols(stats), bands + 1),
 			NULL);
 	}
 
@@ -170,6 +337,10 @@ vips_stats_build(VipsObject *object)
 			(row0[COL_SUM] * row0[COL_SUM] / vals)) /
 		(vals - 1));
 
+	if (stats->bins &&
+		vips_stats_build_hist(stats))
+		return -1;
+
 	return 0;
 }
 
@@ -181,6 +352,7 @@ vips_stats_stop(VipsStatistic *statistic, void *seq)
 	int bands = vips_image_get_bands(statistic->ready);
 	VipsStats *global = (VipsStats *) statistic;
 	VipsStats *local = (VipsStats *) seq;
+	const int ncols = vips_stats_ncols(global);
 
 	int b;
 
@@ -191,7 +363,7 @@ vips_stats_stop(VipsStatistic *statistic, void *seq)
 
 			int i;
 
-			for (i = 0; i < COL_LAST; i++)
+			for (i = 0; i < ncols; i++)
 				q[i] = p[i];
 		}
 
@@ -219,6 +391,22 @@ vips_stats_stop(VipsStatistic *statistic, void *seq)
 		}
 	}
 
+	if (local->bins) {
+		const int nbins = vips_stats_nbins(statistic);
+
+		int x;
+
+		if (!global->bins)
+			global->bins = vips_stats_bins_new(statistic);
+		for (b = 0; b < bands; b++)
+			for (x = 0; x <= local->mx; x++)
+				global->bins[b][x] += local->bins[b][x];
+		global->mx = VIPS_MAX(global->mx, local->mx);
+
+		g_assert(global->mx < nbins);
+	}
+
+	vips_stats_bins_free(statistic, local->bins);
 	VIPS_FREEF(g_object_unref, local->out);
 	VIPS_FREEF(g_free, seq);
 
@@ -232,14 +420,19 @@ vips_stats_start(VipsStatistic *statistic)
 {
 	int bands = vips_image_get_bands(statistic->ready);
 
+	VipsStats *global = (VipsStats *) statistic;
+
 	VipsStats *stats;
 
-	stats = g_new(VipsStats, 1);
-	if (!(stats->out = vips_image_new_matrix(COL_LAST, bands + 1))) {
+	stats = g_new0(VipsStats, 1);
+	if (!(stats->out = vips_image_new_matrix(vips_stats_ncols(global),
+			  bands + 1))) {
 		g_free(stats);
 		return NULL;
 	}
 	stats->set = FALSE;
+	if (global->percent)
+		stats->bins = vips_stats_bins_new(statistic);
 
 	return (void *) stats;
 }
@@ -375,6 +568,33 @@ vips_stats_start(VipsStatistic *statistic)
 		local->set = TRUE; \
 	}
 
+/* Histogram each band, clipping and truncating to the bin range as
+ * vips_cast() would. NaN goes to bin 0.
+ */
+#define HIST(TYPE) \
+	{ \
+		const double top = nbins - 1; \
+		int mx = local->mx; \
+\
+		for (b = 0; b < bands; b++) { \
+			TYPE *p = ((TYPE *) in) + b; \
+			guint64 *bins = local->bins[b]; \
+\
+			for (i = 0; i < n; i++) { \
+				double value = *p; \
+				int v = value > 0 ? (int) VIPS_MIN(value, top) : 0; \
+\
+				if (v > mx) \
+					mx = v; \
+				bins[v] += 1; \
+\
+				p += bands; \
+			} \
+		} \
+\
+		local->mx = mx; \
+	}
+
 /* Loop over region, accumulating a sum in *tmp.
  */
 static int
@@ -416,9 +636,54 @@ vips_stats_scan(VipsStatistic *statistic, void *seq,
 		g_assert_not_reached();
 	}
 
+	if (local->bins) {
+		const int nbins = vips_stats_nbins(statistic);
+
+		switch (vips_image_get_format(statistic->ready)) {
+		case VIPS_FORMAT_UCHAR:
+			HIST(unsigned char);
+			break;
+		case VIPS_FORMAT_CHAR:
+			HIST(signed char);
+			break;
+		case VIPS_FORMAT_USHORT:
+			HIST(unsigned short);
+			break;
+		case VIPS_FORMAT_SHORT:
+			HIST(signed short);
+			break;
+		case VIPS_FORMAT_UINT:
+			HIST(unsigned int);
+			break;
+		case VIPS_FORMAT_INT:
+			HIST(signed int);
+			break;
+		case VIPS_FORMAT_FLOAT:
+			HIST(float);
+			break;
+		case VIPS_FORMAT_DOUBLE:
+			HIST(double);
+			break;
+
+		default:
+			g_assert_not_reached();
+		}
+	}
+
 	return 0;
 }
 
+static void
+vips_stats_dispose(GObject *gobject)
+{
+	VipsStats *stats = (VipsStats *) gobject;
+
+	vips_stats_bins_free(VIPS_STATISTIC(stats), stats->bins);
+	stats->bins = NULL;
+
+	G_OBJECT_CLASS(vips_stats_parent_class)->dispose(gobject);
+}
+
 static void
 vips_stats_class_init(VipsStatsClass *class)
 {
@@ -426,6 +691,7 @@ vips_stats_class_init(VipsStatsClass *class)
 	VipsObjectClass *object_class = (VipsObjectClass *) class;
 	VipsStatisticClass *sclass = VIPS_STATISTIC_CLASS(class);
 
+	gobject_class->dispose = vips_stats_dispose;
 	gobject_class->set_property = vips_object_set_property;
 	gobject_class->get_property = vips_object_get_property;
 
@@ -442,6 +708,19 @@ vips_stats_class_init(VipsStatsClass *class)
 		_("Output array of statistics"),
 		VIPS_ARGUMENT_REQUIRED_OUTPUT,
 		G_STRUCT_OFFSET(VipsStats, out));
+
+	VIPS_ARG_BOXED(class, "percent", 110,
+		_("Percent"),
+		_("Find thresholds for these percents of pixels"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsStats, percent),
+		VIPS_TYPE_ARRAY_DOUBLE);
+
+	VIPS_ARG_IMAGE(class, "hist", 111,
+		_("Histogram"),
+		_("Output histogram, if percent is set"),
+		VIPS_ARGUMENT_OPTIONAL_OUTPUT,
+		G_STRUCT_OFFSET(VipsStats, hist));
 }
 
 static void
@@ -469,8 +748,23 @@ vips_stats_init(VipsStats *stats)
  * If there is more than one maxima or minima, one of them will be chosen at
  * random.
  *
+ * Set @percent to an array of percentages to find percentile thresholds in
+ * the same pass. Each adds a column after the ten above, holding the
+ * threshold below which that percent of values lie, as
+ * [method@Image.percent]. Row 0 is found from all bands together.
+ *
+ * When @percent is set, @hist is also set to the histogram of @in, as
+ * [method@Image.hist_find] would make it. Set @percent to an empty array
+ * to just get the histogram. Values are cast to uchar (for uchar and char
+ * images) or ushort (for all other formats) before histogramming.
+ *
+ * ::: tip "Optional arguments"
+ *     * @percent: [struct@ArrayDouble], find these percentiles
+ *     * @hist: output [class@Image], histogram of @in
+ *
  * ::: seealso
- *     [method@Image.avg], [method@Image.min].
+ *     [method@Image.avg], [method@Image.min], [method@Image.hist_find],
+ *     [method@Image.percent].
  *
  * Returns: 0 on success, -1 on error
  */
@@ -15,6 +15,10 @@
  *	- do our own subimage positioning
  * 8/5/19
  * 	- revise in/out/dest-in/dest-out to make smoother alpha
+ * 18/10/26
+ * 	- skip layers which are transparent or hidden over a whole tile
+ * 	- add a highway path for uchar and ushort RGBA over/multiply/screen
+ * 	- index layers by row, blend only the spans each layer covers
  */
 
 /*
@@ -63,6 +67,7 @@
 #endif
 
 #include <vips/vips.h>
+#include <vips/vector.h>
 #include <vips/internal.h>
 #include <vips/debug.h>
 
@@ -72,6 +77,10 @@
  */
 #define MAX_BANDS (64)
 
+/* Layers are bucketed into bands of rows this high.
+ */
+#define INDEX_HEIGHT (256)
+
 /* Uncomment to disable the vector path ... handy for debugging.
 #undef HAVE_VECTOR_ARITH
  */
@@ -130,6 +139,14 @@ typedef struct _VipsCompositeBase {
 	 */
 	gboolean skippable;
 
+	/* In skippable mode, for each band of INDEX_HEIGHT rows of the
+	 * output, the layers (not including the base) which touch it, in
+	 * stack order.
+	 */
+	int n_index;
+	int **index;
+	int *index_n;
+
 } VipsCompositeBase;
 
 typedef VipsConversionClass VipsCompositeBaseClass;
@@ -155,6 +172,12 @@ vips_composite_base_dispose(GObject *gobject)
 		composite->mode = nullptr;
 	}
 	VIPS_FREE(composite->subimages);
+	if (composite->index) {
+		for (int i = 0; i < composite->n_index; i++)
+			VIPS_FREE(composite->index[i]);
+		VIPS_FREE(composite->index);
+	}
+	VIPS_FREE(composite->index_n);
 
 	G_OBJECT_CLASS(vips_composite_base_parent_class)->dispose(gobject);
 }
@@ -192,9 +215,26 @@ typedef struct {
 	 */
 	int *enabled;
 
-	/* For each enabled image, an input pointer.
+	/* For each enabled image, the blend mode, and scratch space for
+	 * selecting layers.
+	 */
+	int *mode;
+	int *keep;
+
+	/* For each input image, the part of the request it covers.
 	 */
+	VipsRect *hit;
+
+	/* Span breakpoints along a line.
+	 */
+	int *xs;
+
+	/* The @pn layers we are blending for this span: an input pointer
+	 * and a blend mode for each.
+	 */
+	int pn;
 	VipsPel **p;
+	int *pmode;
 
 } VipsCompositeSequence;
 
@@ -252,6 +292,11 @@ vips_composite_stop(void *vseq, void *a, void *b)
 
 	VIPS_FREE(seq->enabled);
 	VIPS_FREE(seq->p);
+	VIPS_FREE(seq->mode);
+	VIPS_FREE(seq->keep);
+	VIPS_FREE(seq->hit);
+	VIPS_FREE(seq->xs);
+	VIPS_FREE(seq->pmode);
 
 #ifdef HAVE_VECTOR_ARITH
 	VIPS_FREEF(vips_free_aligned, seq);
@@ -285,6 +330,11 @@ vips_composite_start(VipsImage *out, void *a, void *b)
 	seq->input_regions = nullptr;
 	seq->enabled = nullptr;
 	seq->p = nullptr;
+	seq->mode = nullptr;
+	seq->keep = nullptr;
+	seq->hit = nullptr;
+	seq->xs = nullptr;
+	seq->pmode = nullptr;
 
 	/* How many images?
 	 */
@@ -310,8 +360,18 @@ vips_composite_start(VipsImage *out, void *a, void *b)
 
 	seq->enabled = VIPS_ARRAY(NULL, n, int);
 	seq->p = VIPS_ARRAY(NULL, n, VipsPel *);
+	seq->mode = VIPS_ARRAY(NULL, n, int);
+	seq->keep = VIPS_ARRAY(NULL, n, int);
+	seq->hit = VIPS_ARRAY(NULL, n, VipsRect);
+	seq->xs = VIPS_ARRAY(NULL, 2 * n + 2, int);
+	seq->pmode = VIPS_ARRAY(NULL, n, int);
 	if (!seq->enabled ||
-		!seq->p) {
+		!seq->p ||
+		!seq->mode ||
+		!seq->keep ||
+		!seq->hit ||
+		!seq->xs ||
+		!seq->pmode) {
 		vips_composite_stop(seq, nullptr, nullptr);
 		return nullptr;
 	}
@@ -442,6 +502,28 @@ vips_composite_base_select(VipsCompositeSequence *seq, VipsRect *r)
 {
 	VipsCompositeBase *composite = seq->composite;
 	int n = composite->in->area.n;
+	int first = r->top / INDEX_HEIGHT;
+	int last = (VIPS_RECT_BOTTOM(r) - 1) / INDEX_HEIGHT;
+
+	/* Usually the request falls within a single band of the index, so
+	 * we only need to test the layers there. The base always overlaps.
+	 */
+	if (composite->index &&
+		first == last &&
+		first < composite->n_index) {
+		int *index = composite->index[first];
+
+		seq->enabled[0] = 0;
+		seq->n = 1;
+		for (int k = 0; k < composite->index_n[first]; k++)
+			if (vips_rect_overlapsrect(r,
+					&composite->subimages[index[k]])) {
+				seq->enabled[seq->n] = index[k];
+				seq->n += 1;
+			}
+
+		return;
+	}
 
 	seq->n = 0;
 	for (int i = 0; i < n; i++)
@@ -453,6 +535,56 @@ vips_composite_base_select(VipsCompositeSequence *seq, VipsRect *r)
 		}
 }
 
+/* Bucket the layers by band of output rows.
+ */
+static int
+vips_composite_base_index(VipsCompositeBase *composite)
+{
+	int n = composite->in->area.n;
+	int height = composite->subimages[0].height;
+
+	composite->n_index = VIPS_ROUND_UP(height, INDEX_HEIGHT) / INDEX_HEIGHT;
+	if (!(composite->index = VIPS_ARRAY(NULL, composite->n_index, int *)) ||
+		!(composite->index_n = VIPS_ARRAY(NULL, composite->n_index, int)))
+		return -1;
+	for (int k = 0; k < composite->n_index; k++) {
+		composite->index[k] = nullptr;
+		composite->index_n[k] = 0;
+	}
+
+	/* Count, allocate, then fill.
+	 */
+	for (int pass = 0; pass < 2; pass++) {
+		for (int i = 1; i < n; i++) {
+			VipsRect *rect = &composite->subimages[i];
+			int first = VIPS_MAX(0, rect->top / INDEX_HEIGHT);
+			int last = VIPS_MIN(composite->n_index - 1,
+				(VIPS_RECT_BOTTOM(rect) - 1) / INDEX_HEIGHT);
+
+			if (vips_rect_isempty(rect) ||
+				VIPS_RECT_BOTTOM(rect) <= 0)
+				continue;
+
+			for (int k = first; k <= last; k++) {
+				if (pass == 1)
+					composite->index[k][composite->index_n[k]] = i;
+				composite->index_n[k] += 1;
+			}
+		}
+
+		if (pass == 0)
+			for (int k = 0; k < composite->n_index; k++) {
+				if (composite->index_n[k] &&
+					!(composite->index[k] = VIPS_ARRAY(NULL,
+						  composite->index_n[k], int)))
+					return -1;
+				composite->index_n[k] = 0;
+			}
+	}
+
+	return 0;
+}
+
 /* Cairo naming conventions:
  *
  * aR	alpha of result
@@ -1135,9 +1267,7 @@ static void
 vips_combine_pixels(VipsCompositeSequence *seq, VipsPel *q)
 {
 	VipsCompositeBase *composite = seq->composite;
-	VipsBlendMode *mode = (VipsBlendMode *) composite->mode->area.data;
-	int n_mode = composite->mode->area.n;
-	int n = seq->n;
+	int n = seq->pn;
 	int bands = composite->bands;
 	T *restrict tq = (T *restrict) q;
 	T **restrict tp = (T * *restrict) seq->p;
@@ -1155,12 +1285,9 @@ vips_combine_pixels(VipsCompositeSequence *seq, VipsPel *q)
 		for (int b = 0; b < bands; b++)
 			B[b] *= aB;
 
-	for (int i = 1; i < n; i++) {
-		int j = seq->enabled[i];
-		VipsBlendMode m = n_mode == 1 ? mode[0] : mode[j - 1];
-
-		vips_composite_base_blend<T>(composite, m, B, tp[i]);
-	}
+	for (int i = 1; i < n; i++)
+		vips_composite_base_blend<T>(composite,
+			(VipsBlendMode) seq->pmode[i], B, tp[i]);
 
 	/* Unpremultiply, if necessary.
 	 */
@@ -1200,9 +1327,7 @@ static void
 vips_combine_pixels3(VipsCompositeSequence *seq, VipsPel *q)
 {
 	VipsCompositeBase *composite = seq->composite;
-	VipsBlendMode *mode = (VipsBlendMode *) composite->mode->area.data;
-	int n_mode = composite->mode->area.n;
-	int n = seq->n;
+	int n = seq->pn;
 	T *restrict tq = (T *restrict) q;
 	T **restrict tp = (T * *restrict) seq->p;
 
@@ -1224,12 +1349,9 @@ vips_combine_pixels3(VipsCompositeSequence *seq, VipsPel *q)
 		B[3] = aB;
 	}
 
-	for (int i = 1; i < n; i++) {
-		int j = seq->enabled[i];
-		VipsBlendMode m = n_mode == 1 ? mode[0] : mode[j - 1];
-
-		vips_composite_base_blend3<T>(seq, m, B, tp[i]);
-	}
+	for (int i = 1; i < n; i++)
+		vips_composite_base_blend3<T>(seq,
+			(VipsBlendMode) seq->pmode[i], B, tp[i]);
 
 	/* Unpremultiply, if necessary.
 	 */
@@ -1263,46 +1385,115 @@ vips_combine_pixels3(VipsCompositeSequence *seq, VipsPel *q)
 }
 #endif /*HAVE_VECTOR_ARITH*/
 
-static int
-vips_composite_base_gen(VipsRegion *output_region,
-	void *vseq, void *a, void *b, gboolean *stop)
+static gboolean vips_composite_mode_skippable(VipsBlendMode mode);
+
+/* Is the alpha of a prepared layer all zero, or all max_alpha, over @r?
+ */
+template <typename T>
+static void
+vips_composite_alpha_range(VipsRegion *region, VipsRect *r,
+	int bands, double max_alpha, gboolean *transparent, gboolean *opaque)
 {
-	VipsCompositeSequence *seq = (VipsCompositeSequence *) vseq;
-	VipsCompositeBase *composite = (VipsCompositeBase *) b;
-	VipsRect *r = &output_region->valid;
-	int ps = VIPS_IMAGE_SIZEOF_PEL(output_region->im);
+	*transparent = TRUE;
+	*opaque = TRUE;
 
-	VIPS_DEBUG_MSG("vips_composite_base_gen: at %d x %d, size %d x %d\n",
-		r->left, r->top, r->width, r->height);
+	for (int y = 0; y < r->height; y++) {
+		T *p = (T *) VIPS_REGION_ADDR(region, r->left, r->top + y);
 
-	/* Find the subset of our input images which intersect this region.
-	 */
-	vips_composite_base_select(seq, r);
+		for (int x = 0; x < r->width; x++) {
+			T alpha = p[bands];
 
-	VIPS_DEBUG_MSG("  selected %d images\n", seq->n);
+			if (alpha != 0)
+				*transparent = FALSE;
+			if (alpha != max_alpha)
+				*opaque = FALSE;
+			if (!*transparent &&
+				!*opaque)
+				return;
 
-	/* Is there just one? We can prepare directly to output and return.
-	 */
-	if (seq->n == 1) {
-		/* This can only be the background image, since it's the only
-		 * image which exactly fills the whole output.
-		 */
-		g_assert(seq->enabled[0] == 0);
+			p += bands + 1;
+		}
+	}
+}
 
-		if (vips_region_prepare(seq->input_regions[0], r))
-			return -1;
-		if (vips_region_region(output_region, seq->input_regions[0],
-				r, r->left, r->top))
-			return -1;
+static void
+vips_composite_base_alpha_range(VipsCompositeBase *composite,
+	VipsRegion *region, VipsRect *r,
+	gboolean *transparent, gboolean *opaque)
+{
+	int bands = composite->bands;
+	double max_alpha = composite->max_band[bands];
 
-		return 0;
+	switch (region->im->BandFmt) {
+	case VIPS_FORMAT_UCHAR:
+		vips_composite_alpha_range<unsigned char>(region, r,
+			bands, max_alpha, transparent, opaque);
+		break;
+
+	case VIPS_FORMAT_CHAR:
+		vips_composite_alpha_range<signed char>(region, r,
+			bands, max_alpha, transparent, opaque);
+		break;
+
+	case VIPS_FORMAT_USHORT:
+		vips_composite_alpha_range<unsigned short>(region, r,
+			bands, max_alpha, transparent, opaque);
+		break;
+
+	case VIPS_FORMAT_SHORT:
+		vips_composite_alpha_range<signed short>(region, r,
+			bands, max_alpha, transparent, opaque);
+		break;
+
+	case VIPS_FORMAT_UINT:
+		vips_composite_alpha_range<unsigned int>(region, r,
+			bands, max_alpha, transparent, opaque);
+		break;
+
+	case VIPS_FORMAT_INT:
+		vips_composite_alpha_range<signed int>(region, r,
+			bands, max_alpha, transparent, opaque);
+		break;
+
+	case VIPS_FORMAT_FLOAT:
+		vips_composite_alpha_range<float>(region, r,
+			bands, max_alpha, transparent, opaque);
+		break;
+
+	case VIPS_FORMAT_DOUBLE:
+		vips_composite_alpha_range<double>(region, r,
+			bands, max_alpha, transparent, opaque);
+		break;
+
+	default:
+		g_assert_not_reached();
 	}
+}
 
-	/* Prepare the appropriate parts into our set of composite
-	 * regions.
-	 */
-	for (int i = 0; i < seq->n; i++) {
+/* Prepare the enabled layers into our set of composite regions.
+ *
+ * We work down from the top of the stack. A layer which is fully
+ * transparent over the part of @r it covers has no effect in skippable modes and
+ * can be dropped. A layer which is fully opaque and in OVER mode hides
+ * everything beneath it, so it becomes the base and we need not compute
+ * any of the lower layers.
+ */
+static int
+vips_composite_base_prepare(VipsCompositeSequence *seq, VipsRect *r)
+{
+	VipsCompositeBase *composite = seq->composite;
+	VipsBlendMode *mode = (VipsBlendMode *) composite->mode->area.data;
+	int n_mode = composite->mode->area.n;
+
+	int n_keep;
+	int i;
+
+	n_keep = 0;
+	for (i = seq->n - 1; i >= 0; i--) {
 		int j = seq->enabled[i];
+		VipsBlendMode m = i == 0
+			? VIPS_BLEND_MODE_OVER
+			: n_mode == 1 ? mode[0] : mode[j - 1];
 
 		VipsRect hit;
 		VipsRect request;
@@ -1324,11 +1515,16 @@ vips_composite_base_gen(VipsRegion *output_region,
 		request.left -= composite->subimages[j].left;
 		request.top -= composite->subimages[j].top;
 
+		seq->hit[j] = hit;
+
 		/* If the request is smaller than the target region, there
-		 * will be some gaps. We must make sure these are zero.
+		 * will be some gaps. In skippable mode we only blend the
+		 * part each layer covers, otherwise we must make sure these
+		 * are zero.
 		 */
-		if (request.width < r->width ||
-			request.height < r->height)
+		if (!composite->skippable &&
+			(request.width < r->width ||
+				request.height < r->height))
 			vips_region_black(seq->composite_regions[j]);
 
 		/* And render the right part of the input image to the
@@ -1344,89 +1540,296 @@ vips_composite_base_gen(VipsRegion *output_region,
 					hit.left, hit.top))
 				return -1;
 		}
+
+		if (i > 0) {
+			gboolean transparent;
+			gboolean opaque;
+
+			vips_composite_base_alpha_range(composite,
+				seq->composite_regions[j], &hit,
+				&transparent, &opaque);
+			opaque = opaque &&
+				vips_rect_equalsrect(&hit, r);
+
+			if (transparent &&
+				!composite->premultiplied &&
+				vips_composite_mode_skippable(m)) {
+				VIPS_DEBUG_MSG("  input %d transparent\n", j);
+				continue;
+			}
+
+			if (opaque &&
+				m == VIPS_BLEND_MODE_OVER) {
+				VIPS_DEBUG_MSG("  input %d opaque\n", j);
+				seq->keep[n_keep++] = i;
+				break;
+			}
+		}
+
+		seq->keep[n_keep++] = i;
 	}
 
-	VIPS_GATE_START("vips_composite_base_gen: work");
+	/* keep[] is top-down, and the last entry is the new base.
+	 */
+	for (i = 0; i < n_keep; i++) {
+		int k = seq->keep[n_keep - 1 - i];
+		int j = seq->enabled[k];
+
+		seq->enabled[i] = j;
+		seq->mode[i] = i == 0
+			? VIPS_BLEND_MODE_OVER
+			: n_mode == 1 ? mode[0] : mode[j - 1];
+	}
+	seq->n = n_keep;
 
-	for (int y = 0; y < r->height; y++) {
-		VipsPel *q;
+	return 0;
+}
 
-		for (int i = 0; i < seq->n; i++) {
-			int j = seq->enabled[i];
+/* Blend a run of @width pixels through the @pn layers in @seq.
+ */
+static int
+vips_composite_base_blend_run(VipsCompositeSequence *seq, VipsPel *q,
+	int width, gboolean hwy, const float *max_band)
+{
+	VipsCompositeBase *composite = seq->composite;
+	VipsBandFormat format = seq->input_regions[0]->im->BandFmt;
+	int ps = VIPS_IMAGE_SIZEOF_PEL(seq->input_regions[0]->im);
+
+#ifdef HAVE_HWY
+	if (hwy) {
+		if (format == VIPS_FORMAT_UCHAR)
+			vips_composite_uchar_hwy(q, seq->p, seq->pmode,
+				seq->pn, width, max_band,
+				composite->premultiplied);
+		else
+			vips_composite_ushort_hwy(q, seq->p, seq->pmode,
+				seq->pn, width, max_band,
+				composite->premultiplied);
 
-			seq->p[i] = VIPS_REGION_ADDR(seq->composite_regions[j],
-				r->left, r->top + y);
-		}
-		q = VIPS_REGION_ADDR(output_region, r->left, r->top + y);
+		return 0;
+	}
+#endif /*HAVE_HWY*/
 
-		for (int x = 0; x < r->width; x++) {
-			switch (seq->input_regions[0]->im->BandFmt) {
-			case VIPS_FORMAT_UCHAR:
+	for (int x = 0; x < width; x++) {
+		switch (format) {
+		case VIPS_FORMAT_UCHAR:
 #ifdef HAVE_VECTOR_ARITH
-				if (composite->bands == 3)
-					vips_combine_pixels3<unsigned char,
-						0, UCHAR_MAX>(seq, q);
-				else
+			if (composite->bands == 3)
+				vips_combine_pixels3<unsigned char,
+					0, UCHAR_MAX>(seq, q);
+			else
 #endif
-					vips_combine_pixels<unsigned char,
-						0, UCHAR_MAX>(seq, q);
-				break;
+				vips_combine_pixels<unsigned char,
+					0, UCHAR_MAX>(seq, q);
+			break;
 
-			case VIPS_FORMAT_CHAR:
-				vips_combine_pixels<signed char,
-					SCHAR_MIN, SCHAR_MAX>(seq, q);
-				break;
+		case VIPS_FORMAT_CHAR:
+			vips_combine_pixels<signed char,
+				SCHAR_MIN, SCHAR_MAX>(seq, q);
+			break;
 
-			case VIPS_FORMAT_USHORT:
+		case VIPS_FORMAT_USHORT:
 #ifdef HAVE_VECTOR_ARITH
-				if (composite->bands == 3)
-					vips_combine_pixels3<unsigned short,
-						0, USHRT_MAX>(seq, q);
-				else
+			if (composite->bands == 3)
+				vips_combine_pixels3<unsigned short,
+					0, USHRT_MAX>(seq, q);
+			else
 #endif
-					vips_combine_pixels<unsigned short,
-						0, USHRT_MAX>(seq, q);
-				break;
+				vips_combine_pixels<unsigned short,
+					0, USHRT_MAX>(seq, q);
+			break;
 
-			case VIPS_FORMAT_SHORT:
-				vips_combine_pixels<signed short,
-					SHRT_MIN, SHRT_MAX>(seq, q);
-				break;
+		case VIPS_FORMAT_SHORT:
+			vips_combine_pixels<signed short,
+				SHRT_MIN, SHRT_MAX>(seq, q);
+			break;
 
-			case VIPS_FORMAT_UINT:
-				vips_combine_pixels<unsigned int,
-					0, UINT_MAX>(seq, q);
-				break;
+		case VIPS_FORMAT_UINT:
+			vips_combine_pixels<unsigned int,
+				0, UINT_MAX>(seq, q);
+			break;
 
-			case VIPS_FORMAT_INT:
-				vips_combine_pixels<signed int,
-					INT_MIN, INT_MAX>(seq, q);
-				break;
+		case VIPS_FORMAT_INT:
+			vips_combine_pixels<signed int,
+				INT_MIN, INT_MAX>(seq, q);
+			break;
 
-			case VIPS_FORMAT_FLOAT:
+		case VIPS_FORMAT_FLOAT:
 #ifdef HAVE_VECTOR_ARITH
-				if (composite->bands == 3)
-					vips_combine_pixels3<float,
-						0, USHRT_MAX>(seq, q);
-				else
+			if (composite->bands == 3)
+				vips_combine_pixels3<float,
+					0, USHRT_MAX>(seq, q);
+			else
 #endif
-					vips_combine_pixels<float,
-						0, 0>(seq, q);
-				break;
-
-			case VIPS_FORMAT_DOUBLE:
-				vips_combine_pixels<double,
+				vips_combine_pixels<float,
 					0, 0>(seq, q);
-				break;
+			break;
 
-			default:
-				g_assert_not_reached();
+		case VIPS_FORMAT_DOUBLE:
+			vips_combine_pixels<double,
+				0, 0>(seq, q);
+			break;
+
+		default:
+			g_assert_not_reached();
+			return -1;
+		}
+
+		for (int i = 0; i < seq->pn; i++)
+			seq->p[i] += ps;
+		q += ps;
+	}
+
+	return 0;
+}
+
+static int
+vips_composite_base_gen(VipsRegion *output_region,
+	void *vseq, void *a, void *b, gboolean *stop)
+{
+	VipsCompositeSequence *seq = (VipsCompositeSequence *) vseq;
+	VipsCompositeBase *composite = (VipsCompositeBase *) b;
+	VipsRect *r = &output_region->valid;
+	int ps = VIPS_IMAGE_SIZEOF_PEL(output_region->im);
+
+	VIPS_DEBUG_MSG("vips_composite_base_gen: at %d x %d, size %d x %d\n",
+		r->left, r->top, r->width, r->height);
+
+	/* Find the subset of our input images which intersect this region.
+	 */
+	vips_composite_base_select(seq, r);
+
+	VIPS_DEBUG_MSG("  selected %d images\n", seq->n);
+
+	/* Is there just one? We can prepare directly to output and return.
+	 */
+	if (seq->n == 1) {
+		/* This can only be the background image, since it's the only
+		 * image which exactly fills the whole output.
+		 */
+		g_assert(seq->enabled[0] == 0);
+
+		if (vips_region_prepare(seq->input_regions[0], r))
+			return -1;
+		if (vips_region_region(output_region, seq->input_regions[0],
+				r, r->left, r->top))
+			return -1;
+
+		return 0;
+	}
+
+	/* Prepare the appropriate parts into our set of composite
+	 * regions.
+	 */
+	if (vips_composite_base_prepare(seq, r))
+		return -1;
+
+	VIPS_DEBUG_MSG("  blending %d images\n", seq->n);
+
+	gboolean hwy = FALSE;
+	float max_band[4] = { 0 };
+
+#ifdef HAVE_HWY
+	/* Highway path for the most common RGBA stacks.
+	 */
+	hwy = composite->bands == 3 &&
+		(seq->input_regions[0]->im->BandFmt == VIPS_FORMAT_UCHAR ||
+			seq->input_regions[0]->im->BandFmt == VIPS_FORMAT_USHORT) &&
+		vips_vector_isenabled();
+	for (int i = 1; i < seq->n && hwy; i++)
+		if (seq->mode[i] != VIPS_BLEND_MODE_OVER &&
+			seq->mode[i] != VIPS_BLEND_MODE_MULTIPLY &&
+			seq->mode[i] != VIPS_BLEND_MODE_SCREEN)
+			hwy = FALSE;
+
+	for (int b = 0; b < 4; b++)
+		max_band[b] = composite->max_band[b];
+#endif /*HAVE_HWY*/
+
+	VIPS_GATE_START("vips_composite_base_gen: work");
+
+	for (int y = 0; y < r->height; y++) {
+		int top = r->top + y;
+
+		/* Not skippable: blend the whole line through every layer.
+		 */
+		if (!composite->skippable) {
+			for (int i = 0; i < seq->n; i++) {
+				seq->p[i] = VIPS_REGION_ADDR(
+					seq->composite_regions[seq->enabled[i]],
+					r->left, top);
+				seq->pmode[i] = seq->mode[i];
+			}
+			seq->pn = seq->n;
+
+			if (vips_composite_base_blend_run(seq,
+					VIPS_REGION_ADDR(output_region, r->left, top),
+					r->width, hwy, max_band))
 				return -1;
+
+			continue;
+		}
+
+		/* Split the line at the edges of the layers which cross it.
+		 * Each span then has a fixed set of layers over the base.
+		 */
+		int *xs = seq->xs;
+		int nx = 0;
+
+		xs[nx++] = r->left;
+		xs[nx++] = VIPS_RECT_RIGHT(r);
+		for (int i = 1; i < seq->n; i++) {
+			VipsRect *hit = &seq->hit[seq->enabled[i]];
+
+			if (top >= hit->top &&
+				top < VIPS_RECT_BOTTOM(hit)) {
+				xs[nx++] = hit->left;
+				xs[nx++] = VIPS_RECT_RIGHT(hit);
 			}
+		}
 
-			for (int i = 0; i < seq->n; i++)
-				seq->p[i] += ps;
-			q += ps;
+		/* Insertion sort, nx is small.
+		 */
+		for (int i = 1; i < nx; i++)
+			for (int k = i; k > 0 && xs[k - 1] > xs[k]; k--)
+				VIPS_SWAP(int, xs[k - 1], xs[k]);
+
+		for (int s = 0; s < nx - 1; s++) {
+			int x0 = xs[s];
+			int x1 = xs[s + 1];
+			VipsPel *q;
+
+			if (x0 == x1)
+				continue;
+
+			seq->p[0] = VIPS_REGION_ADDR(
+				seq->composite_regions[seq->enabled[0]], x0, top);
+			seq->pmode[0] = seq->mode[0];
+			seq->pn = 1;
+			for (int i = 1; i < seq->n; i++) {
+				int j = seq->enabled[i];
+				VipsRect *hit = &seq->hit[j];
+
+				if (top >= hit->top &&
+					top < VIPS_RECT_BOTTOM(hit) &&
+					x0 >= hit->left &&
+					x1 <= VIPS_RECT_RIGHT(hit)) {
+					seq->p[seq->pn] = VIPS_REGION_ADDR(
+						seq->composite_regions[j], x0, top);
+					seq->pmode[seq->pn] = seq->mode[i];
+					seq->pn += 1;
+				}
+			}
+
+			q = VIPS_REGION_ADDR(output_region, x0, top);
+
+			/* No layers over the base here, so pass it through.
+			 */
+			if (seq->pn == 1)
+				memcpy(q, seq->p[0], (size_t) (x1 - x0) * ps);
+			else if (vips_composite_base_blend_run(seq, q,
+						 x1 - x0, hwy, max_band))
+				return -1;
 		}
 	}
 
@@ -1546,6 +1949,14 @@ vips_composite_base_build(VipsObject *object)
 				composite->y_offset[i - 1];
 		}
 
+	/* In skippable mode, index the layers by row so each request only
+	 * looks at the layers near it.
+	 */
+	if (composite->skippable &&
+		n > 1 &&
+		vips_composite_base_index(composite))
+		return -1;
+
 	decode = (VipsImage **) vips_object_local_array(object, n);
 	for (int i = 0; i < n; i++)
 		if (vips_image_decode(in[i], &decode[i]))
@@ -0,0 +1,307 @@
+/* Highway RGBA blend for composite
+ *
+ * 18/10/26
+ * 	- from composite.cpp
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+
+#include <vips/vips.h>
+#include <vips/vector.h>
+#include <vips/debug.h>
+#include <vips/internal.h>
+
+#include "pconversion.h"
+
+#ifdef HAVE_HWY
+
+#undef HWY_TARGET_INCLUDE
+#define HWY_TARGET_INCLUDE "libvips/conversion/composite_hwy.cpp"
+#include <hwy/foreach_target.h>
+#include <hwy/highway.h>
+
+namespace HWY_NAMESPACE {
+
+using namespace hwy::HWY_NAMESPACE;
+
+using DF32 = ScalableTag<float>;
+using DU32 = RebindToUnsigned<DF32>;
+using DI32 = RebindToSigned<DF32>;
+constexpr DF32 df32;
+constexpr DU32 du32;
+constexpr DI32 di32;
+
+using VF32 = Vec<DF32>;
+
+// Compat for Highway versions < 1.3.0
+#ifndef HWY_LANES_CONSTEXPR
+#define HWY_LANES_CONSTEXPR
+#endif
+
+/* Blend one layer onto the accumulator. This is the arithmetic of
+ * vips_composite_base_blend3(), one pixel per lane.
+ */
+HWY_INLINE void
+vips_composite_blend_hwy(int mode, VF32 &B0, VF32 &B1, VF32 &B2, VF32 &aB,
+	VF32 A0, VF32 A1, VF32 A2, VF32 aA)
+{
+	const auto one = Set(df32, 1.0f);
+	const auto t2 = Sub(one, aA);
+	const auto aR = Add(aA, Mul(aB, t2));
+
+	if (mode == VIPS_BLEND_MODE_OVER) {
+		B0 = Add(A0, Mul(t2, B0));
+		B1 = Add(A1, Mul(t2, B1));
+		B2 = Add(A2, Mul(t2, B2));
+	}
+	else {
+		const auto t1 = Sub(one, aB);
+		const auto t3 = Mul(aA, aB);
+
+		VF32 f0, f1, f2;
+
+		if (mode == VIPS_BLEND_MODE_MULTIPLY) {
+			f0 = Mul(A0, B0);
+			f1 = Mul(A1, B1);
+			f2 = Mul(A2, B2);
+		}
+		else {
+			f0 = Sub(Add(A0, B0), Mul(A0, B0));
+			f1 = Sub(Add(A1, B1), Mul(A1, B1));
+			f2 = Sub(Add(A2, B2), Mul(A2, B2));
+		}
+
+		B0 = Add(Add(Mul(t1, A0), Mul(t2, B0)), Mul(t3, f0));
+		B1 = Add(Add(Mul(t1, A1), Mul(t2, B1)), Mul(t3, f1));
+		B2 = Add(Add(Mul(t1, A2), Mul(t2, B2)), Mul(t3, f2));
+	}
+
+	aB = aR;
+}
+
+/* As above, for one pixel.
+ */
+HWY_INLINE void
+vips_composite_blend_scalar(int mode, float *B, const float *A)
+{
+	const float aA = A[3];
+	const float aB = B[3];
+	const float t2 = 1 - aA;
+
+	if (mode == VIPS_BLEND_MODE_OVER)
+		for (int b = 0; b < 3; b++)
+			B[b] = A[b] + t2 * B[b];
+	else {
+		const float t1 = 1 - aB;
+		const float t3 = aA * aB;
+
+		for (int b = 0; b < 3; b++) {
+			float f = mode == VIPS_BLEND_MODE_MULTIPLY
+				? A[b] * B[b]
+				: A[b] + B[b] - A[b] * B[b];
+
+			B[b] = t1 * A[b] + t2 * B[b] + t3 * f;
+		}
+	}
+
+	B[3] = aA + aB * t2;
+}
+
+template <typename T>
+HWY_INLINE void
+vips_composite_load_hwy(const T *HWY_RESTRICT p, const float *max_band,
+	bool premultiplied, VF32 &A0, VF32 &A1, VF32 &A2, VF32 &aA)
+{
+	const Rebind<T, DF32> dt;
+
+	Vec<decltype(dt)> v0, v1, v2, v3;
+
+	LoadInterleaved4(dt, p, v0, v1, v2, v3);
+	A0 = Div(ConvertTo(df32, PromoteTo(du32, v0)), Set(df32, max_band[0]));
+	A1 = Div(ConvertTo(df32, PromoteTo(du32, v1)), Set(df32, max_band[1]));
+	A2 = Div(ConvertTo(df32, PromoteTo(du32, v2)), Set(df32, max_band[2]));
+	aA = Div(ConvertTo(df32, PromoteTo(du32, v3)), Set(df32, max_band[3]));
+
+	if (!premultiplied) {
+		A0 = Mul(A0, aA);
+		A1 = Mul(A1, aA);
+		A2 = Mul(A2, aA);
+	}
+}
+
+template <typename T>
+HWY_INLINE Vec<Rebind<T, DF32>>
+vips_composite_pack_hwy(VF32 v, float max_band, float max_T)
+{
+	const Rebind<T, DF32> dt;
+
+	v = Mul(v, Set(df32, max_band));
+	v = Min(Max(v, Zero(df32)), Set(df32, max_T));
+
+	/* Truncate, as the C path.
+	 */
+	return DemoteTo(dt, ConvertTo(di32, v));
+}
+
+template <typename T>
+HWY_ATTR void
+vips_composite_line_hwy(T *HWY_RESTRICT q, T **HWY_RESTRICT p,
+	const int *HWY_RESTRICT mode, int32_t n, int32_t width,
+	const float *HWY_RESTRICT max_band, int32_t premultiplied,
+	float max_T)
+{
+	const Rebind<T, DF32> dt;
+	HWY_LANES_CONSTEXPR int32_t N = Lanes(df32);
+	const auto zero = Zero(df32);
+
+	int32_t x = 0;
+	for (; x + N <= width; x += N) {
+		VF32 B0, B1, B2, aB;
+
+		vips_composite_load_hwy(p[0] + x * 4, max_band,
+			premultiplied, B0, B1, B2, aB);
+
+		for (int32_t i = 1; i < n; i++) {
+			VF32 A0, A1, A2, aA;
+
+			vips_composite_load_hwy(p[i] + x * 4, max_band,
+				premultiplied, A0, A1, A2, aA);
+			vips_composite_blend_hwy(mode[i],
+				B0, B1, B2, aB, A0, A1, A2, aA);
+		}
+
+		/* Unpremultiply, if necessary. Lanes with zero alpha go to
+		 * zero.
+		 */
+		if (!premultiplied) {
+			const auto nonzero = Ne(aB, zero);
+
+			B0 = IfThenElseZero(nonzero, Div(B0, aB));
+			B1 = IfThenElseZero(nonzero, Div(B1, aB));
+			B2 = IfThenElseZero(nonzero, Div(B2, aB));
+		}
+
+		StoreInterleaved4(
+			vips_composite_pack_hwy<T>(B0, max_band[0], max_T),
+			vips_composite_pack_hwy<T>(B1, max_band[1], max_T),
+			vips_composite_pack_hwy<T>(B2, max_band[2], max_T),
+			vips_composite_pack_hwy<T>(aB, max_band[3], max_T),
+			dt, q + x * 4);
+	}
+
+	/* `width` was not a multiple of the vector length `N`;
+	 * proceed one by one.
+	 */
+	for (; x < width; ++x) {
+		float B[4];
+		float A[4];
+
+		for (int b = 0; b < 4; b++)
+			B[b] = p[0][x * 4 + b] / max_band[b];
+		if (!premultiplied)
+			for (int b = 0; b < 3; b++)
+				B[b] *= B[3];
+
+		for (int32_t i = 1; i < n; i++) {
+			for (int b = 0; b < 4; b++)
+				A[b] = p[i][x * 4 + b] / max_band[b];
+			if (!premultiplied)
+				for (int b = 0; b < 3; b++)
+					A[b] *= A[3];
+
+			vips_composite_blend_scalar(mode[i], B, A);
+		}
+
+		if (!premultiplied)
+			for (int b = 0; b < 3; b++)
+				B[b] = B[3] == 0 ? 0 : B[b] / B[3];
+
+		for (int b = 0; b < 4; b++)
+			q[x * 4 + b] =
+				VIPS_CLIP(0.0f, B[b] * max_band[b], max_T);
+	}
+}
+
+HWY_ATTR void
+vips_composite_uchar_hwy(uint8_t *HWY_RESTRICT q,
+	uint8_t **HWY_RESTRICT p, const int *HWY_RESTRICT mode,
+	int32_t n, int32_t width, const float *HWY_RESTRICT max_band,
+	int32_t premultiplied)
+{
+	vips_composite_line_hwy<uint8_t>(q, p, mode, n, width,
+		max_band, premultiplied, UCHAR_MAX);
+}
+
+HWY_ATTR void
+vips_composite_ushort_hwy(uint16_t *HWY_RESTRICT q,
+	uint16_t **HWY_RESTRICT p, const int *HWY_RESTRICT mode,
+	int32_t n, int32_t width, const float *HWY_RESTRICT max_band,
+	int32_t premultiplied)
+{
+	vips_composite_line_hwy<uint16_t>(q, p, mode, n, width,
+		max_band, premultiplied, USHRT_MAX);
+}
+
+} /*namespace HWY_NAMESPACE*/
+
+#if HWY_ONCE
+HWY_EXPORT(vips_composite_uchar_hwy);
+HWY_EXPORT(vips_composite_ushort_hwy);
+
+void
+vips_composite_uchar_hwy(VipsPel *q, VipsPel **p, const int *mode,
+	int n, int width, const float *max_band, gboolean premultiplied)
+{
+	/* clang-format off */
+	HWY_DYNAMIC_DISPATCH(vips_composite_uchar_hwy)(q, p, mode, n,
+		width, max_band, premultiplied);
+	/* clang-format on */
+}
+
+void
+vips_composite_ushort_hwy(VipsPel *q, VipsPel **p, const int *mode,
+	int n, int width, const float *max_band, gboolean premultiplied)
+{
+	/* clang-format off */
+	HWY_DYNAMIC_DISPATCH(vips_composite_ushort_hwy)((uint16_t *) q,
+		(uint16_t **) p, mode, n, width, max_band, premultiplied);
+	/* clang-format on */
+}
+#endif /*HWY_ONCE*/
+
+#endif /*HAVE_HWY*/
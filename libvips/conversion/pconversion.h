@@ -66,6 +66,12 @@ typedef struct _VipsConversionClass {
 
 GType vips_conversion_get_type(void);
 
+void vips_composite_uchar_hwy(VipsPel *q, VipsPel **p, const int *mode,
+	int n, int width, const float *max_band, gboolean premultiplied);
+
+void vips_composite_ushort_hwy(VipsPel *q, VipsPel **p, const int *mode,
+	int n, int width, const float *max_band, gboolean premultiplied);
+
 #ifdef __cplusplus
 }
 #endif /*__cplusplus*/
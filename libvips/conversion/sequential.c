@@ -25,6 +25,8 @@
  * 	- deprecate @trace, @access now seq is much simpler
  * 6/9/21
  * 	- don't set "persistent", it can cause huge memory use
+ * 18/10/26
+ * 	- requests behind the read point don't take the lock
  */
 
 /*
@@ -87,7 +89,8 @@ typedef struct _VipsSequential {
 	GMutex lock;
 
 	/* The next read from our source will fetch this scanline, ie. it's 0
-	 * when we start.
+	 * when we start. Only changed with the lock held, but read atomically
+	 * without it.
 	 */
 	int y_pos;
 
@@ -124,6 +127,24 @@ vips_sequential_generate(VipsRegion *out_region,
 		sequential, r->top, r->height);
 	 */
 
+	/* A request for lines we've already read can only be served from the
+	 * linecache, which has its own lock, so we needn't wait for threads
+	 * reading ahead. This is common in pipelines which are sequential from
+	 * end to end, where several threads want the same strip.
+	 */
+	if (VIPS_RECT_BOTTOM(r) <= g_atomic_int_get(&sequential->y_pos)) {
+		if (g_atomic_int_get(&sequential->error))
+			return -1;
+
+		if (vips_region_prepare(ir, r) ||
+			vips_region_region(out_region, ir, r, r->left, r->top)) {
+			g_atomic_int_set(&sequential->error, -1);
+			return -1;
+		}
+
+		return 0;
+	}
+
 	VIPS_GATE_START("vips_sequential_generate: wait");
 
 	vips__worker_lock(&sequential->lock);
@@ -156,12 +177,12 @@ vips_sequential_generate(VipsRegion *out_region,
 			area.width = 1;
 			area.height = VIPS_MIN(sequential->tile_height, r->top - area.top);
 			if (vips_region_prepare(ir, &area)) {
-				sequential->error = -1;
+				g_atomic_int_set(&sequential->error, -1);
 				g_mutex_unlock(&sequential->lock);
 				return -1;
 			}
 
-			sequential->y_pos += area.height;
+			g_atomic_int_add(&sequential->y_pos, area.height);
 		}
 	}
 
@@ -171,12 +192,13 @@ vips_sequential_generate(VipsRegion *out_region,
 	 */
 	if (vips_region_prepare(ir, r) ||
 		vips_region_region(out_region, ir, r, r->left, r->top)) {
-		sequential->error = -1;
+		g_atomic_int_set(&sequential->error, -1);
 		g_mutex_unlock(&sequential->lock);
 		return -1;
 	}
 
-	sequential->y_pos = VIPS_MAX(sequential->y_pos, VIPS_RECT_BOTTOM(r));
+	g_atomic_int_set(&sequential->y_pos,
+		VIPS_MAX(sequential->y_pos, VIPS_RECT_BOTTOM(r)));
 
 	g_mutex_unlock(&sequential->lock);
 
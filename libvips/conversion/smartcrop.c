@@ -16,6 +16,8 @@
  * 	- add all
  * 26/11/22 ejoebstl
  *  - expose location of interest when using attention based cropping
+ * 18/10/26
+ * 	- score attention in a single pass over the shrunk image
  */
 
 /*
@@ -57,6 +59,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <math.h>
 
 #include <vips/vips.h>
 #include <vips/debug.h>
@@ -175,47 +178,94 @@ vips_smartcrop_entropy(VipsSmartcrop *smartcrop,
 	return 0;
 }
 
-/* Calculate sqrt(b1^2 + b2^2 ...)
+/* The attention score for every pixel of a small XYZ image: edges on Y, plus
+ * closeness to skin colour and saturation for areas which are not too dark.
+ * This is a single loop equivalent to the chain of conv, linear, divide,
+ * ifthenelse, colourspace and sum operations we used to build.
  */
-static int
-pythagoras(VipsSmartcrop *smartcrop, VipsImage *in, VipsImage **out)
+static void
+vips_smartcrop_attention_score(VipsImage *xyz, float *score)
 {
-	VipsImage **t = (VipsImage **)
-		vips_object_local_array(VIPS_OBJECT(smartcrop),
-			2 * in->Bands + 1);
-
-	int i;
-
-	for (i = 0; i < in->Bands; i++)
-		if (vips_extract_band(in, &t[i], i, NULL))
-			return -1;
+	/* From smartcrop.js.
+	 */
+	static const float skin_vector[] = { -0.78, -0.57, -0.44 };
 
-	for (i = 0; i < in->Bands; i++)
-		if (vips_multiply(t[i], t[i], &t[i + in->Bands], NULL))
-			return -1;
+	const int width = xyz->Xsize;
+	const int height = xyz->Ysize;
 
-	if (vips_sum(&t[in->Bands], &t[2 * in->Bands], in->Bands, NULL) ||
-		vips_pow_const1(t[2 * in->Bands], out, 0.5, NULL))
-		return -1;
+	int x, y;
 
-	return 0;
+	for (y = 0; y < height; y++) {
+		/* Lines above and below, with edges copied, as conv.
+		 */
+		const float *p0 = (float *)
+			VIPS_IMAGE_ADDR(xyz, 0, VIPS_MAX(0, y - 1));
+		const float *p1 = (float *) VIPS_IMAGE_ADDR(xyz, 0, y);
+		const float *p2 = (float *)
+			VIPS_IMAGE_ADDR(xyz, 0, VIPS_MIN(height - 1, y + 1));
+		float *q = score + y * width;
+
+		for (x = 0; x < width; x++) {
+			const int xl = VIPS_MAX(0, x - 1);
+			const int xr = VIPS_MIN(width - 1, x + 1);
+			const float X = p1[x * 3];
+			const float Y = p1[x * 3 + 1];
+			const float Z = p1[x * 3 + 2];
+
+			double sum;
+			float edge;
+			float magnitude;
+			float d[3];
+			float skin;
+			float L, a, b;
+
+			/* Simple edge detect on Y, a 3x3 laplacian.
+			 */
+			sum = 0;
+			sum += -1.0 * p0[x * 3 + 1];
+			sum += -1.0 * p1[xl * 3 + 1];
+			sum += 4.0 * Y;
+			sum += -1.0 * p1[xr * 3 + 1];
+			sum += -1.0 * p2[x * 3 + 1];
+			edge = fabsf((float) sum * 5.0F);
+
+			/* Ignore dark areas.
+			 */
+			if (Y <= 5.0F) {
+				q[x] = edge;
+				continue;
+			}
+
+			/* Distance from skin point, after normalising to
+			 * magnitude of colour in XYZ. Rescale to a 100 - 0 score.
+			 */
+			magnitude = pow(X * X + Y * Y + Z * Z, 0.5);
+			d[0] = (magnitude == 0 ? 0 : X / magnitude) + skin_vector[0];
+			d[1] = (magnitude == 0 ? 0 : Y / magnitude) + skin_vector[1];
+			d[2] = (magnitude == 0 ? 0 : Z / magnitude) + skin_vector[2];
+			skin = pow(d[0] * d[0] + d[1] * d[1] + d[2] * d[2], 0.5);
+			skin = -100.0F * skin + 100.0F;
+
+			/* Saturation, as a* in Lab.
+			 */
+			vips_col_XYZ2Lab(X, Y, Z, &L, &a, &b);
+
+			q[x] = edge + skin + a;
+		}
+	}
 }
 
 static int
 vips_smartcrop_attention(VipsSmartcrop *smartcrop,
 	VipsImage *in, int *left, int *top, int *attention_x, int *attention_y)
 {
-	/* From smartcrop.js.
-	 */
-	static double skin_vector[] = { -0.78, -0.57, -0.44 };
-	static double ones[] = { 1.0, 1.0, 1.0 };
-
 	VipsImage **t = (VipsImage **)
-		vips_object_local_array(VIPS_OBJECT(smartcrop), 24);
+		vips_object_local_array(VIPS_OBJECT(smartcrop), 7);
 
 	double hscale;
 	double vscale;
 	double sigma;
+	float *score;
 	double max;
 	int x_pos;
 	int y_pos;
@@ -229,77 +279,34 @@ vips_smartcrop_attention(VipsSmartcrop *smartcrop,
 		pow(smartcrop->height * vscale, 2));
 	sigma = VIPS_MAX(sigma / 10, 1.0);
 
-	if (vips_resize(in, &t[17], hscale,
-			"vscale", vscale,
-			NULL))
-		return -1;
-
-	/* Simple edge detect.
+	/* Shrink, convert to XYZ and just use the first three bands. This is
+	 * tiny, so we can score it in memory.
 	 */
-	if (!(t[21] = vips_image_new_matrixv(3, 3,
-			  0.0, -1.0, 0.0,
-			  -1.0, 4.0, -1.0,
-			  0.0, -1.0, 0.0)))
-		return -1;
-
-	/* Convert to XYZ and just use the first three bands.
-	 */
-	if (vips_colourspace(t[17], &t[0], VIPS_INTERPRETATION_XYZ, NULL) ||
-		vips_extract_band(t[0], &t[1], 0, "n", 3, NULL))
-		return -1;
-
-	/* Edge detect on Y.
-	 */
-	if (vips_extract_band(t[1], &t[2], 1, NULL) ||
-		vips_conv(t[2], &t[3], t[21],
-			"precision", VIPS_PRECISION_INTEGER,
+	if (vips_resize(in, &t[0], hscale,
+			"vscale", vscale,
 			NULL) ||
-		vips_linear1(t[3], &t[4], 5.0, 0.0, NULL) ||
-		vips_abs(t[4], &t[14], NULL))
+		vips_colourspace(t[0], &t[1], VIPS_INTERPRETATION_XYZ, NULL) ||
+		vips_extract_band(t[1], &t[2], 0, "n", 3, NULL) ||
+		vips_cast(t[2], &t[3], VIPS_FORMAT_FLOAT, NULL) ||
+		!(t[4] = vips_image_copy_memory(t[3])))
 		return -1;
 
-	/* Look for skin colours. Taken from smartcrop.js.
-	 */
-	if (
-		/* Normalise to magnitude of colour in XYZ.
-		 */
-		pythagoras(smartcrop, t[1], &t[5]) ||
-		vips_divide(t[1], t[5], &t[6], NULL) ||
-
-		/* Distance from skin point.
-		 */
-		vips_linear(t[6], &t[7], ones, skin_vector, 3, NULL) ||
-		pythagoras(smartcrop, t[7], &t[8]) ||
-
-		/* Rescale to 100 - 0 score.
-		 */
-		vips_linear1(t[8], &t[9], -100.0, 100.0, NULL) ||
-
-		/* Ignore dark areas.
-		 */
-		vips_more_const1(t[2], &t[10], 5.0, NULL) ||
-		!(t[11] = vips_image_new_from_image1(t[10], 0.0)) ||
-		vips_ifthenelse(t[10], t[9], t[11], &t[15], NULL))
+	if (!(score = VIPS_ARRAY(smartcrop,
+			  VIPS_IMAGE_N_PELS(t[4]), float)))
 		return -1;
+	vips_smartcrop_attention_score(t[4], score);
 
-	/* Look for saturated areas.
-	 */
-	if (vips_colourspace(t[1], &t[12],
-			VIPS_INTERPRETATION_LAB, NULL) ||
-		vips_extract_band(t[12], &t[13], 1, NULL) ||
-		vips_ifthenelse(t[10], t[13], t[11], &t[16], NULL))
-		return -1;
-
-	/* Sum, blur and find maxpos.
+	/* Blur and find maxpos.
 	 *
 	 * The amount of blur is related to the size of the crop
 	 * area: how large an area we want to consider for the scoring
 	 * function.
 	 */
-
-	if (vips_sum(&t[14], &t[18], 3, NULL) ||
-		vips_gaussblur(t[18], &t[19], sigma, NULL) ||
-		vips_max(t[19], &max, "x", &x_pos, "y", &y_pos, NULL))
+	if (!(t[5] = vips_image_new_from_memory(score,
+			  VIPS_IMAGE_N_PELS(t[4]) * sizeof(float),
+			  t[4]->Xsize, t[4]->Ysize, 1, VIPS_FORMAT_FLOAT)) ||
+		vips_gaussblur(t[5], &t[6], sigma, NULL) ||
+		vips_max(t[6], &max, "x", &x_pos, "y", &y_pos, NULL))
 		return -1;
 
 	/* Transform back into image coordinates.
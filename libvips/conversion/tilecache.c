@@ -35,6 +35,9 @@
  * 	- terminate on tile calc error
  * 7/3/17
  * 	- remove "access" on linecache, use the base class instead
+ * 18/10/26
+ * 	- in non-threaded mode, only tile calculation is serialised, other
+ * 	  threads can fetch cached tiles meanwhile
  */
 
 /*
@@ -131,6 +134,7 @@ typedef struct _VipsBlockCache {
 
 	GMutex lock;	   /* Lock everything here */
 	GCond new_tile;	   /* A new tile is ready */
+	gboolean calculating; /* Non-threaded, and a tile is being made */
 	GHashTable *tiles; /* Tiles, hashed by coordinates */
 	GQueue *recycle;   /* Queue of unreffed tiles to reuse */
 } VipsBlockCache;
@@ -490,6 +494,7 @@ vips_block_cache_init(VipsBlockCache *cache)
 	cache->access = VIPS_ACCESS_RANDOM;
 	cache->threaded = FALSE;
 	cache->persistent = FALSE;
+	cache->calculating = FALSE;
 
 	g_mutex_init(&cache->lock);
 	g_cond_init(&cache->new_tile);
@@ -668,23 +673,33 @@ vips_tile_cache_gen(VipsRegion *out_region,
 		 * don't calculate all PEND tiles since after the first, more
 		 * DATA tiles might heve been made available by other threads
 		 * and we want to get them out of the way as soon as we can.
+		 *
+		 * In non-threaded mode, only one tile can be calculated at
+		 * once. When it's done, whichever waiting thread gets the lock
+		 * first starts on its next PEND tile, so there's no ordering
+		 * here. Sequential loaders are kept in order by the
+		 * vips_sequential() that sits in front of their linecache.
 		 */
 		for (p = work; p; p = p->next) {
 			tile = (VipsTile *) p->data;
 
-			if (tile->state == VIPS_TILE_STATE_PEND) {
+			if (tile->state == VIPS_TILE_STATE_PEND &&
+				(cache->threaded ||
+					!cache->calculating)) {
 				tile->state = VIPS_TILE_STATE_CALC;
+				if (!cache->threaded)
+					cache->calculating = TRUE;
 
 				VIPS_DEBUG_MSG_RED(
 					"vips_tile_cache_gen: calc of %p\n",
 					tile);
 
-				/* In threaded mode, we let other threads run
-				 * while we calc this tile. In non-threaded
-				 * mode, we keep the lock and make 'em wait.
+				/* We let other threads run while we calc this
+				 * tile, so they can fetch DATA tiles. In
+				 * non-threaded mode, any PEND tiles they
+				 * need must wait for us.
 				 */
-				if (cache->threaded)
-					g_mutex_unlock(&cache->lock);
+				g_mutex_unlock(&cache->lock);
 
 				/* Don't compute if we've seen an error
 				 * previously.
@@ -695,13 +710,13 @@ vips_tile_cache_gen(VipsRegion *out_region,
 						&tile->pos,
 						tile->pos.left, tile->pos.top);
 
-				if (cache->threaded) {
-					VIPS_GATE_START("vips_tile_cache_gen: wait2");
+				VIPS_GATE_START("vips_tile_cache_gen: wait2");
 
-					g_mutex_lock(&cache->lock);
+				g_mutex_lock(&cache->lock);
 
-					VIPS_GATE_STOP("vips_tile_cache_gen: wait2");
-				}
+				VIPS_GATE_STOP("vips_tile_cache_gen: wait2");
+
+				cache->calculating = FALSE;
 
 				/* If there was an error calculating this
 				 * tile, black it out and terminate
@@ -734,17 +749,20 @@ vips_tile_cache_gen(VipsRegion *out_region,
 			}
 		}
 
-		/* There are no PEND or DATA tiles, we must need a tile some
-		 * other thread is currently calculating.
+		/* There are no DATA tiles and no PEND tiles we can start on,
+		 * we must need a tile some other thread is currently
+		 * calculating, or be waiting for our turn to calculate.
 		 *
-		 * We must block until the CALC tiles we need are done.
+		 * We must block until another tile is done.
 		 */
 		if (!p &&
 			work) {
 			for (p = work; p; p = p->next) {
 				tile = (VipsTile *) p->data;
 
-				g_assert(tile->state == VIPS_TILE_STATE_CALC);
+				g_assert(tile->state == VIPS_TILE_STATE_CALC ||
+					(tile->state == VIPS_TILE_STATE_PEND &&
+						cache->calculating));
 			}
 
 			VIPS_DEBUG_MSG_RED("vips_tile_cache_gen: waiting\n");
@@ -855,7 +873,8 @@ vips_tile_cache_init(VipsTileCache *cache)
  * By default, @tile_width and @tile_height are 128 pixels, and the operation
  * will cache up to 1,000 tiles. @access defaults to [enum@Vips.Access.RANDOM].
  *
- * Normally, only a single thread at once is allowed to calculate tiles. If
+ * Normally, only a single thread at once is allowed to calculate tiles,
+ * though other threads can fetch cached tiles meanwhile. If
  * you set @threaded to `TRUE`, [method@Image.tilecache] will allow many
  * threads to calculate tiles at once, and share the cache between them.
  *
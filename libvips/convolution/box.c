@@ -0,0 +1,240 @@
+/* box filter from summed-area tables
+ *
+ * 18/10/26
+ * 	- from stdif.c
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vips/vips.h>
+#include <vips/internal.h>
+
+typedef struct _VipsBox {
+	VipsOperation parent_instance;
+
+	VipsImage *in;
+	VipsImage *out;
+
+	int width;
+	int height;
+	gboolean variance;
+
+} VipsBox;
+
+typedef VipsOperationClass VipsBoxClass;
+
+G_DEFINE_TYPE(VipsBox, vips_box, VIPS_TYPE_OPERATION);
+
+#define LOOP(TYPE) \
+	{ \
+		TYPE *restrict q = (TYPE *) \
+			VIPS_REGION_ADDR(out_region, r->left, r->top + y); \
+\
+		for (x = 0; x < r->width; x++) \
+			for (i = 0; i < bands; i++) { \
+				double mean, var; \
+\
+				vips__window_stats_get(stats, \
+					r->left + x, r->top + y, i, NULL, &mean, &var); \
+				*q++ = box->variance ? var : mean; \
+			} \
+	}
+
+static int
+vips_box_generate(VipsRegion *out_region,
+	void *seq, void *a, void *b, gboolean *stop)
+{
+	VipsWindowStats *stats = (VipsWindowStats *) seq;
+	VipsBox *box = (VipsBox *) b;
+	VipsRect *r = &out_region->valid;
+	const int bands = out_region->im->Bands;
+
+	int x, y, i;
+
+	if (vips__window_stats_prepare(stats, r))
+		return -1;
+
+	for (y = 0; y < r->height; y++) {
+		if (out_region->im->BandFmt == VIPS_FORMAT_DOUBLE)
+			LOOP(double)
+		else
+			LOOP(float)
+	}
+
+	return 0;
+}
+
+static int
+vips_box_build(VipsObject *object)
+{
+	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(object);
+	VipsBox *box = (VipsBox *) object;
+	VipsImage **t = (VipsImage **) vips_object_local_array(object, 2);
+
+	VipsImage *in;
+
+	if (VIPS_OBJECT_CLASS(vips_box_parent_class)->build(object))
+		return -1;
+
+	in = box->in;
+
+	if (vips_image_decode(in, &t[0]))
+		return -1;
+	in = t[0];
+
+	if (vips_check_noncomplex(class->nickname, in) ||
+		vips__window_stats_embed(class->nickname, in,
+			box->width, box->height, &t[1]))
+		return -1;
+
+	g_object_set(object, "out", vips_image_new(), NULL);
+
+	if (vips_image_pipelinev(box->out,
+			VIPS_DEMAND_STYLE_FATSTRIP, in, NULL))
+		return -1;
+	box->out->BandFmt = in->BandFmt == VIPS_FORMAT_DOUBLE
+		? VIPS_FORMAT_DOUBLE
+		: VIPS_FORMAT_FLOAT;
+
+	if (vips_image_generate(box->out,
+			vips__window_stats_start,
+			vips_box_generate,
+			vips__window_stats_stop,
+			t[1], box))
+		return -1;
+
+	vips_reorder_margin_hint(box->out, box->width * box->height);
+
+	return 0;
+}
+
+static void
+vips_box_class_init(VipsBoxClass *class)
+{
+	GObjectClass *gobject_class = G_OBJECT_CLASS(class);
+	VipsObjectClass *object_class = (VipsObjectClass *) class;
+	VipsOperationClass *operation_class = VIPS_OPERATION_CLASS(class);
+
+	gobject_class->set_property = vips_object_set_property;
+	gobject_class->get_property = vips_object_get_property;
+
+	object_class->nickname = "box";
+	object_class->description = _("box filter");
+	object_class->build = vips_box_build;
+
+	operation_class->flags = VIPS_OPERATION_SEQUENTIAL;
+
+	VIPS_ARG_IMAGE(class, "in", 1,
+		_("Input"),
+		_("Input image"),
+		VIPS_ARGUMENT_REQUIRED_INPUT,
+		G_STRUCT_OFFSET(VipsBox, in));
+
+	VIPS_ARG_IMAGE(class, "out", 2,
+		_("Output"),
+		_("Output image"),
+		VIPS_ARGUMENT_REQUIRED_OUTPUT,
+		G_STRUCT_OFFSET(VipsBox, out));
+
+	VIPS_ARG_INT(class, "width", 4,
+		_("Width"),
+		_("Window width in pixels"),
+		VIPS_ARGUMENT_REQUIRED_INPUT,
+		G_STRUCT_OFFSET(VipsBox, width),
+		1, VIPS_MAX_COORD, 11);
+
+	VIPS_ARG_INT(class, "height", 5,
+		_("Height"),
+		_("Window height in pixels"),
+		VIPS_ARGUMENT_REQUIRED_INPUT,
+		G_STRUCT_OFFSET(VipsBox, height),
+		1, VIPS_MAX_COORD, 11);
+
+	VIPS_ARG_BOOL(class, "variance", 6,
+		_("Variance"),
+		_("Find the window variance, not the mean"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsBox, variance),
+		FALSE);
+}
+
+static void
+vips_box_init(VipsBox *box)
+{
+	box->width = 11;
+	box->height = 11;
+}
+
+/**
+ * vips_box: (method)
+ * @in: input image
+ * @out: (out): output image
+ * @width: width of window
+ * @height: height of window
+ * @...: `NULL`-terminated list of optional named arguments
+ *
+ * Find the mean of a @width by @height window centred on every pixel of
+ * @in. Set @variance to find the window variance instead.
+ *
+ * The window statistics come from summed-area tables of each area of the
+ * input, so the cost per pixel does not depend on the size of the window.
+ * The input is expanded by copying edge pixels, so the output is the same
+ * size as @in. The window must be no larger than @in.
+ *
+ * @out is float, or double for double input, and has the same size and
+ * number of bands as @in.
+ *
+ * ::: tip "Optional arguments"
+ *     * @variance: `gboolean`, find the window variance
+ *
+ * ::: seealso
+ *     [method@Image.conva], [method@Image.stdif],
+ *     [method@Image.threshold_local].
+ *
+ * Returns: 0 on success, -1 on error
+ */
+int
+vips_box(VipsImage *in, VipsImage **out, int width, int height, ...)
+{
+	va_list ap;
+	int result;
+
+	va_start(ap, height);
+	result = vips_call_split("box", ap, in, out, width, height);
+	va_end(ap);
+
+	return result;
+}
@@ -150,6 +150,7 @@ vips_convolution_operation_init(void)
 	extern GType vips_convi_get_type(void);
 	extern GType vips_convsep_get_type(void);
 	extern GType vips_convasep_get_type(void);
+	extern GType vips_box_get_type(void);
 	extern GType vips_compass_get_type(void);
 	extern GType vips_fastcor_get_type(void);
 	extern GType vips_spcor_get_type(void);
@@ -167,6 +168,7 @@ vips_convolution_operation_init(void)
 	vips_compass_get_type();
 	vips_convsep_get_type();
 	vips_convasep_get_type();
+	vips_box_get_type();
 	vips_fastcor_get_type();
 	vips_spcor_get_type();
 	vips_sharpen_get_type();
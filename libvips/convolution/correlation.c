@@ -2,6 +2,10 @@
  *
  * 7/11/13
  * 	- from convolution.c
+ * 18/10/26
+ * 	- correlate in the frequency domain for large refs
+ * 	- only go to the frequency domain if the tables fit in max_mem
+ * 	- centre the tables on the input mean
  */
 
 /*
@@ -45,9 +49,126 @@
 #include "pconvolution.h"
 #include "correlation.h"
 
+/* Correlate in the frequency domain once ref has more than this many pels
+ * per bit of the number of input pels. Below that, the direct loop wins.
+ */
+#define VIPS_CORRELATION_FFT_RATIO (4)
+
+/* ... but not for inputs larger than this, since the transforms are all
+ * done in memory.
+ */
+#define VIPS_CORRELATION_FFT_MAX_PELS (2048 * 2048)
+
+/* Roughly the peak bytes per pel per band the frequency domain path needs:
+ * two complex forward transforms and their product, the real inverse and
+ * its scaled copy, and the three double tables we keep.
+ */
+#define VIPS_CORRELATION_FFT_BYTES (3 * 16 + 2 * 8 + 3 * 8)
+
 G_DEFINE_ABSTRACT_TYPE(VipsCorrelation, vips_correlation,
 	VIPS_TYPE_OPERATION);
 
+/* The sum of the ref-sized window of in_ready with top-left at (x, y), from
+ * a summed-area table of in_ready.
+ */
+double
+vips__correlation_window(VipsCorrelation *correlation,
+	VipsImage *table, int x, int y, int b)
+{
+	return vips__integral_window(table, x, y,
+		correlation->ref_ready->Xsize, correlation->ref_ready->Ysize, b);
+}
+
+#ifdef HAVE_FFTW
+static gboolean
+vips_correlation_fft_wanted(VipsCorrelation *correlation)
+{
+	VipsCorrelationClass *cclass =
+		VIPS_CORRELATION_GET_CLASS(correlation);
+	guint64 n = VIPS_IMAGE_N_PELS(correlation->in_ready);
+	guint64 bytes = n * correlation->in_ready->Bands *
+		VIPS_CORRELATION_FFT_BYTES;
+
+	/* Everything is in memory, so stay inside the operation cache size
+	 * limit and let the direct loop stream larger images.
+	 */
+	return cclass->fft_correlation &&
+		cclass->fft_format_table[correlation->in_ready->BandFmt] &&
+		n <= VIPS_CORRELATION_FFT_MAX_PELS &&
+		bytes <= vips_cache_get_max_mem() &&
+		VIPS_IMAGE_N_PELS(correlation->ref_ready) >
+		VIPS_CORRELATION_FFT_RATIO * log2(n);
+}
+
+/* Make the cross table, the sum of ref times in_ready for every position of
+ * ref, plus summed-area tables of in_ready and in_ready squared. Subclasses
+ * can make their output from these in constant time per pixel.
+ *
+ * The tables are all of in_ready less offset, the rounded per-band mean.
+ * Without that, a large DC level swamps the window variance when we
+ * subtract the two sums.
+ */
+static int
+vips_correlation_tables(VipsCorrelation *correlation)
+{
+	VipsImage *ref = correlation->ref_ready;
+	int bands = correlation->in_ready->Bands;
+	VipsImage **t = (VipsImage **)
+		vips_object_local_array(VIPS_OBJECT(correlation), 16);
+
+	VipsImage *in;
+	double *scale;
+	double *shift;
+	int i;
+
+	if (!(correlation->offset = VIPS_ARRAY(correlation, bands, double)) ||
+		!(scale = VIPS_ARRAY(correlation, bands, double)) ||
+		!(shift = VIPS_ARRAY(correlation, bands, double)) ||
+		vips_stats(correlation->in_ready, &t[13], NULL))
+		return -1;
+	for (i = 0; i < bands; i++) {
+		correlation->offset[i] = VIPS_RINT(*VIPS_MATRIX(t[13], 4, i + 1));
+		scale[i] = 1.0;
+		shift[i] = -correlation->offset[i];
+	}
+	if (vips_cast_double(correlation->in_ready, &t[14], NULL) ||
+		vips_linear(t[14], &t[15], scale, shift, bands, NULL))
+		return -1;
+	in = t[15];
+
+	/* Correlating with ref is convolving with ref turned through 180
+	 * degrees. Pad that out to the size of in_ready and multiply the
+	 * transforms. in_ready is one ref less one pel larger than out, so
+	 * the circular convolution never wraps in the part we keep.
+	 *
+	 * fwfft normalises by the number of pels, and we have two forward
+	 * transforms but only one inverse, so we must scale back up again.
+	 */
+	if (vips_rot(ref, &t[0], VIPS_ANGLE_D180, NULL) ||
+		vips_embed(t[0], &t[1], 0, 0, in->Xsize, in->Ysize, NULL) ||
+		vips_fwfft(t[1], &t[2], NULL) ||
+		vips_fwfft(in, &t[3], NULL) ||
+		vips_multiply(t[2], t[3], &t[4], NULL) ||
+		vips_invfft(t[4], &t[5], "real", TRUE, NULL) ||
+		vips_linear1(t[5], &t[6], VIPS_IMAGE_N_PELS(in), 0.0, NULL) ||
+		vips_crop(t[6], &t[7], ref->Xsize - 1, ref->Ysize - 1,
+			correlation->in->Xsize, correlation->in->Ysize, NULL) ||
+		!(t[8] = vips_image_copy_memory(t[7])))
+		return -1;
+	correlation->cross = t[8];
+
+	if (vips_integral(in, &t[9], NULL) ||
+		!(t[10] = vips_image_copy_memory(t[9])) ||
+		vips_integral(in, &t[11], "squared", TRUE, NULL) ||
+		!(t[12] = vips_image_copy_memory(t[11])))
+		return -1;
+	correlation->sum = t[10];
+	correlation->sum2 = t[12];
+
+	return 0;
+}
+#endif /*HAVE_FFTW*/
+
 static int
 vips_correlation_gen(VipsRegion *out_region,
 	void *seq, void *a, void *b, gboolean *stop)
@@ -60,6 +181,13 @@ vips_correlation_gen(VipsRegion *out_region,
 
 	VipsRect irect;
 
+	/* Frequency domain, everything is in the tables already.
+	 */
+	if (correlation->cross) {
+		cclass->fft_correlation(correlation, out_region);
+		return 0;
+	}
+
 	/* What part of ir do we need?
 	 */
 	irect.left = r->left;
@@ -103,6 +231,12 @@ vips_correlation_build(VipsObject *object)
 	correlation->in_ready = t[3];
 	correlation->ref_ready = t[5];
 
+#ifdef HAVE_FFTW
+	if (vips_correlation_fft_wanted(correlation) &&
+		vips_correlation_tables(correlation))
+		return -1;
+#endif /*HAVE_FFTW*/
+
 	g_object_set(object, "out", vips_image_new(), NULL);
 
 	/* FATSTRIP is good for us as THINSTRIP will cause
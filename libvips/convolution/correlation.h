@@ -65,6 +65,16 @@ typedef struct {
 	VipsImage *in_ready;
 	VipsImage *ref_ready;
 
+	/* If we are correlating in the frequency domain, the sum of ref times
+	 * in_ready at every position of ref, and summed-area tables of
+	 * in_ready and in_ready squared. All double memory images, and all
+	 * made from in_ready less the per-band offset.
+	 */
+	VipsImage *cross;
+	VipsImage *sum;
+	VipsImage *sum2;
+	double *offset;
+
 } VipsCorrelation;
 
 typedef struct {
@@ -81,10 +91,19 @@ typedef struct {
 	void (*correlation)(VipsCorrelation *,
 		VipsRegion *in, VipsRegion *out);
 
+	/* Optional. Make out from the cross, sum and sum2 tables. For each
+	 * upcast input format, whether this is good enough.
+	 */
+	const gboolean *fft_format_table;
+	void (*fft_correlation)(VipsCorrelation *, VipsRegion *out);
+
 } VipsCorrelationClass;
 
 GType vips_correlation_get_type(void);
 
+double vips__correlation_window(VipsCorrelation *correlation,
+	VipsImage *table, int x, int y, int b);
+
 #ifdef __cplusplus
 }
 #endif /*__cplusplus*/
@@ -24,6 +24,8 @@
  * 	- cleanups
  * 7/11/13
  * 	- redone as a class
+ * 18/10/26
+ * 	- add a frequency domain path for large 8-bit refs
  */
 
 /*
@@ -59,6 +61,8 @@
 #include <glib/gi18n-lib.h>
 
 #include <stdio.h>
+#include <string.h>
+#include <limits.h>
 #include <math.h>
 
 #include <vips/vips.h>
@@ -66,7 +70,14 @@
 #include "pconvolution.h"
 #include "correlation.h"
 
-typedef VipsCorrelationClass VipsFastcor;
+typedef struct _VipsFastcor {
+	VipsCorrelation parent_instance;
+
+	/* Per band sumij ref(i,j)^2, for the frequency domain path.
+	 */
+	double *rsum2;
+} VipsFastcor;
+
 typedef VipsCorrelationClass VipsFastcorClass;
 
 G_DEFINE_TYPE(VipsFastcor, vips_fastcor, VIPS_TYPE_CORRELATION);
@@ -187,6 +198,73 @@ vips_fastcor_correlation(VipsCorrelation *correlation,
 	}
 }
 
+static int
+vips_fastcor_pre_generate(VipsCorrelation *correlation)
+{
+	VipsFastcor *fastcor = (VipsFastcor *) correlation;
+	VipsImage *ref = correlation->ref_ready;
+	int bands = ref->Bands;
+	VipsImage **t = (VipsImage **)
+		vips_object_local_array(VIPS_OBJECT(fastcor), 2);
+
+	guint64 i;
+
+	if (!correlation->cross)
+		return 0;
+
+	if (!(fastcor->rsum2 = VIPS_ARRAY(fastcor, bands, double)) ||
+		vips_cast_double(ref, &t[0], NULL) ||
+		!(t[1] = vips_image_copy_memory(t[0])))
+		return -1;
+	memset(fastcor->rsum2, 0, bands * sizeof(double));
+	for (i = 0; i < VIPS_IMAGE_N_ELEMENTS(ref) * ref->Ysize; i++) {
+		double v = ((double *) t[1]->data)[i] -
+			correlation->offset[i % bands];
+
+		fastcor->rsum2[i % bands] += v * v;
+	}
+
+	return 0;
+}
+
+/* sumij (ref(i,j)-in(i,j))^2 is sumij ref(i,j)^2 - 2 * sumij ref(i,j)in(i,j)
+ * + sumij in(i,j)^2, and we have tables for all three. The tables are of in
+ * less offset, so we take offset from ref as well: rsum2 is already of
+ * ref less offset, and the cross term needs offset * sumij in(i,j) removing.
+ */
+static void
+vips_fastcor_fft_correlation(VipsCorrelation *correlation, VipsRegion *out)
+{
+	VipsFastcor *fastcor = (VipsFastcor *) correlation;
+	VipsRect *r = &out->valid;
+	int bands = correlation->ref_ready->Bands;
+
+	int x, y, b;
+
+	for (y = 0; y < r->height; y++) {
+		unsigned int *q = (unsigned int *)
+			VIPS_REGION_ADDR(out, r->left, r->top + y);
+		double *p = (double *)
+			VIPS_IMAGE_ADDR(correlation->cross, r->left, r->top + y);
+
+		for (x = 0; x < r->width; x++)
+			for (b = 0; b < bands; b++) {
+				double sum1 = vips__correlation_window(correlation,
+					correlation->sum, r->left + x, r->top + y, b);
+				double sum2 = vips__correlation_window(correlation,
+					correlation->sum2, r->left + x, r->top + y, b);
+				double cross = p[x * bands + b] -
+					correlation->offset[b] * sum1;
+				double sum = fastcor->rsum2[b] - 2.0 * cross + sum2;
+
+				/* 8-bit images have integer sums well inside
+				 * the precision of the transform, so this is exact.
+				 */
+				*q++ = VIPS_CLIP(0, VIPS_RINT(sum), UINT_MAX);
+			}
+	}
+}
+
 /* Save a bit of typing.
  */
 #define UC VIPS_FORMAT_UCHAR
@@ -208,6 +286,16 @@ static const VipsBandFormat vips_fastcor_format_table[10] = {
 	/* Promotion: */ UI, UI, UI, UI, UI, UI, F, X, D, DX
 };
 
+/* Only 8-bit images can't overflow the uint sum in the spatial path, so only
+ * those give the same result in the frequency domain.
+ */
+static const gboolean vips_fastcor_fft_format_table[10] = {
+	/* UC  C     US     S      UI     I */
+	TRUE, TRUE, FALSE, FALSE, FALSE, FALSE,
+	/* F   X      D      DX */
+	FALSE, FALSE, FALSE, FALSE
+};
+
 static void
 vips_fastcor_class_init(VipsFastcorClass *class)
 {
@@ -218,7 +306,10 @@ vips_fastcor_class_init(VipsFastcorClass *class)
 	object_class->description = _("fast correlation");
 
 	cclass->format_table = vips_fastcor_format_table;
+	cclass->pre_generate = vips_fastcor_pre_generate;
 	cclass->correlation = vips_fastcor_correlation;
+	cclass->fft_format_table = vips_fastcor_fft_format_table;
+	cclass->fft_correlation = vips_fastcor_fft_correlation;
 }
 
 static void
@@ -252,6 +343,11 @@ vips_fastcor_init(VipsFastcor *fastcor)
  * In other words, the output type is just large enough to hold the whole
  * range of possible values.
  *
+ * For large 8-bit @ref, the sum of products is found in the frequency
+ * domain and the sum of squares of @in from a summed-area table. The result
+ * is the same, but much quicker. The choice is made automatically, and only
+ * if the tables fit inside [func@cache_set_max_mem].
+ *
  * ::: seealso
  *     [method@Image.spcor].
  *
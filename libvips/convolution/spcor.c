@@ -38,6 +38,8 @@
  * 	- redone as a class
  * 8/4/15
  * 	- avoid /0 for constant reference or zero image
+ * 18/10/26
+ * 	- add a frequency domain path for large refs
  */
 
 /*
@@ -90,6 +92,10 @@ typedef struct _VipsSpcor {
 	/* Per band sqrt(sumij (ref(i,j)-mean(ref))^2)
 	 */
 	double *c1;
+
+	/* ref with the mean removed, as double.
+	 */
+	double *rzero;
 } VipsSpcor;
 
 typedef VipsCorrelationClass VipsSpcorClass;
@@ -106,7 +112,7 @@ vips_spcor_pre_generate(VipsCorrelation *correlation)
 	VipsImage **b = (VipsImage **)
 		vips_object_local_array(VIPS_OBJECT(spcor), bands);
 	VipsImage **t = (VipsImage **)
-		vips_object_local_array(VIPS_OBJECT(spcor), 2);
+		vips_object_local_array(VIPS_OBJECT(spcor), 4);
 	VipsImage **b2 = (VipsImage **)
 		vips_object_local_array(VIPS_OBJECT(spcor), bands);
 
@@ -148,55 +154,70 @@ vips_spcor_pre_generate(VipsCorrelation *correlation)
 		spcor->c1[i] = sqrt(spcor->c1[i]);
 	}
 
+	/* ref less its mean, ready for the product term.
+	 */
+	if (vips_cast_double(ref, &t[2], NULL) ||
+		!(t[3] = vips_image_copy_memory(t[2])) ||
+		!(spcor->rzero = VIPS_ARRAY(spcor,
+			  VIPS_IMAGE_N_ELEMENTS(ref) * ref->Ysize, double)))
+		return -1;
+	for (i = 0; i < VIPS_IMAGE_N_ELEMENTS(ref) * ref->Ysize; i++)
+		spcor->rzero[i] = ((double *) t[3]->data)[i] -
+			spcor->rmean[i % bands];
+
 	return 0;
 }
 
+/* The coefficient from the sum of the products of differences and the sum of
+ * squares of differences for this window of in.
+ */
+static float
+vips_spcor_coefficient(VipsSpcor *spcor, int b, double sum3, double sum2)
+{
+	double c2;
+
+	/* sum2 can go a little negative with rounding.
+	 */
+	c2 = spcor->c1[b] * sqrt(VIPS_MAX(0.0, sum2));
+
+	/* Something like constant ref. We regard this as uncorrelated.
+	 */
+	if (c2 == 0.0)
+		return 0.0;
+
+	return sum3 / c2;
+}
+
+/* Two passes: find the window mean, then sumij (in(i,j)-mean(inkl))^2 and
+ * sumij (ref(i,j)-mean(ref)) * (in(i,j)-mean(inkl)). Removing the mean
+ * before we square keeps float images with a large DC level accurate.
+ */
 #define LOOP(IN) \
 	{ \
-		IN *r1 = ((IN *) ref->data) + b; \
 		IN *p1 = ((IN *) p) + b; \
+		double *r1 = spcor->rzero + b; \
 		int in_lsk = lsk / sizeof(IN); \
-		IN *r1a; \
-		IN *p1a; \
+		double imean; \
 \
-		/* Mean of area of in corresponding to ref. \
-		 */ \
-		p1a = p1; \
-		sum1 = 0.0; \
 		for (j = 0; j < ref->Ysize; j++) { \
 			for (i = 0; i < sz; i += bands) \
-				sum1 += p1a[i]; \
-			p1a += in_lsk; \
+				sum1 += p1[i]; \
+\
+			p1 += in_lsk; \
 		} \
-		imean = sum1 / VIPS_IMAGE_N_PELS(ref); \
+		imean = sum1 / n; \
 \
-		/* Calculate sum-of-squares-of-differences for this window on \
-		 * in, and also sum-of-products-of-differences from mean. \
-		 */ \
-		p1a = p1; \
-		r1a = r1; \
-		sum2 = 0.0; \
-		sum3 = 0.0; \
+		p1 = ((IN *) p) + b; \
 		for (j = 0; j < ref->Ysize; j++) { \
 			for (i = 0; i < sz; i += bands) { \
-				/* Reference pel and input pel. \
-				 */ \
-				IN ip = p1a[i]; \
-				IN rp = r1a[i]; \
+				double ip = p1[i] - imean; \
 \
-				/* Accumulate sum-of-squares-of-differences for \
-				 * input image. \
-				 */ \
-				double t = ip - imean; \
-				sum2 += t * t; \
-\
-				/* Accumulate product-of-difference from mean. \
-				 */ \
-				sum3 += (rp - spcor->rmean[b]) * t; \
+				sum2 += ip * ip; \
+				sum3 += r1[i] * ip; \
 			} \
 \
-			p1a += in_lsk; \
-			r1a += sz; \
+			p1 += in_lsk; \
+			r1 += sz; \
 		} \
 	}
 
@@ -213,12 +234,12 @@ vips_spcor_correlation(VipsCorrelation *correlation,
 	int sz = ref->Xsize * bands;
 	int lsk = VIPS_REGION_LSKIP(in);
 
+	double n = VIPS_IMAGE_N_PELS(ref);
+
 	int x, y, b, j, i;
 
-	double imean;
 	double sum1;
 	double sum2, sum3;
-	double c2, cc;
 
 	for (y = 0; y < r->height; y++) {
 		float *q = (float *)
@@ -229,6 +250,10 @@ vips_spcor_correlation(VipsCorrelation *correlation,
 				VIPS_REGION_ADDR(in, r->left + x, r->top + y);
 
 			for (b = 0; b < bands; b++) {
+				sum1 = 0.0;
+				sum2 = 0.0;
+				sum3 = 0.0;
+
 				switch (vips_image_get_format(ref)) {
 				case VIPS_FORMAT_UCHAR:
 					LOOP(unsigned char);
@@ -266,26 +291,46 @@ vips_spcor_correlation(VipsCorrelation *correlation,
 
 				default:
 					g_assert_not_reached();
-
-					/* Stop compiler warnings.
-					 */
-					sum2 = 0;
-					sum3 = 0;
 				}
 
-				c2 = spcor->c1[b] * sqrt(sum2);
+				*q++ = vips_spcor_coefficient(spcor, b,
+					sum3, sum2);
+			}
+		}
+	}
+}
+
+/* The same, but from the tables made by the frequency domain path.
+ */
+static void
+vips_spcor_fft_correlation(VipsCorrelation *correlation, VipsRegion *out)
+{
+	VipsSpcor *spcor = (VipsSpcor *) correlation;
+	VipsRect *r = &out->valid;
+	VipsImage *ref = correlation->ref_ready;
+	int bands = ref->Bands;
+	double n = VIPS_IMAGE_N_PELS(ref);
+
+	int x, y, b;
 
-				if (c2 == 0.0)
-					/* Something like constant ref.
-					 * We regard this as uncorrelated.
-					 */
-					cc = 0.0;
-				else
-					cc = sum3 / c2;
+	for (y = 0; y < r->height; y++) {
+		float *q = (float *)
+			VIPS_REGION_ADDR(out, r->left, r->top + y);
+		double *p = (double *)
+			VIPS_IMAGE_ADDR(correlation->cross, r->left, r->top + y);
 
-				*q++ = cc;
+		for (x = 0; x < r->width; x++)
+			for (b = 0; b < bands; b++) {
+				double sum1 = vips__correlation_window(correlation,
+					correlation->sum, r->left + x, r->top + y, b);
+				double sum2 = vips__correlation_window(correlation,
+					correlation->sum2, r->left + x, r->top + y, b);
+				double sum3 =
+					p[x * bands + b] - spcor->rmean[b] * sum1;
+
+				*q++ = vips_spcor_coefficient(spcor, b,
+					sum3, sum2 - sum1 * sum1 / n);
 			}
-		}
 	}
 }
 
@@ -307,6 +352,13 @@ static const VipsBandFormat vips_spcor_format_table[10] = {
 	/* Promotion: */ F, F, F, F, F, F, F, F, F, F
 };
 
+static const gboolean vips_spcor_fft_format_table[10] = {
+	/* UC  C     US    S     UI    I */
+	TRUE, TRUE, TRUE, TRUE, TRUE, TRUE,
+	/* F   X      D     DX */
+	TRUE, FALSE, TRUE, FALSE
+};
+
 static void
 vips_spcor_class_init(VipsSpcorClass *class)
 {
@@ -319,6 +371,8 @@ vips_spcor_class_init(VipsSpcorClass *class)
 	cclass->format_table = vips_spcor_format_table;
 	cclass->pre_generate = vips_spcor_pre_generate;
 	cclass->correlation = vips_spcor_correlation;
+	cclass->fft_format_table = vips_spcor_fft_format_table;
+	cclass->fft_correlation = vips_spcor_fft_correlation;
 }
 
 static void
@@ -365,6 +419,11 @@ vips_spcor_init(VipsSpcor *spcor)
  * The output image is always float, unless either of the two inputs is
  * double, in which case the output is also double.
  *
+ * For large @ref, the sum of products is found in the frequency domain and
+ * the window sums from summed-area tables. This needs the whole of @in in
+ * memory, but is much quicker. The choice is made automatically, and only
+ * if the tables fit inside [func@cache_set_max_mem].
+ *
  * ::: seealso
  *     [method@Image.fastcor].
  *
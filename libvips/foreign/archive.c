@@ -2,6 +2,10 @@
  *
  * 8/9/23
  *	- extracted from dzsave
+ * 18/10/26
+ *	- write entries with image suffixes as STORE, so we don't deflate
+ *	  them inside the libarchive lock ... other entries are still
+ *	  deflated there
  */
 
 /*
@@ -65,8 +69,32 @@ struct _VipsArchive {
 	// write a zip to a target
 	struct archive *archive;
 	VipsTarget *target;
+
+	// the deflate level we were made with, 0 means store everything
+	int compression;
+
+	// TRUE if libarchive is set to store the next entry
+	gboolean store;
+};
+
+/* Files with these suffixes are already compressed, so there's no point
+ * running deflate over them. We write them as STORE entries.
+ */
+static const char *vips_archive_compressed_suffs[] = {
+	".jpg", ".jpeg", ".png", ".webp", ".avif", ".heic", ".jxl", ".gif",
+	NULL
 };
 
+static gboolean
+vips_archive_is_compressed(const char *filename)
+{
+	for (int i = 0; vips_archive_compressed_suffs[i]; i++)
+		if (vips_iscasepostfix(filename, vips_archive_compressed_suffs[i]))
+			return TRUE;
+
+	return FALSE;
+}
+
 void
 vips__archive_free(VipsArchive *archive)
 {
@@ -133,6 +161,7 @@ vips__archive_new_to_target(VipsTarget *target,
 
 	archive->target = target;
 	archive->base_dirname = g_strdup(base_dirname);
+	archive->compression = compression;
 
 	if (!(archive->archive = archive_write_new())) {
 		vips_error("archive", "%s", _("unable to create archive"));
@@ -161,6 +190,16 @@ vips__archive_new_to_target(VipsTarget *target,
 		return NULL;
 	}
 
+	/* Entries all start as deflate, we switch to store per entry.
+	 */
+	archive->store = FALSE;
+	if (archive_write_set_format_option(archive->archive, "zip",
+			"compression", "deflate")) {
+		vips_error("archive", "%s", _("unable to set compression"));
+		vips__archive_free(archive);
+		return NULL;
+	}
+
 	/* Do not pad last block.
 	 */
 	if (archive_write_set_bytes_in_last_block(archive->archive, 1)) {
@@ -225,25 +264,43 @@ vips__archive_mkfile_zip(VipsArchive *archive,
 	const char *filename, void *buf, size_t len)
 {
 	struct archive_entry *entry;
+	gboolean store;
+	char *path;
 
-	vips__worker_lock(&vips_libarchive_mutex);
-
+	/* Build the entry outside the lock, we only need to serialise
+	 * writing the header and data.
+	 */
 	if (!(entry = archive_entry_new())) {
 		vips_error("archive", "%s", _("unable to create entry"));
-		g_mutex_unlock(&vips_libarchive_mutex);
 		return -1;
 	}
 
-	char *path;
-
 	path = g_build_filename(archive->base_dirname, filename, NULL);
-
 	archive_entry_set_pathname(entry, path);
 	archive_entry_set_mode(entry, S_IFREG | 0664);
 	archive_entry_set_size(entry, len);
-
 	g_free(path);
 
+	/* Deflate runs inside archive_write_data(), ie. inside the lock, so
+	 * skip it for entries where it can't help.
+	 */
+	store = archive->compression == 0 ||
+		vips_archive_is_compressed(filename);
+
+	vips__worker_lock(&vips_libarchive_mutex);
+
+	if (store != archive->store) {
+		if (archive_write_set_format_option(archive->archive, "zip",
+				"compression", store ? "store" : "deflate")) {
+			vips_error("archive", "%s", _("unable to set compression"));
+			archive_entry_free(entry);
+			g_mutex_unlock(&vips_libarchive_mutex);
+			return -1;
+		}
+
+		archive->store = store;
+	}
+
 	if (archive_write_header(archive->archive, entry)) {
 		vips_error("archive", "%s", _("unable to write header"));
 		archive_entry_free(entry);
@@ -251,16 +308,17 @@ vips__archive_mkfile_zip(VipsArchive *archive,
 		return -1;
 	}
 
-	archive_entry_free(entry);
-
 	if (archive_write_data(archive->archive, buf, len) != len) {
 		vips_error("archive", "%s", _("unable to write data"));
+		archive_entry_free(entry);
 		g_mutex_unlock(&vips_libarchive_mutex);
 		return -1;
 	}
 
 	g_mutex_unlock(&vips_libarchive_mutex);
 
+	archive_entry_free(entry);
+
 	return 0;
 }
 
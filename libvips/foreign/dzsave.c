@@ -100,6 +100,11 @@
  *	- add direct mode
  * 24/11/25
  *	- add gainmap support
+ * 18/10/26
+ *	- reuse JPEG encoders between tiles in direct mode
+ *	- add @preview_size, @preview
+ *	- add the ::level signal, extend the pyramid below @depth to make
+ *	  a bounded preview
  */
 
 /*
@@ -233,6 +238,12 @@ struct _Level {
 	int sub; /* Subsample factor for this level */
 	int n;	 /* Level number ... 0 for smallest */
 
+	/* FALSE for levels below @depth which we only make to shrink down to
+	 * the preview size. These are always at the bottom of the pyramid and
+	 * are never written.
+	 */
+	gboolean save;
+
 	Level *below; /* Tiles go to here */
 	Level *above; /* Tiles come from here */
 };
@@ -263,6 +274,8 @@ struct _VipsForeignSaveDz {
 	gboolean no_strip;
 	char *id;
 	int Q;
+	int preview_size;
+	VipsImage *preview;
 
 	/* In direct save mode, we write regions of pixels to the output and
 	 * avoid creating a pipeline for each tile. This must be disabled if
@@ -344,6 +357,20 @@ struct _VipsForeignSaveDz {
 	 */
 	double gainmap_hscale;
 	double gainmap_vscale;
+
+	/* Idle JPEG encoders for direct mode. Workers take one, write a tile
+	 * and put it back, so we make about one per thread for the whole
+	 * pyramid.
+	 */
+	GMutex encoder_lock;
+	GSList *encoders;
+
+	/* If we're making a preview, the level we copy it from, and a region
+	 * on the memory image we copy to.
+	 */
+	Level *preview_level;
+	VipsImage *preview_image;
+	VipsRegion *preview_region;
 };
 
 typedef VipsForeignSaveClass VipsForeignSaveDzClass;
@@ -351,6 +378,15 @@ typedef VipsForeignSaveClass VipsForeignSaveDzClass;
 G_DEFINE_ABSTRACT_TYPE(VipsForeignSaveDz, vips_foreign_save_dz,
 	VIPS_TYPE_FOREIGN_SAVE);
 
+/* Our signals.
+ */
+enum {
+	SIG_LEVEL,
+	SIG_LAST
+};
+
+static guint vips_foreign_save_dz_signals[SIG_LAST] = { 0 };
+
 /* ZIP and SZI are both written as zip files.
  */
 static gboolean
@@ -429,18 +465,37 @@ vips_foreign_save_dz_dispose(GObject *gobject)
 	VIPS_FREE(dz->root_name);
 	VIPS_FREE(dz->file_suffix);
 
+	VIPS_UNREF(dz->preview_region);
+	VIPS_UNREF(dz->preview_image);
+
+	g_slist_free_full(dz->encoders,
+		(GDestroyNotify) vips__jpeg_tile_encoder_free);
+	dz->encoders = NULL;
+
 	G_OBJECT_CLASS(vips_foreign_save_dz_parent_class)->dispose(gobject);
 }
 
+static void
+vips_foreign_save_dz_finalize(GObject *gobject)
+{
+	VipsForeignSaveDz *dz = (VipsForeignSaveDz *) gobject;
+
+	g_mutex_clear(&dz->encoder_lock);
+
+	G_OBJECT_CLASS(vips_foreign_save_dz_parent_class)->finalize(gobject);
+}
+
 /* Build a pyramid.
  *
  * width/height is the size of this level, real_* the subsection of the level
  * which is real pixels (as opposed to background). left/top of save_area
- * can be >0 if we are centring.
+ * can be >0 if we are centring. save_level is FALSE for levels below @depth
+ * which we only make for the preview.
  */
 static Level *
 pyramid_build(VipsForeignSaveDz *dz,
-	Level *above, int width, int height, VipsRect *save_area)
+	Level *above, int width, int height, VipsRect *save_area,
+	gboolean save_level)
 {
 	VipsForeignSave *save = VIPS_FOREIGN_SAVE(dz);
 
@@ -454,6 +509,7 @@ pyramid_build(VipsForeignSaveDz *dz,
 	level->dz = dz;
 	level->width = width;
 	level->height = height;
+	level->save = save_level;
 
 	/* We need to output all possible tiles, even if they give no new
 	 * pixels.
@@ -538,6 +594,16 @@ pyramid_build(VipsForeignSaveDz *dz,
 		limit = 1;
 	}
 
+	/* Below @depth, we only carry on down if we need a smaller level for
+	 * the preview.
+	 */
+	if (!save_level ||
+		(width <= limit &&
+			height <= limit)) {
+		save_level = FALSE;
+		limit = dz->preview_size > 0 ? dz->preview_size : VIPS_MAX_COORD;
+	}
+
 	if (width > limit ||
 		height > limit) {
 		/* Round up, so eg. a 5 pixel wide image becomes 3 a level
@@ -550,12 +616,15 @@ pyramid_build(VipsForeignSaveDz *dz,
 		half.width = (save_area->width + 1) / 2;
 		half.height = (save_area->height + 1) / 2;
 		if (!(level->below = pyramid_build(dz, level,
-				  (width + 1) / 2, (height + 1) / 2, &half))) {
+				  (width + 1) / 2, (height + 1) / 2, &half, save_level))) {
 			level_free(level);
 			return NULL;
 		}
-		level->n = level->below->n + 1;
 	}
+
+	if (level->below &&
+		level->below->save)
+		level->n = level->below->n + 1;
 	else
 		level->n = 0;
 
@@ -1183,7 +1252,7 @@ tile_name(Level *level, int x, int y)
 
 		/* Count all tiles in levels below this one.
 		 */
-		for (p = level->below; p; p = p->below)
+		for (p = level->below; p && p->save; p = p->below)
 			n += p->tiles_across * p->tiles_down;
 
 		/* And count tiles so far in this level.
@@ -1553,39 +1622,56 @@ direct_strip_allocate(VipsThreadState *state, void *a, gboolean *stop)
 	return 0;
 }
 
+/* Take an idle encoder, or make a new one.
+ */
+static VipsJpegTileEncoder *
+direct_encoder_get(VipsForeignSaveDz *dz)
+{
+	VipsForeignSave *save = VIPS_FOREIGN_SAVE(dz);
+
+	VipsJpegTileEncoder *encoder;
+
+	g_mutex_lock(&dz->encoder_lock);
+	if ((encoder = dz->encoders ? dz->encoders->data : NULL))
+		dz->encoders = g_slist_remove(dz->encoders, encoder);
+	g_mutex_unlock(&dz->encoder_lock);
+
+	if (!encoder)
+		encoder = vips__jpeg_tile_encoder_new(save->ready,
+			dz->Q, save->keep);
+
+	return encoder;
+}
+
+static void
+direct_encoder_put(VipsForeignSaveDz *dz, VipsJpegTileEncoder *encoder)
+{
+	g_mutex_lock(&dz->encoder_lock);
+	dz->encoders = g_slist_prepend(dz->encoders, encoder);
+	g_mutex_unlock(&dz->encoder_lock);
+}
+
 static int
 direct_image_write(VipsForeignSaveDz *dz,
 	VipsRegion *region, VipsRect *rect, const char *filename)
 {
-	VipsForeignSave *save = VIPS_FOREIGN_SAVE(dz);
-	VipsTarget *target;
-
-	if (!(target = vips_target_new_to_memory()))
-		return -1;
+	VipsJpegTileEncoder *encoder;
+	void *buf;
+	size_t len;
 
-	if (vips__jpeg_region_write_target(region, rect, target,
-			dz->Q, NULL,
-			FALSE, FALSE,
-			save->keep, FALSE,
-			FALSE, FALSE,
-			0, 0, 0)) {
-		g_object_unref(target);
+	if (!(encoder = direct_encoder_get(dz)))
 		return -1;
-	}
 
-	VipsBlob *blob;
-	const void *buf;
-	size_t len;
-	g_object_get(target, "blob", &blob, NULL);
-	buf = vips_blob_get(blob, &len);
-	if (vips__archive_mkfile(dz->archive, filename, (void *) buf, len)) {
-		vips_area_unref(VIPS_AREA(blob));
-		g_object_unref(target);
+	/* The encoded tile is in the encoder's arena, so we must write it
+	 * before we hand the encoder back.
+	 */
+	if (vips__jpeg_tile_encoder_encode(encoder, region, rect, &buf, &len) ||
+		vips__archive_mkfile(dz->archive, filename, buf, len)) {
+		direct_encoder_put(dz, encoder);
 		return -1;
 	}
 
-	vips_area_unref(VIPS_AREA(blob));
-	g_object_unref(target);
+	direct_encoder_put(dz, encoder);
 
 	return 0;
 }
@@ -1657,6 +1743,11 @@ strip_save(Level *level)
 	printf("strip_save: n = %d, y = %d\n", level->n, level->y);
 #endif /*DEBUG_VERBOSE*/
 
+	/* Levels below @depth are only there to make the preview.
+	 */
+	if (!level->save)
+		return 0;
+
 	if (level->dz->direct) {
 		DirectStrip strip;
 
@@ -1753,6 +1844,75 @@ level_generate_extras(Level *level)
 	}
 }
 
+/* Pixels in @rect of @level's strip are complete. Pass them to any ::level
+ * handlers, and copy them to the preview if this is the preview level.
+ */
+static void
+level_pixels(Level *level, const VipsRect *rect)
+{
+	VipsForeignSaveDz *dz = level->dz;
+
+	VipsRect area;
+
+	/* Don't pass on the extra line or column we add to make the size
+	 * even.
+	 */
+	area.left = 0;
+	area.top = 0;
+	area.width = level->width;
+	area.height = level->height;
+	vips_rect_intersectrect(&area, rect, &area);
+	if (vips_rect_isempty(&area))
+		return;
+
+	g_signal_emit(dz, vips_foreign_save_dz_signals[SIG_LEVEL], 0,
+		level->sub, level->strip, &area);
+
+	if (level == dz->preview_level)
+		vips_region_copy(level->strip, dz->preview_region,
+			&area, area.left, area.top);
+}
+
+/* The preview is the largest level that fits within preview_size.
+ * pyramid_build() carries on below @depth until there is one.
+ */
+static int
+preview_build(VipsForeignSaveDz *dz)
+{
+	VipsForeignSave *save = VIPS_FOREIGN_SAVE(dz);
+
+	Level *level;
+	VipsRect all;
+
+	for (level = dz->level; level->below; level = level->below)
+		if (level->width <= dz->preview_size &&
+			level->height <= dz->preview_size)
+			break;
+	dz->preview_level = level;
+
+	dz->preview_image = vips_image_new_memory();
+	if (vips_image_pipelinev(dz->preview_image,
+			VIPS_DEMAND_STYLE_ANY, save->ready, NULL))
+		return -1;
+	dz->preview_image->Xsize = level->width;
+	dz->preview_image->Ysize = level->height;
+	dz->preview_image->Xres = save->ready->Xres / level->sub;
+	dz->preview_image->Yres = save->ready->Yres / level->sub;
+	if (vips_image_write_prepare(dz->preview_image))
+		return -1;
+
+	all.left = 0;
+	all.top = 0;
+	all.width = level->width;
+	all.height = level->height;
+	dz->preview_region = vips_region_new(dz->preview_image);
+	vips__region_no_ownership(dz->preview_region);
+	if (vips_region_image(dz->preview_region, &all))
+		return -1;
+
+	return 0;
+}
+
 static int strip_arrived(Level *level);
 
 /* Shrink what pixels we can from this strip into the level below. If the
@@ -1816,6 +1976,7 @@ strip_shrink(Level *level)
 			break;
 
 		(void) vips_region_shrink_method(from, to, &target, region_shrink);
+		level_pixels(below, &target);
 
 		below->write_y += target.height;
 
@@ -1979,6 +2140,7 @@ pyramid_strip(VipsRegion *region, VipsRect *area, void *a)
 		 */
 		vips_region_copy(region, level->strip,
 			&target, target.left, target.top);
+		level_pixels(level, &target);
 
 		level->write_y += target.height;
 
@@ -2188,11 +2350,11 @@ vips_foreign_save_dz_build(VipsObject *object)
 		int height;
 
 		if (!(level = pyramid_build(dz, NULL,
-				  save->ready->Xsize, save->ready->Ysize, &save_area)))
+				  save->ready->Xsize, save->ready->Ysize, &save_area, TRUE)))
 			return -1;
 
-		// find the deepest (smallest) level
-		for (p = level; p->below; p = p->below)
+		// find the deepest (smallest) level we save
+		for (p = level; p->below && p->below->save; p = p->below)
 			;
 
 		// round image size up so we have complete tiles in the base level
@@ -2313,7 +2475,14 @@ vips_foreign_save_dz_build(VipsObject *object)
 	/* Build the skeleton of the image pyramid.
 	 */
 	if (!(dz->level = pyramid_build(dz, NULL,
-			  save->ready->Xsize, save->ready->Ysize, &save_area)))
+			  save->ready->Xsize, save->ready->Ysize, &save_area, TRUE)))
+		return -1;
+
+	/* The preview is filled in as the pyramid is built, so it costs
+	 * no extra decode or shrink.
+	 */
+	if (dz->preview_size > 0 &&
+		preview_build(dz))
 		return -1;
 
 	if (dz->layout == VIPS_FOREIGN_DZ_LAYOUT_DZ)
@@ -2397,6 +2566,9 @@ vips_foreign_save_dz_build(VipsObject *object)
 	 */
 	VIPS_FREEF(vips__archive_free, dz->archive);
 
+	if (dz->preview_image)
+		g_object_set(object, "preview", dz->preview_image, NULL);
+
 	return 0;
 }
 
@@ -2429,6 +2601,7 @@ vips_foreign_save_dz_class_init(VipsForeignSaveDzClass *class)
 	VipsForeignSaveClass *save_class = (VipsForeignSaveClass *) class;
 
 	gobject_class->dispose = vips_foreign_save_dz_dispose;
+	gobject_class->finalize = vips_foreign_save_dz_finalize;
 	gobject_class->set_property = vips_object_set_property;
 	gobject_class->get_property = vips_object_get_property;
 
@@ -2540,6 +2713,46 @@ vips_foreign_save_dz_class_init(VipsForeignSaveDzClass *class)
 		G_STRUCT_OFFSET(VipsForeignSaveDz, Q),
 		1, 100, 75);
 
+	VIPS_ARG_INT(class, "preview_size", 24,
+		_("Preview size"),
+		_("Make a preview no larger than this"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsForeignSaveDz, preview_size),
+		0, VIPS_MAX_COORD, 0);
+
+	VIPS_ARG_IMAGE(class, "preview", 25,
+		_("Preview"),
+		_("Preview image from the pyramid"),
+		VIPS_ARGUMENT_OPTIONAL_OUTPUT,
+		G_STRUCT_OFFSET(VipsForeignSaveDz, preview));
+
+	/**
+	 * VipsForeignSaveDz::level:
+	 * @dz: the operation building the pyramid
+	 * @sub: the subsample factor of this level, 1 for full resolution
+	 * @region: a [class@Region] holding the pixels
+	 * @rect: (type gpointer): the [struct@Rect] of @region that is complete
+	 *
+	 * This signal is emitted as each part of each pyramid level is
+	 * finished, including levels below @depth which are only made for the
+	 * preview. Each level arrives in order from top to bottom, and levels
+	 * are interleaved.
+	 *
+	 * Use it to send the pyramid to another writer, for example to make a
+	 * pyramidal TIFF, from the same decode and shrink.
+	 *
+	 * The signal is emitted from a background thread, one call at a time.
+	 * Copy the pixels out of @region, since it will be reused.
+	 */
+	vips_foreign_save_dz_signals[SIG_LEVEL] = g_signal_new("level",
+		G_TYPE_FROM_CLASS(class),
+		G_SIGNAL_RUN_LAST,
+		0,
+		NULL, NULL,
+		NULL,
+		G_TYPE_NONE, 3,
+		G_TYPE_INT, VIPS_TYPE_REGION, G_TYPE_POINTER);
+
 	/* How annoying. We stupidly had these in earlier versions.
 	 */
 
@@ -2601,6 +2814,7 @@ vips_foreign_save_dz_init(VipsForeignSaveDz *dz)
 	dz->region_shrink = VIPS_REGION_SHRINK_MEAN;
 	dz->skip_blanks = -1;
 	dz->Q = 75;
+	g_mutex_init(&dz->encoder_lock);
 
 	// we default background to 255 (not 0), see vips_foreign_save_init()
 	VipsForeignSave *save = (VipsForeignSave *) dz;
@@ -2832,6 +3046,9 @@ vips_foreign_save_dz_buffer_init(VipsForeignSaveDzBuffer *buffer)
  * If @container is set to `zip`, you can set a compression level from -1
  * (use zlib default), 0 (store, compression disabled) to 9 (max compression).
  * If no value is given, the default is to store files without compression.
+ * Tiles in already-compressed formats, such as `.jpg`, `.png` and `.webp`,
+ * are always stored, whatever the level. Only metadata and other
+ * non-image entries are deflated.
  *
  * You can use @region_shrink to control the method for shrinking each 2x2
  * region. This defaults to using the average of the 4 input pixels but you can
@@ -2847,6 +3064,16 @@ vips_foreign_save_dz_buffer_init(VipsForeignSaveDzBuffer *buffer)
  *
  * Use @layout [enum@Vips.ForeignDzLayout.IIIF3] for IIIF v3 layout.
  *
+ * Set @preview_size to also get @preview, a copy of the largest pyramid
+ * level that fits within that many pixels. It is made as the pyramid is
+ * built, so you can save a preview image without decoding or shrinking the
+ * source again. If @depth stops the pyramid before a level is small
+ * enough, dzsave carries on shrinking, but does not write tiles for these
+ * extra levels.
+ *
+ * Connect to the ::level signal to get the pixels of every pyramid level
+ * as they are finished.
+ *
  * ::: tip "Optional arguments"
  *     * @basename: `gchararray`, base part of name
  *     * @layout: [enum@ForeignDzLayout], directory layout convention
@@ -2864,6 +3091,8 @@ vips_foreign_save_dz_buffer_init(VipsForeignSaveDzBuffer *buffer)
  *       background
  *     * @id: `gchararray`, id for IIIF properties
  *     * @Q: `gint`, quality factor
+ *     * @preview_size: `gint`, make a preview no larger than this
+ *     * @preview: [class@Image], output preview image
  *
  * ::: seealso
  *     [method@Image.tiffsave].
@@ -2916,6 +3145,8 @@ vips_dzsave(VipsImage *in, const char *name, ...)
  *       background
  *     * @id: `gchararray`, id for IIIF properties
  *     * @Q: `gint`, quality factor
+ *     * @preview_size: `gint`, make a preview no larger than this
+ *     * @preview: [class@Image], output preview image
  *
  * ::: seealso
  *     [method@Image.dzsave], [method@Image.write_to_file].
@@ -2975,6 +3206,8 @@ vips_dzsave_buffer(VipsImage *in, void **buf, size_t *len, ...)
  *       background
  *     * @id: `gchararray`, id for IIIF properties
  *     * @Q: `gint`, quality factor
+ *     * @preview_size: `gint`, make a preview no larger than this
+ *     * @preview: [class@Image], output preview image
  *
  * ::: seealso
  *     [method@Image.dzsave], [method@Image.write_to_target].
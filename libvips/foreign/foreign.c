@@ -26,6 +26,10 @@
  * 	- drop incompatible ICC profiles before save
  * 24/7/21
  * 	- add fail_on
+ * 18/10/26
+ * 	- add compressed spill for large random-access loads
+ * 	- spill with deflate if libtiff has no zstd, unlink the spill file as
+ * 	  soon as it's open
  */
 
 /*
@@ -66,6 +70,20 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <glib/gstdio.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif /*HAVE_UNISTD_H*/
+#ifdef G_OS_WIN32
+#include <io.h>
+#endif /*G_OS_WIN32*/
+
+#ifdef HAVE_TIFF
+#include <tiffio.h>
+#endif /*HAVE_TIFF*/
 
 #include <vips/vips.h>
 #include <vips/internal.h>
@@ -910,6 +928,150 @@ vips_foreign_load_new_from_string(const char *string)
 	return VIPS_OBJECT(load);
 }
 
+/* Spill tiles are this size.
+ */
+#define SPILL_TILE_SIZE (256)
+
+/* Should we load via a compressed tiled temp rather than a .v file? Only for
+ * large random access to sequential formats, where we would otherwise write
+ * the whole uncompressed image to disc.
+ */
+static gboolean
+vips_foreign_load_spill_wanted(VipsForeignLoad *load)
+{
+#ifdef HAVE_TIFF
+	return vips__disc_compress &&
+		!load->memory &&
+		!(load->flags & VIPS_FOREIGN_PARTIAL) &&
+		(load->flags & VIPS_FOREIGN_SEQUENTIAL) &&
+		load->access == VIPS_ACCESS_RANDOM &&
+		load->out->Coding != VIPS_CODING_RAD &&
+		VIPS_IMAGE_SIZEOF_IMAGE(load->out) > vips_get_disc_threshold();
+#else  /*!HAVE_TIFF*/
+	return FALSE;
+#endif /*HAVE_TIFF*/
+}
+
+#ifdef HAVE_TIFF
+static void
+vips_foreign_load_spill_close(VipsObject *object, char *filename)
+{
+	if (filename) {
+		g_unlink(filename);
+		g_free(filename);
+	}
+}
+
+/* zstd is much faster than deflate, but libtiff can be built without it.
+ */
+static VipsForeignTiffCompression
+vips_foreign_load_spill_compression(void)
+{
+#ifdef HAVE_TIFF_COMPRESSION_WEBP
+	if (TIFFIsCODECConfigured(COMPRESSION_ZSTD))
+		return VIPS_FOREIGN_TIFF_COMPRESSION_ZSTD;
+#endif /*HAVE_TIFF_COMPRESSION_WEBP*/
+
+	return VIPS_FOREIGN_TIFF_COMPRESSION_DEFLATE;
+}
+
+/* Write @in to a tiled, compressed temp file, then reopen it behind a
+ * threaded tile cache sized to the disc threshold.
+ *
+ * We reload from a descriptor, so the source is never minimised and
+ * reopened by name, and unlink the file as soon as it's open. The space is
+ * reclaimed when the reload closes, even if we crash. On Windows we can't
+ * delete open files, so we remove it on close instead.
+ */
+static int
+vips_foreign_load_spill(VipsImage *in, VipsImage **out)
+{
+	const guint64 tile_size = (guint64) SPILL_TILE_SIZE * SPILL_TILE_SIZE *
+		VIPS_IMAGE_SIZEOF_PEL(in);
+	const int max_tiles = VIPS_CLIP(10,
+		vips_get_disc_threshold() / tile_size, G_MAXINT);
+
+	char *filename;
+	int fd;
+	VipsSource *source;
+	VipsOperation *operation;
+	VipsImage *x;
+
+	if (!(filename = vips__temp_name("%s.tif")))
+		return -1;
+
+#ifdef DEBUG
+	printf("vips_foreign_load_spill: spilling to %s\n", filename);
+#endif /*DEBUG*/
+
+	if (vips_tiffsave(in, filename,
+			"tile", TRUE,
+			"tile_width", SPILL_TILE_SIZE,
+			"tile_height", SPILL_TILE_SIZE,
+			"bigtiff", TRUE,
+			"compression", vips_foreign_load_spill_compression(),
+			"level", 1,
+			"keep", VIPS_FOREIGN_KEEP_NONE,
+			NULL)) {
+		vips_foreign_load_spill_close(NULL, filename);
+		return -1;
+	}
+
+	source = NULL;
+	if ((fd = g_open(filename, O_RDONLY, 0)) == -1)
+		vips_error_system(errno, "VipsForeignLoad",
+			_("unable to open \"%s\""), filename);
+	else {
+		source = vips_source_new_from_descriptor(fd);
+		close(fd);
+	}
+
+#ifndef G_OS_WIN32
+	g_unlink(filename);
+	VIPS_FREE(filename);
+#endif /*!G_OS_WIN32*/
+
+	/* Build the reload by hand, so it stays out of the operation cache
+	 * and the file can go as soon as the pipeline is done with it.
+	 */
+	if (!source ||
+		!(operation = vips_operation_new("tiffload_source"))) {
+		VIPS_UNREF(source);
+		vips_foreign_load_spill_close(NULL, filename);
+		return -1;
+	}
+	if (filename)
+		g_signal_connect(operation, "postclose",
+			G_CALLBACK(vips_foreign_load_spill_close), filename);
+	g_object_set(operation,
+		"source", source,
+		NULL);
+	g_object_unref(source);
+	if (vips_object_build(VIPS_OBJECT(operation))) {
+		vips_object_unref_outputs(VIPS_OBJECT(operation));
+		g_object_unref(operation);
+		return -1;
+	}
+	g_object_get(operation, "out", &x, NULL);
+	vips_object_unref_outputs(VIPS_OBJECT(operation));
+	g_object_unref(operation);
+
+	if (vips_tilecache(x, out,
+			"tile_width", SPILL_TILE_SIZE,
+			"tile_height", SPILL_TILE_SIZE,
+			"max_tiles", max_tiles,
+			"access", VIPS_ACCESS_RANDOM,
+			"threaded", TRUE,
+			NULL)) {
+		g_object_unref(x);
+		return -1;
+	}
+	g_object_unref(x);
+
+	return 0;
+}
+#endif /*HAVE_TIFF*/
+
 static VipsImage *
 vips_foreign_load_temp(VipsForeignLoad *load)
 {
@@ -952,6 +1114,18 @@ vips_foreign_load_temp(VipsForeignLoad *load)
 		return vips_image_new();
 	}
 
+	/* Large random access to a sequential format, and compressed spill
+	 * has been requested. Load to a partial image, we spill it in
+	 * vips_foreign_load_start().
+	 */
+	if (vips_foreign_load_spill_wanted(load)) {
+#ifdef DEBUG
+		printf("vips_foreign_load_temp: compressed spill temp\n");
+#endif /*DEBUG*/
+
+		return vips_image_new();
+	}
+
 	/* We open via disc if the uncompressed image will be larger than
 	 * vips_get_disc_threshold().
 	 */
@@ -1065,6 +1239,31 @@ vips_foreign_load_start(VipsImage *out, void *a, void *b)
 			return NULL;
 		}
 
+#ifdef HAVE_TIFF
+		/* Loaders which write lines themselves will have turned real
+		 * into a memory image, so only spill partial images.
+		 */
+		if (vips_foreign_load_spill_wanted(load) &&
+			load->real->dtype == VIPS_IMAGE_PARTIAL) {
+			VipsImage *x;
+
+			if (vips_foreign_load_spill(load->real, &x)) {
+				vips_operation_invalidate(VIPS_OPERATION(load));
+				load->error = TRUE;
+
+				return NULL;
+			}
+			VIPS_UNREF(load->real);
+			load->real = x;
+
+			if (!vips_foreign_load_iscompat(load, out)) {
+				load->error = TRUE;
+
+				return NULL;
+			}
+		}
+#endif /*HAVE_TIFF*/
+
 		/* We have to tell vips that out depends on real. We've set
 		 * the demand hint below, but not given an input there.
 		 */
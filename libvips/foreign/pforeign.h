@@ -136,6 +136,14 @@ int vips__jpeg_region_write_target(VipsRegion *region, VipsRect *rect,
 	int quant_table, VipsForeignSubsample subsample_mode,
 	int restart_interval);
 
+typedef struct _VipsJpegTileEncoder VipsJpegTileEncoder;
+
+VipsJpegTileEncoder *vips__jpeg_tile_encoder_new(VipsImage *in,
+	int Q, VipsForeignKeep keep);
+int vips__jpeg_tile_encoder_encode(VipsJpegTileEncoder *encoder,
+	VipsRegion *region, VipsRect *rect, void **buf, size_t *len);
+void vips__jpeg_tile_encoder_free(VipsJpegTileEncoder *encoder);
+
 int vips__jpeg_read_source(VipsSource *source, VipsImage *out,
 	gboolean header_only, int shrink, VipsFailOn fail_on,
 	gboolean autorotate, gboolean unlimited);
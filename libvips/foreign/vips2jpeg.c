@@ -100,6 +100,8 @@
  *	- add restart_interval
  * 21/10/21 usualuse
  *	- raise single-chunk limit on APP to 65533
+ * 18/10/26
+ *	- add a reusable tile encoder
  */
 
 /*
@@ -1040,6 +1042,190 @@ vips__jpeg_region_write_target(VipsRegion *region, VipsRect *rect,
 	return 0;
 }
 
+/* Arena output for the tile encoder. We write straight into a byte array
+ * that is kept between tiles, so we only allocate when a tile is larger
+ * than any we have seen before.
+ */
+typedef struct {
+	struct jpeg_destination_mgr pub;
+
+	GByteArray *arena;
+} ArenaDest;
+
+static void
+arena_init_destination(j_compress_ptr cinfo)
+{
+	ArenaDest *dest = (ArenaDest *) cinfo->dest;
+	GByteArray *arena = dest->arena;
+
+	g_byte_array_set_size(arena, VIPS_MAX(arena->len, TARGET_BUFFER_SIZE));
+	dest->pub.next_output_byte = arena->data;
+	dest->pub.free_in_buffer = arena->len;
+}
+
+/* Only called when the arena is exactly full, so double it.
+ */
+static boolean
+arena_empty_output_buffer(j_compress_ptr cinfo)
+{
+	ArenaDest *dest = (ArenaDest *) cinfo->dest;
+	GByteArray *arena = dest->arena;
+	guint used = arena->len;
+
+	g_byte_array_set_size(arena, 2 * used);
+	dest->pub.next_output_byte = arena->data + used;
+	dest->pub.free_in_buffer = arena->len - used;
+
+	return TRUE;
+}
+
+static void
+arena_term_destination(j_compress_ptr cinfo)
+{
+	ArenaDest *dest = (ArenaDest *) cinfo->dest;
+
+	g_byte_array_set_size(dest->arena,
+		dest->arena->len - dest->pub.free_in_buffer);
+}
+
+/* A JPEG encoder we can reuse for many tiles of one image, for example in
+ * dzsave. The compress struct, row pointers, output arena and the image we
+ * take metadata from are all made once.
+ */
+struct _VipsJpegTileEncoder {
+	Write *write;
+
+	/* A private copy of the image with metadata updated for @keep.
+	 */
+	VipsImage *meta;
+
+	int Q;
+
+	/* Output for the last tile.
+	 */
+	GByteArray *arena;
+
+	/* The size of write->row_pointer.
+	 */
+	int max_height;
+};
+
+void
+vips__jpeg_tile_encoder_free(VipsJpegTileEncoder *encoder)
+{
+	VIPS_FREEF(write_destroy, encoder->write);
+	VIPS_UNREF(encoder->meta);
+	if (encoder->arena) {
+		g_byte_array_unref(encoder->arena);
+		encoder->arena = NULL;
+	}
+
+	g_free(encoder);
+}
+
+VipsJpegTileEncoder *
+vips__jpeg_tile_encoder_new(VipsImage *in, int Q, VipsForeignKeep keep)
+{
+	VipsJpegTileEncoder *encoder;
+	ArenaDest *dest;
+
+	/* Should have been converted for save.
+	 */
+	g_assert(in->BandFmt == VIPS_FORMAT_UCHAR);
+	g_assert(in->Coding == VIPS_CODING_NONE);
+	g_assert(in->Bands == 1 ||
+		in->Bands == 3 ||
+		in->Bands == 4);
+
+	encoder = g_new0(VipsJpegTileEncoder, 1);
+	encoder->Q = Q;
+	encoder->arena = g_byte_array_new();
+	if (!(encoder->write = write_new())) {
+		vips__jpeg_tile_encoder_free(encoder);
+		return NULL;
+	}
+
+	if (vips_copy(in, &encoder->meta, NULL) ||
+		vips__foreign_update_metadata(encoder->meta, keep)) {
+		vips__jpeg_tile_encoder_free(encoder);
+		return NULL;
+	}
+
+	if (setjmp(encoder->write->eman.jmp)) {
+		vips__jpeg_tile_encoder_free(encoder);
+		return NULL;
+	}
+	jpeg_create_compress(&encoder->write->cinfo);
+
+	dest = (ArenaDest *) (*encoder->write->cinfo.mem->alloc_small)(
+		(j_common_ptr) &encoder->write->cinfo,
+		JPOOL_PERMANENT,
+		sizeof(ArenaDest));
+	dest->pub.init_destination = arena_init_destination;
+	dest->pub.empty_output_buffer = arena_empty_output_buffer;
+	dest->pub.term_destination = arena_term_destination;
+	dest->arena = encoder->arena;
+	encoder->write->cinfo.dest = (struct jpeg_destination_mgr *) dest;
+
+	encoder->write->invert = in->Bands == 4 &&
+		in->Type == VIPS_INTERPRETATION_CMYK;
+
+	return encoder;
+}
+
+/* Encode @rect of @region. The result is valid until the next call.
+ */
+int
+vips__jpeg_tile_encoder_encode(VipsJpegTileEncoder *encoder,
+	VipsRegion *region, VipsRect *rect, void **buf, size_t *len)
+{
+	Write *write = encoder->write;
+
+	if (rect->height > encoder->max_height) {
+		VIPS_FREE(write->row_pointer);
+		if (!(write->row_pointer =
+					VIPS_ARRAY(NULL, rect->height, JSAMPROW)))
+			return -1;
+		encoder->max_height = rect->height;
+	}
+
+	if (setjmp(write->eman.jmp)) {
+		/* Reset the compress object so we can be used again.
+		 */
+		jpeg_abort_compress(&write->cinfo);
+		return -1;
+	}
+
+	set_cinfo(&write->cinfo, encoder->meta, rect->width, rect->height,
+		encoder->Q, FALSE, FALSE,
+		FALSE, FALSE, FALSE, 0,
+		VIPS_FOREIGN_SUBSAMPLE_AUTO, 0);
+	jpeg_start_compress(&write->cinfo, TRUE);
+
+	if (write_metadata(write, encoder->meta, NULL)) {
+		jpeg_abort_compress(&write->cinfo);
+		return -1;
+	}
+
+	/* write_jpeg_block() sets its own longjmp target.
+	 */
+	if (write_jpeg_block(region, rect, write)) {
+		jpeg_abort_compress(&write->cinfo);
+		return -1;
+	}
+
+	if (setjmp(write->eman.jmp)) {
+		jpeg_abort_compress(&write->cinfo);
+		return -1;
+	}
+	jpeg_finish_compress(&write->cinfo);
+
+	*buf = encoder->arena->data;
+	*len = encoder->arena->len;
+
+	return 0;
+}
+
 #else /*!HAVE_JPEG*/
 
 int
@@ -1057,4 +1243,26 @@ vips__jpeg_region_write_target(VipsRegion *region, VipsRect *rect,
 	return -1;
 }
 
+VipsJpegTileEncoder *
+vips__jpeg_tile_encoder_new(VipsImage *in, int Q, VipsForeignKeep keep)
+{
+	vips_error("vips2jpeg",
+		"%s", _("libvips built without JPEG support"));
+	return NULL;
+}
+
+int
+vips__jpeg_tile_encoder_encode(VipsJpegTileEncoder *encoder,
+	VipsRegion *region, VipsRect *rect, void **buf, size_t *len)
+{
+	vips_error("vips2jpeg",
+		"%s", _("libvips built without JPEG support"));
+	return -1;
+}
+
+void
+vips__jpeg_tile_encoder_free(VipsJpegTileEncoder *encoder)
+{
+}
+
 #endif /*HAVE_JPEG*/
@@ -0,0 +1,212 @@
+/* out-of-core 2D FFT
+ *
+ * 18/10/26
+ * 	- from fwfft.c
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+/*
+#define DEBUG
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vips/vips.h>
+#include <vips/internal.h>
+#include "pfreqfilt.h"
+
+#ifdef HAVE_FFTW
+
+#include <fftw3.h>
+
+/* Aim for strips of about this many bytes when reading the input.
+ */
+#define VIPS_FFT_DISC_STRIP_BYTES (8 * 1024 * 1024)
+
+/* Transform every line of @in (a 1-band dpcomplex image) with a 1D
+ * transform and write the result to @out, a file image. If @size is not
+ * 1.0, divide the result by @size.
+ *
+ * We only ever hold one strip of @in plus one line of fftw buffer in memory.
+ */
+static int
+vips_fft_disc_lines(VipsObject *context,
+	VipsImage *in, VipsImage *out, int sign, double size)
+{
+	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(context);
+	const int n = in->Xsize;
+	const size_t linesize = VIPS_IMAGE_SIZEOF_LINE(in);
+
+	VipsRegion *region;
+	fftw_complex *buf;
+	fftw_plan plan;
+	VipsRect strip;
+	int strip_height;
+	int result;
+	int x, y;
+
+	if (vips_image_pio_input(in) ||
+		vips_image_pipelinev(out, VIPS_DEMAND_STYLE_THINSTRIP, in, NULL))
+		return -1;
+
+	if (!(buf = (fftw_complex *) fftw_malloc(n * sizeof(fftw_complex)))) {
+		vips_error(class->nickname, "%s", _("out of memory"));
+		return -1;
+	}
+
+	/* Use FFTW_ESTIMATE so the planner won't scribble on buf, and we
+	 * can plan once for the whole image.
+	 */
+	g_mutex_lock(&vips__fft_lock);
+	plan = fftw_plan_dft_1d(n, buf, buf, sign, FFTW_ESTIMATE);
+	g_mutex_unlock(&vips__fft_lock);
+	if (!plan) {
+		fftw_free(buf);
+		vips_error(class->nickname,
+			"%s", _("unable to create transform plan"));
+		return -1;
+	}
+
+	strip_height = VIPS_CLIP(1, VIPS_FFT_DISC_STRIP_BYTES / linesize, 128);
+	region = vips_region_new(in);
+	result = 0;
+
+	for (y = 0; y < in->Ysize && !result; y++) {
+		double *q = (double *) buf;
+
+		if (y % strip_height == 0) {
+			strip.left = 0;
+			strip.top = y;
+			strip.width = n;
+			strip.height = VIPS_MIN(strip_height, in->Ysize - y);
+			if (vips_region_prepare(region, &strip)) {
+				result = -1;
+				break;
+			}
+		}
+
+		memcpy(buf, VIPS_REGION_ADDR(region, 0, y), linesize);
+		fftw_execute(plan);
+
+		if (size != 1.0)
+			for (x = 0; x < 2 * n; x++)
+				q[x] /= size;
+
+		if (vips_image_write_line(out, y, (VipsPel *) buf))
+			result = -1;
+	}
+
+	VIPS_UNREF(region);
+	g_mutex_lock(&vips__fft_lock);
+	fftw_destroy_plan(plan);
+	g_mutex_unlock(&vips__fft_lock);
+	fftw_free(buf);
+
+	return result;
+}
+
+/* Swap x and y.
+ */
+static int
+vips_fft_disc_transpose(VipsObject *context, VipsImage *in, VipsImage **out)
+{
+	VipsImage **t = (VipsImage **) vips_object_local_array(context, 1);
+
+	if (vips_image_pio_input(in) ||
+		vips_rot(in, &t[0], VIPS_ANGLE_D90, NULL) ||
+		vips_flip(t[0], out, VIPS_DIRECTION_HORIZONTAL, NULL))
+		return -1;
+
+	return 0;
+}
+
+/* Complex to complex 2D transform of a 1-band image, staged through temp
+ * files rather than memory.
+ *
+ * Memory strategy: a 2D transform is a set of 1D transforms of the rows
+ * followed by a set of 1D transforms of the columns. We do the rows strip by
+ * strip, transpose through a temp file so the columns become rows, transform
+ * those strip by strip, then transpose back as we read out. Peak memory use
+ * is a strip plus a few tiles, whatever the image size.
+ *
+ * input pipeline ->
+ *   row transforms ->
+ *     temp file ->
+ *       transpose ->
+ *         temp file ->
+ *           column transforms ->
+ *             temp file ->
+ *               partial transpose ->
+ *                 output pipeline
+ *
+ * Set @normalise to divide the result by the number of pixels, as the
+ * memory forward transform does.
+ */
+int
+vips__fft_disc(VipsObject *context,
+	VipsImage *in, VipsImage **out, int sign, gboolean normalise)
+{
+	VipsImage **t = (VipsImage **) vips_object_local_array(context, 5);
+	double size = normalise ? (double) VIPS_IMAGE_N_PELS(in) : 1.0;
+
+#ifdef DEBUG
+	printf("vips__fft_disc: %d x %d\n", in->Xsize, in->Ysize);
+#endif /*DEBUG*/
+
+	if (vips_cast_dpcomplex(in, &t[0], NULL))
+		return -1;
+
+	if (!(t[1] = vips_image_new_temp_file("%s.v")) ||
+		vips_fft_disc_lines(context, t[0], t[1], sign, 1.0))
+		return -1;
+
+	if (vips_fft_disc_transpose(context, t[1], &t[2]))
+		return -1;
+	if (!(t[3] = vips_image_new_temp_file("%s.v")) ||
+		vips_image_write(t[2], t[3]))
+		return -1;
+
+	if (!(t[4] = vips_image_new_temp_file("%s.v")) ||
+		vips_fft_disc_lines(context, t[3], t[4], sign, size))
+		return -1;
+
+	if (vips_fft_disc_transpose(context, t[4], out))
+		return -1;
+
+	return 0;
+}
+
+#endif /*HAVE_FFTW*/
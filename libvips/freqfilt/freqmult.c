@@ -15,6 +15,8 @@
  *	- use im_invfftr() to get real back for speedup
  * 3/1/14
  * 	- redone as a class
+ * 18/10/26
+ * 	- add "disc" option
  */
 
 /*
@@ -59,6 +61,7 @@ typedef struct _VipsFreqmult {
 	VipsFreqfilt parent_instance;
 
 	VipsImage *mask;
+	gboolean disc;
 } VipsFreqmult;
 
 typedef VipsFreqfiltClass VipsFreqmultClass;
@@ -81,11 +84,29 @@ vips_freqmult_build(VipsObject *object)
 
 	if (vips_band_format_iscomplex(in->BandFmt)) {
 		if (vips_multiply(in, freqmult->mask, &t[0], NULL) ||
-			vips_invfft(t[0], &t[1], "real", TRUE, NULL))
+			vips_invfft(t[0], &t[1],
+				"real", TRUE,
+				"disc", freqmult->disc,
+				NULL))
 			return -1;
 
 		in = t[1];
 	}
+	else if (freqmult->disc) {
+		/* Everything stays on disc, so there's no point making a
+		 * memory copy.
+		 */
+		if (vips_fwfft(in, &t[0], "disc", TRUE, NULL) ||
+			vips_multiply(t[0], freqmult->mask, &t[1], NULL) ||
+			vips_invfft(t[1], &t[2],
+				"real", TRUE,
+				"disc", TRUE,
+				NULL) ||
+			vips_cast(t[2], &t[3], in->BandFmt, NULL))
+			return -1;
+
+		in = t[3];
+	}
 	else {
 		/* Optimisation: output of vips_invfft() is double, we
 		 * will usually cast to char, so rather than keeping a
@@ -131,6 +152,13 @@ vips_freqmult_class_init(VipsFreqmultClass *class)
 		_("Input mask image"),
 		VIPS_ARGUMENT_REQUIRED_INPUT,
 		G_STRUCT_OFFSET(VipsFreqmult, mask));
+
+	VIPS_ARG_BOOL(class, "disc", 4,
+		_("Disc"),
+		_("Transform via temporary files"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsFreqmult, disc),
+		FALSE);
 }
 
 static void
@@ -151,6 +179,12 @@ vips_freqmult_init(VipsFreqmult *freqmult)
  * transformed back to real space. If @in is already a complex image, just
  * multiply then inverse transform.
  *
+ * Set @disc to do the transforms via temporary files, see
+ * [method@Image.fwfft].
+ *
+ * ::: tip "Optional arguments"
+ *     * @disc: `gboolean`, transform via temporary files
+ *
  * ::: seealso
  *     [method@Image.invfft], [ctor@Image.mask_ideal].
  *
@@ -39,6 +39,8 @@
  * 	- redone as a class
  * 15/12/23 [akash-akya]
  *	- add locks
+ * 18/10/26
+ * 	- add "disc" option for out-of-core transforms
  */
 
 /*
@@ -87,6 +89,8 @@
 typedef struct _VipsFwfft {
 	VipsFreqfilt parent_instance;
 
+	gboolean disc;
+
 } VipsFwfft;
 
 typedef VipsFreqfiltClass VipsFwfftClass;
@@ -307,6 +311,27 @@ cfwfft1(VipsObject *object, VipsImage *in, VipsImage **out)
 	return 0;
 }
 
+/* Complex to complex forward transform, via temp files.
+ */
+static int
+dfwfft1(VipsObject *object, VipsImage *in, VipsImage **out)
+{
+	VipsImage **t = (VipsImage **) vips_object_local_array(object, 1);
+	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(object);
+
+	if (vips_check_mono(class->nickname, in) ||
+		vips_check_uncoded(class->nickname, in))
+		return -1;
+
+	if (vips__fft_disc(object, in, &t[0], FFTW_FORWARD, TRUE) ||
+		vips_copy(t[0], out,
+			"interpretation", VIPS_INTERPRETATION_FOURIER,
+			NULL))
+		return -1;
+
+	return 0;
+}
+
 static int
 vips_fwfft_build(VipsObject *object)
 {
@@ -325,7 +350,12 @@ vips_fwfft_build(VipsObject *object)
 		return -1;
 	in = t[0];
 
-	if (vips_band_format_iscomplex(in->BandFmt)) {
+	if (fwfft->disc) {
+		if (vips__fftproc(VIPS_OBJECT(fwfft), in, &t[1],
+				dfwfft1))
+			return -1;
+	}
+	else if (vips_band_format_iscomplex(in->BandFmt)) {
 		if (vips__fftproc(VIPS_OBJECT(fwfft), in, &t[1],
 				cfwfft1))
 			return -1;
@@ -345,11 +375,22 @@ vips_fwfft_build(VipsObject *object)
 static void
 vips_fwfft_class_init(VipsFwfftClass *class)
 {
+	GObjectClass *gobject_class = G_OBJECT_CLASS(class);
 	VipsObjectClass *vobject_class = VIPS_OBJECT_CLASS(class);
 
+	gobject_class->set_property = vips_object_set_property;
+	gobject_class->get_property = vips_object_get_property;
+
 	vobject_class->nickname = "fwfft";
 	vobject_class->description = _("forward FFT");
 	vobject_class->build = vips_fwfft_build;
+
+	VIPS_ARG_BOOL(class, "disc", 4,
+		_("Disc"),
+		_("Transform via temporary files"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsFwfft, disc),
+		FALSE);
 }
 
 static void
@@ -370,6 +411,14 @@ vips_fwfft_init(VipsFwfft *fwfft)
  * VIPS uses the fftw Fourier Transform library. If this library was not
  * available when VIPS was configured, these functions will fail.
  *
+ * Normally the whole image is transformed in memory. Set @disc to transform
+ * rows and columns in strips, staging intermediate results through
+ * temporary files. Peak memory use is then bounded, so you can transform
+ * images larger than RAM, at the cost of some speed and disc space.
+ *
+ * ::: tip "Optional arguments"
+ *     * @disc: `gboolean`, transform via temporary files
+ *
  * ::: seealso
  *     [method@Image.invfft].
  *
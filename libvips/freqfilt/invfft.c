@@ -28,6 +28,8 @@
  * 	- redone as a class
  * 15/12/23 [akash-akya]
  *	- add locks
+ * 18/10/26
+ * 	- add "disc" option
  */
 
 /*
@@ -77,6 +79,7 @@ typedef struct _VipsInvfft {
 	VipsFreqfilt parent_instance;
 
 	gboolean real;
+	gboolean disc;
 
 } VipsInvfft;
 
@@ -215,6 +218,39 @@ rinvfft1(VipsObject *object, VipsImage *in, VipsImage **out)
 	return 0;
 }
 
+/* Complex to complex inverse transform, via temp files.
+ */
+static int
+dinvfft1(VipsObject *object, VipsImage *in, VipsImage **out)
+{
+	VipsImage **t = (VipsImage **) vips_object_local_array(object, 2);
+	VipsInvfft *invfft = (VipsInvfft *) object;
+	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(invfft);
+
+	VipsImage *x;
+
+	if (vips_check_mono(class->nickname, in) ||
+		vips_check_uncoded(class->nickname, in))
+		return -1;
+
+	if (vips__fft_disc(object, in, &t[0], FFTW_BACKWARD, FALSE))
+		return -1;
+	x = t[0];
+
+	if (invfft->real) {
+		if (vips_real(x, &t[1], NULL))
+			return -1;
+		x = t[1];
+	}
+
+	if (vips_copy(x, out,
+			"interpretation", VIPS_INTERPRETATION_B_W,
+			NULL))
+		return -1;
+
+	return 0;
+}
+
 static int
 vips_invfft_build(VipsObject *object)
 {
@@ -233,7 +269,12 @@ vips_invfft_build(VipsObject *object)
 		return -1;
 	in = t[0];
 
-	if (invfft->real) {
+	if (invfft->disc) {
+		if (vips__fftproc(VIPS_OBJECT(invfft),
+				in, &t[1], dinvfft1))
+			return -1;
+	}
+	else if (invfft->real) {
 		if (vips__fftproc(VIPS_OBJECT(invfft),
 				in, &t[1], rinvfft1))
 			return -1;
@@ -269,6 +310,13 @@ vips_invfft_class_init(VipsInvfftClass *class)
 		VIPS_ARGUMENT_OPTIONAL_INPUT,
 		G_STRUCT_OFFSET(VipsInvfft, real),
 		FALSE);
+
+	VIPS_ARG_BOOL(class, "disc", 5,
+		_("Disc"),
+		_("Transform via temporary files"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsInvfft, disc),
+		FALSE);
 }
 
 static void
@@ -292,8 +340,12 @@ vips_invfft_init(VipsInvfft *invfft)
  * VIPS uses the fftw Fourier Transform library. If this library was not
  * available when VIPS was configured, these functions will fail.
  *
+ * Set @disc to transform in strips via temporary files, see
+ * [method@Image.fwfft].
+ *
  * ::: tip "Optional arguments"
  *     * @real: `gboolean`, only output the real part
+ *     * @disc: `gboolean`, transform via temporary files
  *
  * ::: seealso
  *     [method@Image.fwfft].
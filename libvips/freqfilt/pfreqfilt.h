@@ -74,6 +74,9 @@ typedef int (*VipsFftProcessFn)(VipsObject *, VipsImage *, VipsImage **);
 int vips__fftproc(VipsObject *context,
 	VipsImage *in, VipsImage **out, VipsFftProcessFn fn);
 
+int vips__fft_disc(VipsObject *context,
+	VipsImage *in, VipsImage **out, int sign, gboolean normalise);
+
 #ifdef __cplusplus
 }
 #endif /*__cplusplus*/
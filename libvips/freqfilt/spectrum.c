@@ -16,6 +16,8 @@
  * 	- cleanups
  * 3/1/14
  * 	- redone as a class
+ * 18/10/26
+ * 	- add "disc" option
  */
 
 /*
@@ -56,7 +58,13 @@
 #include <vips/vips.h>
 #include "pfreqfilt.h"
 
-typedef VipsFreqfilt VipsSpectrum;
+typedef struct _VipsSpectrum {
+	VipsFreqfilt parent_instance;
+
+	gboolean disc;
+
+} VipsSpectrum;
+
 typedef VipsFreqfiltClass VipsSpectrumClass;
 
 G_DEFINE_TYPE(VipsSpectrum, vips_spectrum, VIPS_TYPE_FREQFILT);
@@ -65,6 +73,7 @@ static int
 vips_spectrum_build(VipsObject *object)
 {
 	VipsFreqfilt *freqfilt = VIPS_FREQFILT(object);
+	VipsSpectrum *spectrum = (VipsSpectrum *) object;
 	VipsImage **t = (VipsImage **) vips_object_local_array(object, 5);
 
 	VipsImage *in;
@@ -75,7 +84,9 @@ vips_spectrum_build(VipsObject *object)
 	in = freqfilt->in;
 
 	if (in->BandFmt != VIPS_FORMAT_COMPLEX) {
-		if (vips_fwfft(in, &t[0], NULL))
+		if (vips_fwfft(in, &t[0],
+				"disc", spectrum->disc,
+				NULL))
 			return -1;
 		in = t[0];
 	}
@@ -94,11 +105,22 @@ vips_spectrum_build(VipsObject *object)
 static void
 vips_spectrum_class_init(VipsSpectrumClass *class)
 {
+	GObjectClass *gobject_class = G_OBJECT_CLASS(class);
 	VipsObjectClass *vobject_class = VIPS_OBJECT_CLASS(class);
 
+	gobject_class->set_property = vips_object_set_property;
+	gobject_class->get_property = vips_object_get_property;
+
 	vobject_class->nickname = "spectrum";
 	vobject_class->description = _("make displayable power spectrum");
 	vobject_class->build = vips_spectrum_build;
+
+	VIPS_ARG_BOOL(class, "disc", 4,
+		_("Disc"),
+		_("Transform via temporary files"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsSpectrum, disc),
+		FALSE);
 }
 
 static void
@@ -118,6 +140,12 @@ vips_spectrum_init(VipsSpectrum *spectrum)
  * absolute value is passed through [method@Image.scale] in log mode, and
  * [method@Image.wrap].
  *
+ * Set @disc to do the transform via temporary files, see
+ * [method@Image.fwfft].
+ *
+ * ::: tip "Optional arguments"
+ *     * @disc: `gboolean`, transform via temporary files
+ *
  * ::: seealso
  *     [method@Image.fwfft], [method@Image.scale], [method@Image.wrap].
  *
@@ -234,12 +234,14 @@ vips_histogram_operation_init(void)
 	extern GType vips_hist_ismonotonic_get_type(void);
 	extern GType vips_hist_entropy_get_type(void);
 	extern GType vips_stdif_get_type(void);
+	extern GType vips_threshold_local_get_type(void);
 
 	vips_maplut_get_type();
 	vips_case_get_type();
 	vips_percent_get_type();
 	vips_percent_lum_get_type();
 	vips_stdif_get_type();
+	vips_threshold_local_get_type();
 	vips_hist_cum_get_type();
 	vips_hist_norm_get_type();
 	vips_hist_equal_get_type();
@@ -24,6 +24,9 @@
  * 10/8/13
  * 	- wrapped as a class using hist_local.c
  * 	- many bands
+ * 18/10/26
+ * 	- find window stats from summed-area tables, so constant time for
+ * 	  any window size
  */
 
 /*
@@ -86,167 +89,49 @@ typedef VipsOperationClass VipsStdifClass;
 
 G_DEFINE_TYPE(VipsStdif, vips_stdif, VIPS_TYPE_OPERATION);
 
-/* Our sequence value.
- */
-typedef struct {
-	VipsRegion *ir; /* Input region */
-
-	/* The sums for each band.
-	 */
-	unsigned int *sum;
-	unsigned int *sum2;
-} VipsStdifSequence;
-
-static int
-vips_stdif_stop(void *vseq, void *a, void *b)
-{
-	VipsStdifSequence *seq = (VipsStdifSequence *) vseq;
-
-	VIPS_UNREF(seq->ir);
-	VIPS_FREE(seq->sum);
-	VIPS_FREE(seq->sum2);
-	VIPS_FREE(seq);
-
-	return 0;
-}
-
-static void *
-vips_stdif_start(VipsImage *out, void *a, void *b)
-{
-	VipsImage *in = (VipsImage *) a;
-	VipsStdifSequence *seq;
-
-	if (!(seq = VIPS_NEW(NULL, VipsStdifSequence)))
-		return NULL;
-	seq->ir = NULL;
-	seq->sum = NULL;
-	seq->sum2 = NULL;
-
-	if (!(seq->ir = vips_region_new(in)) ||
-		!(seq->sum = VIPS_ARRAY(NULL, in->Bands, unsigned int)) ||
-		!(seq->sum2 = VIPS_ARRAY(NULL, in->Bands, unsigned int))) {
-		vips_stdif_stop(seq, NULL, NULL);
-		return NULL;
-	}
-
-	return seq;
-}
-
 static int
 vips_stdif_generate(VipsRegion *out_region,
-	void *vseq, void *a, void *b, gboolean *stop)
+	void *seq, void *a, void *b, gboolean *stop)
 {
-	VipsStdifSequence *seq = (VipsStdifSequence *) vseq;
-	VipsImage *in = (VipsImage *) a;
+	VipsWindowStats *stats = (VipsWindowStats *) seq;
 	VipsStdif *stdif = (VipsStdif *) b;
 	VipsRect *r = &out_region->valid;
-	const int bands = in->Bands;
-	const int npel = stdif->width * stdif->height;
-
-	VipsRect s;
-	int lsk;
-	int centre; /* Offset to move to centre of window */
+	const int bands = out_region->im->Bands;
+	const double f1 = stdif->a * stdif->m0;
+	const double f2 = 1.0 - stdif->a;
+	const double f3 = stdif->b * stdif->s0;
 
-	/* Prepare the section of the input image we need. A little larger
-	 * than the section of the output image we are producing.
-	 */
-	s = *r;
-	s.width += stdif->width;
-	s.height += stdif->height - 1;
-	if (vips_region_prepare(seq->ir, &s))
+	if (vips__window_stats_prepare(stats, r))
 		return -1;
 
-	lsk = VIPS_REGION_LSKIP(seq->ir);
-	centre = lsk * (stdif->height / 2) + bands * (stdif->width / 2);
-
 	for (int y = 0; y < r->height; y++) {
-		/* Get input and output pointers for this line.
-		 */
-		VipsPel *restrict p =
-			VIPS_REGION_ADDR(seq->ir, r->left, r->top + y);
 		VipsPel *restrict q =
 			VIPS_REGION_ADDR(out_region, r->left, r->top + y);
 
-		double f1 = stdif->a * stdif->m0;
-		double f2 = 1.0 - stdif->a;
-		double f3 = stdif->b * stdif->s0;
-
-		VipsPel *restrict p1;
+		for (int x = 0; x < r->width; x++)
+			for (int i = 0; i < bands; i++) {
+				double centre, mean, var, sig, res;
 
-		/* We will get int overflow for windows larger than about 256
-		 * x 256, sadly.
-		 */
-
-		/* Find sum, sum of squares for the start of this line.
-		 */
-		memset(seq->sum, 0, bands * sizeof(unsigned int));
-		memset(seq->sum2, 0, bands * sizeof(unsigned int));
-
-		p1 = p;
-		for (int j = 0; j < stdif->height; j++) {
-			int i;
-
-			i = 0;
-			for (int x = 0; x < stdif->width; x++) {
-				for (int b = 0; b < bands; b++, i++) {
-					int t = p1[i];
-
-					seq->sum[b] += t;
-					seq->sum2[b] += t * t;
-				}
-			}
-
-			p1 += lsk;
-		}
-
-		/* Loop for output pels.
-		 */
-		for (int x = 0; x < r->width; x++) {
-			for (int b = 0; b < bands; b++) {
 				/* Find stats.
 				 */
-				double mean = (double) seq->sum[b] / npel;
-				double var = (double) seq->sum2[b] / npel -
-					(mean * mean);
-				double sig = sqrt(var);
+				vips__window_stats_get(stats,
+					r->left + x, r->top + y, i, &centre, &mean, &var);
+				sig = sqrt(var);
 
 				/* Transform.
 				 */
-				double res = f1 + f2 * mean +
-					((double) p[centre + b] - mean) *
-						(f3 / (stdif->s0 + stdif->b * sig));
+				res = f1 + f2 * mean +
+					(centre - mean) * (f3 / (stdif->s0 + stdif->b * sig));
 
 				/* And write.
 				 */
 				if (res < 0.0)
-					q[b] = 0;
+					q[x * bands + i] = 0;
 				else if (res >= 256.0)
-					q[b] = 255;
+					q[x * bands + i] = 255;
 				else
-					q[b] = res + 0.5;
-
-				/* Adapt sums -- remove the pels from the left hand column,
-				 * add in pels for a new right-hand column.
-				 */
-				const int next = bands * stdif->width;
-				p1 = p + b;
-				for (int j = 0; j < stdif->height; j++) {
-					int t1 = p1[0];
-					int t2 = p1[next];
-
-					seq->sum[b] -= t1;
-					seq->sum2[b] -= t1 * t1;
-
-					seq->sum[b] += t2;
-					seq->sum2[b] += t2 * t2;
-
-					p1 += lsk;
-				}
+					q[x * bands + i] = res + 0.5;
 			}
-
-			p += bands;
-			q += bands;
-		}
 	}
 
 	return 0;
@@ -257,7 +142,7 @@ vips_stdif_build(VipsObject *object)
 {
 	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(object);
 	VipsStdif *stdif = (VipsStdif *) object;
-	VipsImage **t = (VipsImage **) vips_object_local_array(object, 3);
+	VipsImage **t = (VipsImage **) vips_object_local_array(object, 2);
 
 	VipsImage *in;
 
@@ -273,21 +158,11 @@ vips_stdif_build(VipsObject *object)
 	if (vips_check_format(class->nickname, in, VIPS_FORMAT_UCHAR))
 		return -1;
 
-	if (stdif->width > in->Xsize ||
-		stdif->height > in->Ysize) {
-		vips_error(class->nickname, "%s", _("window too large"));
-		return -1;
-	}
-
 	/* Expand the input.
 	 */
-	if (vips_embed(in, &t[1],
-			stdif->width / 2, stdif->height / 2,
-			in->Xsize + stdif->width, in->Ysize + stdif->height - 1,
-			"extend", VIPS_EXTEND_COPY,
-			NULL))
+	if (vips__window_stats_embed(class->nickname, in,
+			stdif->width, stdif->height, &t[1]))
 		return -1;
-	in = t[1];
 
 	g_object_set(object, "out", vips_image_new(), NULL);
 
@@ -297,19 +172,14 @@ vips_stdif_build(VipsObject *object)
 	if (vips_image_pipelinev(stdif->out,
 			VIPS_DEMAND_STYLE_FATSTRIP, in, NULL))
 		return -1;
-	stdif->out->Xsize -= stdif->width;
-	stdif->out->Ysize -= stdif->height - 1;
 
 	if (vips_image_generate(stdif->out,
-			vips_stdif_start,
+			vips__window_stats_start,
 			vips_stdif_generate,
-			vips_stdif_stop,
-			in, stdif))
+			vips__window_stats_stop,
+			t[1], stdif))
 		return -1;
 
-	stdif->out->Xoffset = 0;
-	stdif->out->Yoffset = 0;
-
 	vips_reorder_margin_hint(stdif->out, stdif->width * stdif->height);
 
 	return 0;
@@ -343,21 +213,19 @@ vips_stdif_class_init(VipsStdifClass *class)
 		VIPS_ARGUMENT_REQUIRED_OUTPUT,
 		G_STRUCT_OFFSET(VipsStdif, out));
 
-	/* Windows larger than 256x256 will overflow sum2, see above.
-	 */
 	VIPS_ARG_INT(class, "width", 4,
 		_("Width"),
 		_("Window width in pixels"),
 		VIPS_ARGUMENT_REQUIRED_INPUT,
 		G_STRUCT_OFFSET(VipsStdif, width),
-		1, 256, 11);
+		1, VIPS_MAX_COORD, 11);
 
 	VIPS_ARG_INT(class, "height", 5,
 		_("Height"),
 		_("Window height in pixels"),
 		VIPS_ARGUMENT_REQUIRED_INPUT,
 		G_STRUCT_OFFSET(VipsStdif, height),
-		1, 256, 11);
+		1, VIPS_MAX_COORD, 11);
 
 	VIPS_ARG_DOUBLE(class, "a", 2,
 		_("Mean weight"),
@@ -438,6 +306,9 @@ vips_stdif_init(VipsStdif *stdif)
  * operation so that the output image has the same size as the input.
  * Edge pixels in the output image are therefore only approximate.
  *
+ * Window statistics are found from summed-area tables of each area of the
+ * input, so the cost per pixel does not depend on the size of the window.
+ *
  * ::: tip "Optional arguments"
  *     * @a: `gdouble`, weight of new mean
  *     * @m0: `gdouble`, target mean
@@ -445,7 +316,7 @@ vips_stdif_init(VipsStdif *stdif)
  *     * @s0: `gdouble`, target deviation
  *
  * ::: seealso
- *     [method@Image.hist_local].
+ *     [method@Image.hist_local], [method@Image.integral].
  *
  * Returns: 0 on success, -1 on error
  */
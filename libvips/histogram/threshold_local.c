@@ -0,0 +1,241 @@
+/* threshold against window statistics
+ *
+ * 18/10/26
+ * 	- from stdif.c
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <vips/vips.h>
+#include <vips/internal.h>
+
+typedef struct _VipsThresholdLocal {
+	VipsOperation parent_instance;
+
+	VipsImage *in;
+	VipsImage *out;
+
+	int width;
+	int height;
+	double k;
+
+} VipsThresholdLocal;
+
+typedef VipsOperationClass VipsThresholdLocalClass;
+
+G_DEFINE_TYPE(VipsThresholdLocal, vips_threshold_local, VIPS_TYPE_OPERATION);
+
+static int
+vips_threshold_local_generate(VipsRegion *out_region,
+	void *seq, void *a, void *b, gboolean *stop)
+{
+	VipsWindowStats *stats = (VipsWindowStats *) seq;
+	VipsThresholdLocal *threshold = (VipsThresholdLocal *) b;
+	VipsRect *r = &out_region->valid;
+	const int bands = out_region->im->Bands;
+
+	if (vips__window_stats_prepare(stats, r))
+		return -1;
+
+	for (int y = 0; y < r->height; y++) {
+		VipsPel *restrict q =
+			VIPS_REGION_ADDR(out_region, r->left, r->top + y);
+
+		for (int x = 0; x < r->width; x++)
+			for (int i = 0; i < bands; i++) {
+				double centre, mean, var;
+
+				vips__window_stats_get(stats,
+					r->left + x, r->top + y, i, &centre, &mean, &var);
+				q[x * bands + i] =
+					centre > mean + threshold->k * sqrt(var) ? 255 : 0;
+			}
+	}
+
+	return 0;
+}
+
+static int
+vips_threshold_local_build(VipsObject *object)
+{
+	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(object);
+	VipsThresholdLocal *threshold = (VipsThresholdLocal *) object;
+	VipsImage **t = (VipsImage **) vips_object_local_array(object, 2);
+
+	VipsImage *in;
+
+	if (VIPS_OBJECT_CLASS(vips_threshold_local_parent_class)->build(object))
+		return -1;
+
+	in = threshold->in;
+
+	if (vips_image_decode(in, &t[0]))
+		return -1;
+	in = t[0];
+
+	if (vips_check_noncomplex(class->nickname, in) ||
+		vips__window_stats_embed(class->nickname, in,
+			threshold->width, threshold->height, &t[1]))
+		return -1;
+
+	g_object_set(object, "out", vips_image_new(), NULL);
+
+	if (vips_image_pipelinev(threshold->out,
+			VIPS_DEMAND_STYLE_FATSTRIP, in, NULL))
+		return -1;
+	threshold->out->BandFmt = VIPS_FORMAT_UCHAR;
+	threshold->out->Type = VIPS_INTERPRETATION_B_W;
+
+	if (vips_image_generate(threshold->out,
+			vips__window_stats_start,
+			vips_threshold_local_generate,
+			vips__window_stats_stop,
+			t[1], threshold))
+		return -1;
+
+	vips_reorder_margin_hint(threshold->out,
+		threshold->width * threshold->height);
+
+	return 0;
+}
+
+static void
+vips_threshold_local_class_init(VipsThresholdLocalClass *class)
+{
+	GObjectClass *gobject_class = G_OBJECT_CLASS(class);
+	VipsObjectClass *object_class = (VipsObjectClass *) class;
+	VipsOperationClass *operation_class = VIPS_OPERATION_CLASS(class);
+
+	gobject_class->set_property = vips_object_set_property;
+	gobject_class->get_property = vips_object_get_property;
+
+	object_class->nickname = "threshold_local";
+	object_class->description = _("threshold against window statistics");
+	object_class->build = vips_threshold_local_build;
+
+	operation_class->flags = VIPS_OPERATION_SEQUENTIAL;
+
+	VIPS_ARG_IMAGE(class, "in", 1,
+		_("Input"),
+		_("Input image"),
+		VIPS_ARGUMENT_REQUIRED_INPUT,
+		G_STRUCT_OFFSET(VipsThresholdLocal, in));
+
+	VIPS_ARG_IMAGE(class, "out", 2,
+		_("Output"),
+		_("Output image"),
+		VIPS_ARGUMENT_REQUIRED_OUTPUT,
+		G_STRUCT_OFFSET(VipsThresholdLocal, out));
+
+	VIPS_ARG_INT(class, "width", 4,
+		_("Width"),
+		_("Window width in pixels"),
+		VIPS_ARGUMENT_REQUIRED_INPUT,
+		G_STRUCT_OFFSET(VipsThresholdLocal, width),
+		1, VIPS_MAX_COORD, 15);
+
+	VIPS_ARG_INT(class, "height", 5,
+		_("Height"),
+		_("Window height in pixels"),
+		VIPS_ARGUMENT_REQUIRED_INPUT,
+		G_STRUCT_OFFSET(VipsThresholdLocal, height),
+		1, VIPS_MAX_COORD, 15);
+
+	VIPS_ARG_DOUBLE(class, "k", 6,
+		_("K"),
+		_("Weight of window deviation"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsThresholdLocal, k),
+		-INFINITY, INFINITY, 0.0);
+}
+
+static void
+vips_threshold_local_init(VipsThresholdLocal *threshold)
+{
+	threshold->width = 15;
+	threshold->height = 15;
+}
+
+/**
+ * vips_threshold_local: (method)
+ * @in: input image
+ * @out: (out): output image
+ * @width: width of window
+ * @height: height of window
+ * @...: `NULL`-terminated list of optional named arguments
+ *
+ * Threshold each pixel of @in against the statistics of the @width by
+ * @height window centred on it. Following Niblack, "An Introduction to
+ * Digital Image Processing", the output is 255 where
+ *
+ * ```
+ * vin(i,j) > meanv + @k * stdv
+ * ```
+ *
+ * and 0 elsewhere. With the default @k of 0, pixels are compared to their
+ * window mean. This copes with uneven lighting much better than a single
+ * global threshold.
+ *
+ * Any non-complex image is accepted, and each band is thresholded
+ * separately. The output is uchar and has the same size as @in.
+ *
+ * The window statistics come from summed-area tables of each area of the
+ * input, so the cost per pixel does not depend on the size of the window.
+ * The input is expanded by copying edge pixels, so the output is the same
+ * size as @in. The window must be no larger than @in.
+ *
+ * ::: tip "Optional arguments"
+ *     * @k: `gdouble`, weight of window deviation
+ *
+ * ::: seealso
+ *     [method@Image.stdif], [method@Image.box], [method@Image.more].
+ *
+ * Returns: 0 on success, -1 on error
+ */
+int
+vips_threshold_local(VipsImage *in, VipsImage **out,
+	int width, int height, ...)
+{
+	va_list ap;
+	int result;
+
+	va_start(ap, height);
+	result = vips_call_split("threshold_local", ap, in, out, width, height);
+	va_end(ap);
+
+	return result;
+}
@@ -548,6 +548,9 @@ int vips_find_trim(VipsImage *in,
 	int *left, int *top, int *width, int *height, ...)
 	G_GNUC_NULL_TERMINATED;
 VIPS_API
+int vips_integral(VipsImage *in, VipsImage **out, ...)
+	G_GNUC_NULL_TERMINATED;
+VIPS_API
 int vips_getpoint(VipsImage *in, double **vector, int *n, int x, int y, ...)
 	G_GNUC_NULL_TERMINATED;
 VIPS_API
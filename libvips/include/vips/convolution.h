@@ -63,6 +63,9 @@ int vips_convsep(VipsImage *in, VipsImage **out, VipsImage *mask, ...)
 VIPS_API
 int vips_convasep(VipsImage *in, VipsImage **out, VipsImage *mask, ...)
 	G_GNUC_NULL_TERMINATED;
+VIPS_API
+int vips_box(VipsImage *in, VipsImage **out, int width, int height, ...)
+	G_GNUC_NULL_TERMINATED;
 
 VIPS_API
 int vips_compass(VipsImage *in, VipsImage **out, VipsImage *mask, ...)
@@ -72,6 +72,30 @@ extern "C" {
 VIPS_API
 void vips_profile_set(gboolean profile);
 
+/* What we record for each image with vips_operation_profile_set(). Times
+ * are in microseconds.
+ */
+typedef struct _VipsProfileRecord {
+	const char *nickname; /* Operation that made this image */
+	struct _VipsImage *image;
+
+	gint64 calls;		 /* Calls to generate */
+	gint64 wall;		 /* Wall time in generate, including inputs */
+	gint64 self_wall;	 /* Wall time in generate, excluding inputs */
+	gint64 self_cpu;	 /* CPU time in generate, excluding inputs */
+	gint64 pixels;		 /* Pixels made by generate */
+	gint64 tiles;		 /* Requests for pixels */
+	gint64 cache_hits;	 /* Requests found in the buffer cache */
+	gint64 buffer_bytes; /* Pixel buffer memory taken */
+} VipsProfileRecord;
+
+VIPS_API
+void vips_operation_profile_set(gboolean profile);
+VIPS_API
+VipsProfileRecord *vips_image_get_profile(struct _VipsImage *image, int *n);
+VIPS_API
+char *vips_image_get_profile_json(struct _VipsImage *image);
+
 #endif /*VIPS_GATE_H*/
 
 #ifdef __cplusplus
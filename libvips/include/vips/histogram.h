@@ -51,6 +51,10 @@ VIPS_API
 int vips_stdif(VipsImage *in, VipsImage **out, int width, int height, ...)
 	G_GNUC_NULL_TERMINATED;
 VIPS_API
+int vips_threshold_local(VipsImage *in, VipsImage **out,
+	int width, int height, ...)
+	G_GNUC_NULL_TERMINATED;
+VIPS_API
 int vips_hist_cum(VipsImage *in, VipsImage **out, ...)
 	G_GNUC_NULL_TERMINATED;
 VIPS_API
@@ -89,11 +89,12 @@ extern "C" {
 /* What we store in the Meta hash table. We can't just use GHashTable's
  * key/value pairs, since we need to iterate over meta in Meta_traverse order.
  *
- * We don't refcount at this level ... large meta values are refcounted by
- * their GValue implementation, see eg. MetaArea.
+ * Items are immutable once made and refcounted, so they can be shared
+ * between the images in a pipeline. Each image holds a ref from its hash
+ * table, and the traverse list borrows it.
  */
 typedef struct _VipsMeta {
-	VipsImage *im;
+	int ref_count;
 
 	char *name;	  /* strdup() of field name */
 	GValue value; /* copy of value */
@@ -149,6 +150,14 @@ extern int vips__info;
  */
 extern char *vips__disc_threshold;
 
+/* Spill to compressed tiled temp files rather than uncompressed .v files.
+ */
+extern gboolean vips__disc_compress;
+
+/* Ask for transparent huge pages for large pixel buffers.
+ */
+extern gboolean vips__hugepages;
+
 extern gboolean vips__cache_dump;
 extern gboolean vips__cache_trace;
 
@@ -169,6 +178,7 @@ VIPS_API void vips__worker_cond_wait(GCond *cond, GMutex *mutex);
 gboolean vips__worker_exit(void);
 
 void vips__cache_init(void);
+unsigned int vips__value_hash(GParamSpec *pspec, const GValue *value);
 
 int vips__print_renders(void);
 int vips__type_leak(void);
@@ -208,6 +218,8 @@ int vips_remapfilerw(VipsImage *image);
 
 void vips__buffer_init(void);
 void vips__buffer_shutdown(void);
+void vips__buffer_pool_shutdown(void);
+void vips__buffer_pool_stats(VipsBuf *buf);
 
 void vips__copy_4byte(int swap, unsigned char *to, unsigned char *from);
 void vips__copy_2byte(gboolean swap, unsigned char *to, unsigned char *from);
@@ -287,6 +299,43 @@ void vips__draw_circle_direct(VipsImage *image, int cx, int cy, int r,
 
 int vips__insert_paste_region(VipsRegion *out, VipsRegion *in, VipsRect *pos);
 
+/* Window sums from vips_integral() tables.
+ */
+double vips__integral_window(VipsImage *table,
+	int x, int y, int width, int height, int b);
+
+/* Window mean and variance for streaming window filters, from summed-area
+ * tables of each area of input.
+ */
+typedef struct _VipsWindowStats {
+	VipsRegion *ir;
+	int width;
+	int height;
+	int bands;
+
+	/* The output area the tables are for, their stride in doubles, and
+	 * the input unpacked to double.
+	 */
+	VipsRect area;
+	int tw;
+	double *pixels;
+	double *sum;
+	double *sum2;
+	size_t size;
+
+	/* The tables are of the input less this, per band.
+	 */
+	double *offset;
+} VipsWindowStats;
+
+int vips__window_stats_embed(const char *domain, VipsImage *in,
+	int width, int height, VipsImage **out);
+void *vips__window_stats_start(VipsImage *out, void *a, void *b);
+int vips__window_stats_stop(void *seq, void *a, void *b);
+int vips__window_stats_prepare(VipsWindowStats *stats, VipsRect *r);
+void vips__window_stats_get(VipsWindowStats *stats, int x, int y, int b,
+	double *centre, double *mean, double *variance);
+
 /* Register base vips interpolators, called during startup.
  */
 void vips__interpolate_init(void);
@@ -65,6 +65,9 @@ int vips_labelregions(VipsImage *in, VipsImage **mask, ...)
 VIPS_API
 int vips_fill_nearest(VipsImage *in, VipsImage **out, ...)
 	G_GNUC_NULL_TERMINATED;
+VIPS_API
+int vips_distance(VipsImage *in, VipsImage **out, ...)
+	G_GNUC_NULL_TERMINATED;
 
 #ifdef __cplusplus
 }
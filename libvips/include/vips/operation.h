@@ -127,6 +127,21 @@ VIPS_API
 int vips_call_split_option_string(const char *operation_name,
 	const char *option_string, va_list optional, ...);
 
+typedef struct _VipsPreparedCall VipsPreparedCall;
+
+VIPS_API
+VipsPreparedCall *vips_prepared_call_new(const char *operation_name,
+	const char *first_name, ...)
+	G_GNUC_NULL_TERMINATED;
+VIPS_API
+int vips_prepared_call_n_values(VipsPreparedCall *call);
+VIPS_API
+void vips_prepared_call_init_values(VipsPreparedCall *call, GValue *values);
+VIPS_API
+int vips_prepared_call_run(VipsPreparedCall *call, GValue *values);
+VIPS_API
+void vips_prepared_call_free(VipsPreparedCall *call);
+
 VIPS_API
 void vips_call_options(GOptionGroup *group, VipsOperation *operation);
 VIPS_API
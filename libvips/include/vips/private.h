@@ -224,6 +224,43 @@ void vips__thread_gate_stop(const char *gate_name);
 
 void vips__thread_malloc_free(gint64 size);
 
+extern gboolean vips__operation_profile;
+extern GQuark vips__profile_quark;
+
+/* Start and end times for a call to generate, and the time our caller had
+ * seen from its other inputs.
+ */
+typedef struct _VipsProfileTimer {
+	gint64 wall;
+	gint64 cpu;
+	gint64 child_wall;
+	gint64 child_cpu;
+} VipsProfileTimer;
+
+void vips__profile_attach(struct _VipsImage *image);
+void vips__profile_label(struct _VipsImage *image, const char *nickname);
+void vips__profile_generate_start(VipsProfileTimer *timer);
+void vips__profile_generate_stop(VipsProfileTimer *timer,
+	struct _VipsRegion *region);
+void vips__profile_tile(struct _VipsImage *image, gboolean hit);
+void vips__profile_buffer(struct _VipsImage *image, size_t bytes);
+
+#define VIPS_PROFILE_TILE(IMAGE, HIT) \
+	G_STMT_START \
+	{ \
+		if (vips__operation_profile) \
+			vips__profile_tile(IMAGE, HIT); \
+	} \
+	G_STMT_END
+
+#define VIPS_PROFILE_BUFFER(IMAGE, BYTES) \
+	G_STMT_START \
+	{ \
+		if (vips__operation_profile) \
+			vips__profile_buffer(IMAGE, BYTES); \
+	} \
+	G_STMT_END
+
 FILE *vips__file_open_read(const char *filename,
 	const char *fallback_dir, gboolean text_mode);
 FILE *vips__file_open_write(const char *filename,
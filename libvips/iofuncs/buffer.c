@@ -25,6 +25,11 @@
  * 	  buffers don't clog up the system
  * 13/10/16
  * 	- better solution: don't keep a buffercache for non-workers
+ * 18/10/26
+ * 	- recycle pixel memory through a pool of size classes, with per-thread
+ * 	  magazines and a shared depot
+ * 	- ask for transparent huge pages for large blocks, if enabled
+ * 	- count buffer memory for operation profiles
  */
 
 /*
@@ -67,6 +72,11 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif /*HAVE_SYS_MMAN_H*/
 
 #include <vips/vips.h>
 #include <vips/internal.h>
@@ -92,6 +102,60 @@ static void buffer_thread_destroy_notify(gpointer data);
 static GPrivate buffer_thread_key =
 	G_PRIVATE_INIT(buffer_thread_destroy_notify);
 
+/* Pixel memory is recycled through a pool. Sizes are rounded up to one of
+ * four steps per power of two, so we waste at most 25%, from 4kb up to
+ * 256mb. Larger blocks are allocated exactly and never pooled.
+ */
+#define BUFFER_POOL_MIN_SHIFT (12)
+#define BUFFER_POOL_MAX_SHIFT (28)
+#define BUFFER_POOL_N_CLASSES \
+	(4 * (BUFFER_POOL_MAX_SHIFT - BUFFER_POOL_MIN_SHIFT) + 1)
+
+/* Workers keep a few blocks of each class in a private magazine, so most
+ * allocations need no lock. Magazines overflow into a shared depot, and
+ * anything past that is freed.
+ *
+ * Pooled blocks still count towards vips_tracked_get_mem(), so keep these
+ * small.
+ */
+static const int buffer_magazine_max_blocks = 2;
+static const size_t buffer_magazine_max_mem = 8 * 1024 * 1024;
+static const size_t buffer_depot_max_mem = 32 * 1024 * 1024;
+
+/* Blocks this large or larger are aligned for huge pages.
+ */
+#define BUFFER_HUGEPAGE_SIZE (2 * 1024 * 1024)
+
+typedef struct _BufferMagazine {
+	/* Free blocks are chained through their first word.
+	 */
+	void *blocks[BUFFER_POOL_N_CLASSES];
+	int n_blocks[BUFFER_POOL_N_CLASSES];
+	size_t mem;
+
+	/* Folded into the global counts when the magazine is flushed.
+	 */
+	guint64 hits;
+	guint64 reused;
+} BufferMagazine;
+
+static void buffer_magazine_destroy_notify(gpointer data);
+static GPrivate buffer_magazine_key =
+	G_PRIVATE_INIT(buffer_magazine_destroy_notify);
+
+/* The depot, and the pool counters, all behind this lock.
+ */
+static GMutex buffer_depot_lock;
+static void *buffer_depot[BUFFER_POOL_N_CLASSES];
+static size_t buffer_depot_mem = 0;
+static gboolean buffer_depot_closed = FALSE;
+
+static guint64 buffer_pool_hits = 0;
+static guint64 buffer_pool_misses = 0;
+static guint64 buffer_pool_reused = 0;
+static guint64 buffer_pool_discards = 0;
+static guint64 buffer_pool_hugepages = 0;
+
 void
 vips_buffer_print(VipsBuffer *buffer)
 {
@@ -197,10 +261,246 @@ vips_buffer_dump_all(void)
 #endif /*DEBUG*/
 }
 
+/* The size class for a block of @size bytes, or -1 for too large to pool.
+ */
+static int
+buffer_pool_class(size_t size)
+{
+	int shift;
+	size_t base;
+	int step;
+
+	if (size <= ((size_t) 1 << BUFFER_POOL_MIN_SHIFT))
+		return 0;
+
+	/* The power of two below size, then which quarter-step above that.
+	 */
+	for (shift = BUFFER_POOL_MIN_SHIFT;
+		 ((size_t) 2 << shift) < size; shift++)
+		;
+	if (shift >= BUFFER_POOL_MAX_SHIFT)
+		return -1;
+
+	base = (size_t) 1 << shift;
+	step = (size - base + (base / 4) - 1) / (base / 4);
+
+	return 4 * (shift - BUFFER_POOL_MIN_SHIFT) + step;
+}
+
+static size_t
+buffer_pool_class_size(int class)
+{
+	size_t base = (size_t) 1 << (BUFFER_POOL_MIN_SHIFT + class / 4);
+
+	return base + (class % 4) * (base / 4);
+}
+
+static void
+buffer_block_push(void **list, void *block)
+{
+	*((void **) block) = *list;
+	*list = block;
+}
+
+static void *
+buffer_block_pop(void **list)
+{
+	void *block;
+
+	if ((block = *list))
+		*list = *((void **) block);
+
+	return block;
+}
+
+/* Return a block to the depot, or free it if the depot is full.
+ */
+static void
+buffer_depot_put(void *block, int class)
+{
+	size_t size = buffer_pool_class_size(class);
+
+	g_mutex_lock(&buffer_depot_lock);
+
+	if (!buffer_depot_closed &&
+		buffer_depot_mem + size <= buffer_depot_max_mem) {
+		buffer_block_push(&buffer_depot[class], block);
+		buffer_depot_mem += size;
+		block = NULL;
+	}
+	else
+		buffer_pool_discards += 1;
+
+	g_mutex_unlock(&buffer_depot_lock);
+
+	if (block)
+		vips_tracked_aligned_free(block);
+}
+
+static void
+buffer_magazine_flush(BufferMagazine *magazine)
+{
+	int class;
+	void *block;
+
+	for (class = 0; class < BUFFER_POOL_N_CLASSES; class++)
+		while ((block = buffer_block_pop(&magazine->blocks[class])))
+			buffer_depot_put(block, class);
+
+	g_mutex_lock(&buffer_depot_lock);
+	buffer_pool_hits += magazine->hits;
+	buffer_pool_reused += magazine->reused;
+	g_mutex_unlock(&buffer_depot_lock);
+
+	memset(magazine, 0, sizeof(BufferMagazine));
+}
+
+static void
+buffer_magazine_free(BufferMagazine *magazine)
+{
+	buffer_magazine_flush(magazine);
+	g_free(magazine);
+}
+
+static void
+buffer_magazine_destroy_notify(gpointer data)
+{
+	buffer_magazine_free((BufferMagazine *) data);
+}
+
+/* Get the magazine for this thread, making one for workers if necessary.
+ */
+static BufferMagazine *
+buffer_magazine_get(void)
+{
+	BufferMagazine *magazine;
+
+	if (!(magazine = g_private_get(&buffer_magazine_key)) &&
+		vips_thread_isvips()) {
+		magazine = g_new0(BufferMagazine, 1);
+		g_private_set(&buffer_magazine_key, magazine);
+	}
+
+	return magazine;
+}
+
+/* Allocate at least @size bytes of pixel memory. The size we actually
+ * allocated goes to @bsize, and must be passed back to buffer_block_free().
+ */
+static void *
+buffer_block_alloc(size_t size, size_t align, size_t *bsize)
+{
+	int class;
+	BufferMagazine *magazine;
+	void *block;
+
+	if ((class = buffer_pool_class(size)) < 0) {
+		*bsize = size;
+		return vips_tracked_aligned_alloc(size, align);
+	}
+
+	*bsize = buffer_pool_class_size(class);
+
+	if ((magazine = buffer_magazine_get()) &&
+		(block = buffer_block_pop(&magazine->blocks[class]))) {
+		magazine->n_blocks[class] -= 1;
+		magazine->mem -= *bsize;
+		magazine->hits += 1;
+		magazine->reused += *bsize;
+
+		return block;
+	}
+
+	g_mutex_lock(&buffer_depot_lock);
+	if ((block = buffer_block_pop(&buffer_depot[class]))) {
+		buffer_depot_mem -= *bsize;
+		buffer_pool_hits += 1;
+		buffer_pool_reused += *bsize;
+	}
+	else
+		buffer_pool_misses += 1;
+	g_mutex_unlock(&buffer_depot_lock);
+
+	if (block)
+		return block;
+
+	/* Pooled blocks can be reused for any format, so they are always
+	 * aligned for the highway paths. If huge pages are enabled, large
+	 * blocks are aligned for them, and vips_tracked_aligned_alloc() will
+	 * advise the kernel.
+	 */
+	align = 64;
+#ifdef MADV_HUGEPAGE
+	if (vips__hugepages &&
+		*bsize >= BUFFER_HUGEPAGE_SIZE) {
+		align = BUFFER_HUGEPAGE_SIZE;
+
+		g_mutex_lock(&buffer_depot_lock);
+		buffer_pool_hugepages += *bsize / BUFFER_HUGEPAGE_SIZE;
+		g_mutex_unlock(&buffer_depot_lock);
+	}
+#endif /*MADV_HUGEPAGE*/
+
+	return vips_tracked_aligned_alloc(*bsize, align);
+}
+
+static void
+buffer_block_free(void *block, size_t bsize)
+{
+	int class;
+	BufferMagazine *magazine;
+
+	if ((class = buffer_pool_class(bsize)) < 0 ||
+		buffer_pool_class_size(class) != bsize) {
+		vips_tracked_aligned_free(block);
+		return;
+	}
+
+	/* Don't make a magazine here, we can be called during thread exit.
+	 */
+	if ((magazine = g_private_get(&buffer_magazine_key)) &&
+		magazine->n_blocks[class] < buffer_magazine_max_blocks &&
+		magazine->mem + bsize <= buffer_magazine_max_mem) {
+		buffer_block_push(&magazine->blocks[class], block);
+		magazine->n_blocks[class] += 1;
+		magazine->mem += bsize;
+	}
+	else
+		buffer_depot_put(block, class);
+}
+
+/* Append a summary of pool activity to @buf, if there's been any.
+ */
+void
+vips__buffer_pool_stats(VipsBuf *buf)
+{
+	guint64 total;
+
+	g_mutex_lock(&buffer_depot_lock);
+
+	total = buffer_pool_hits + buffer_pool_misses;
+	if (total > 0) {
+		vips_buf_appendf(buf, "buffer pool: %" G_GUINT64_FORMAT " of %"
+			G_GUINT64_FORMAT " allocations reused (%.3g%%), ",
+			buffer_pool_hits, total, 100.0 * buffer_pool_hits / total);
+		vips_buf_append_size(buf, buffer_pool_reused);
+		vips_buf_appendf(buf, " recycled, about %" G_GUINT64_FORMAT
+			" page faults avoided, ", buffer_pool_reused / 4096);
+		vips_buf_appendf(buf, "%" G_GUINT64_FORMAT " discards, %"
+			G_GUINT64_FORMAT " huge pages requested\n",
+			buffer_pool_discards, buffer_pool_hugepages);
+	}
+
+	g_mutex_unlock(&buffer_depot_lock);
+}
+
 static void
 vips_buffer_free(VipsBuffer *buffer)
 {
-	VIPS_FREEF(vips_tracked_aligned_free, buffer->buf);
+	if (buffer->buf) {
+		buffer_block_free(buffer->buf, buffer->bsize);
+		buffer->buf = NULL;
+	}
 	buffer->bsize = 0;
 	g_free(buffer);
 
@@ -495,10 +795,16 @@ buffer_move(VipsBuffer *buffer, VipsRect *area)
 
 	if (buffer->bsize < new_bsize ||
 		!buffer->buf) {
-		buffer->bsize = new_bsize;
-		VIPS_FREEF(vips_tracked_aligned_free, buffer->buf);
-		if (!(buffer->buf = vips_tracked_aligned_alloc(buffer->bsize, align)))
+		if (buffer->buf) {
+			buffer_block_free(buffer->buf, buffer->bsize);
+			buffer->buf = NULL;
+			buffer->bsize = 0;
+		}
+		if (!(buffer->buf =
+					buffer_block_alloc(new_bsize, align, &buffer->bsize)))
 			return -1;
+
+		VIPS_PROFILE_BUFFER(im, buffer->bsize);
 	}
 
 	return 0;
@@ -690,9 +996,38 @@ void
 vips__buffer_shutdown(void)
 {
 	VipsBufferThread *buffer_thread;
+	BufferMagazine *magazine;
 
 	if ((buffer_thread = g_private_get(&buffer_thread_key))) {
 		buffer_thread_free(buffer_thread);
 		g_private_set(&buffer_thread_key, NULL);
 	}
+
+	/* After the buffer thread, since freeing that can refill the
+	 * magazine.
+	 */
+	if ((magazine = g_private_get(&buffer_magazine_key))) {
+		buffer_magazine_free(magazine);
+		g_private_set(&buffer_magazine_key, NULL);
+	}
+}
+
+/* Free everything in the depot. Blocks returned after this are freed
+ * immediately. Called from vips_shutdown().
+ */
+void
+vips__buffer_pool_shutdown(void)
+{
+	int class;
+	void *block;
+
+	g_mutex_lock(&buffer_depot_lock);
+
+	buffer_depot_closed = TRUE;
+	for (class = 0; class < BUFFER_POOL_N_CLASSES; class++)
+		while ((block = buffer_block_pop(&buffer_depot[class])))
+			vips_tracked_aligned_free(block);
+	buffer_depot_mem = 0;
+
+	g_mutex_unlock(&buffer_depot_lock);
 }
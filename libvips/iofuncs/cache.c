@@ -130,8 +130,8 @@ typedef struct _VipsOperationCacheEntry {
  * held in a GParamSpec allowing OBJECT, but the value could be of type
  * VipsImage. generics are much faster to compare.
  */
-static unsigned int
-vips_value_hash(GParamSpec *pspec, const GValue *value)
+unsigned int
+vips__value_hash(GParamSpec *pspec, const GValue *value)
 {
 	GType generic = G_PARAM_SPEC_TYPE(pspec);
 
@@ -245,7 +245,7 @@ vips_value_hash(GParamSpec *pspec, const GValue *value)
 		s = g_strdup_value_contents(value);
 		hash = g_str_hash(s);
 
-		printf("vips_value_hash: no case for %s\n", s);
+		printf("vips__value_hash: no case for %s\n", s);
 		printf("\ttype %d, %s\n",
 			(int) G_VALUE_TYPE(value),
 			g_type_name(G_VALUE_TYPE(value)));
@@ -434,7 +434,7 @@ vips_object_hash_arg(VipsObject *object,
 
 		g_value_init(&value, type);
 		g_object_get_property(G_OBJECT(object), name, &value);
-		*hash = (*hash << 1) ^ vips_value_hash(pspec, &value);
+		*hash = (*hash << 1) ^ vips__value_hash(pspec, &value);
 		g_value_unset(&value);
 	}
 
@@ -938,11 +938,11 @@ vips_cache_find_differences(VipsObject *object,
 
 		GValue value_before = G_VALUE_INIT;
 		g_object_get_property(G_OBJECT(operation_before), name, &value_before);
-		unsigned int hash_before = vips_value_hash(pspec, &value_before);
+		unsigned int hash_before = vips__value_hash(pspec, &value_before);
 
 		GValue value_after = G_VALUE_INIT;
 		g_object_get_property(G_OBJECT(object), name, &value_after);
-		unsigned int hash_after = vips_value_hash(pspec, &value_after);
+		unsigned int hash_after = vips__value_hash(pspec, &value_after);
 
 		if (hash_before != hash_after) {
 			g_warning("arg \"%s\" has changed value during build", name);
@@ -1,6 +1,8 @@
 /* gate.c -- thread profiling
  *
  * Written on: 18 nov 13
+ * 18/10/26
+ * 	- add per-image operation profiles, see vips_operation_profile_set()
  */
 
 /*
@@ -43,6 +45,12 @@
 #endif /*HAVE_CONFIG_H*/
 #include <glib/gi18n-lib.h>
 
+#include <time.h>
+
+#ifdef G_OS_WIN32
+#include <windows.h>
+#endif /*G_OS_WIN32*/
+
 #include <vips/vips.h>
 #include <vips/internal.h>
 #include <vips/debug.h>
@@ -361,3 +369,338 @@ vips__thread_malloc_free(gint64 size)
 		gate->stop->time[gate->stop->i++] = size;
 	}
 }
+
+/* What we hang off each image with vips__operation_profile.
+ */
+typedef struct _VipsProfileImage {
+	GMutex lock;
+	VipsProfileRecord record;
+} VipsProfileImage;
+
+/* Time spent in generate by upstream images, for this thread.
+ */
+typedef struct _VipsProfileThread {
+	gint64 child_wall;
+	gint64 child_cpu;
+} VipsProfileThread;
+
+gboolean vips__operation_profile = FALSE;
+GQuark vips__profile_quark = 0;
+
+static GPrivate vips_profile_thread_key = G_PRIVATE_INIT(g_free);
+
+/**
+ * vips_operation_profile_set:
+ * @profile: `TRUE` to enable operation profiles
+ *
+ * If set, vips will record, for each image it computes, the time spent in
+ * generate, the pixels made, the tiles requested, the requests satisfied
+ * from the buffer cache, and the bytes of pixel buffer it takes.
+ *
+ * Images are tagged with the nickname of the operation that made them,
+ * and the records stay with the image, so you can fetch a report for a
+ * pipeline after evaluation with [method@Image.get_profile].
+ *
+ * This is much cheaper than [func@profile_set], but it still adds a
+ * couple of clock reads and a lock to every tile, so it's off by default.
+ * You can also enable it with the `VIPS_PROFILE_OPERATIONS` environment
+ * variable, or with the `--vips-profile-operations` command-line flag.
+ *
+ * ::: seealso
+ *     [method@Image.get_profile], [method@Image.get_profile_json].
+ */
+void
+vips_operation_profile_set(gboolean profile)
+{
+	vips__operation_profile = profile;
+}
+
+static void
+vips_profile_image_free(VipsProfileImage *profile)
+{
+	g_mutex_clear(&profile->lock);
+	g_free(profile);
+}
+
+static VipsProfileImage *
+vips_profile_image_get(VipsImage *image)
+{
+	return g_object_get_qdata(G_OBJECT(image), vips__profile_quark);
+}
+
+/* Start recording for an image. Called from vips_image_generate().
+ */
+void
+vips__profile_attach(VipsImage *image)
+{
+	g_mutex_lock(&vips__global_lock);
+
+	if (!vips_profile_image_get(image)) {
+		VipsProfileImage *profile = g_new0(VipsProfileImage, 1);
+
+		g_mutex_init(&profile->lock);
+		g_object_set_qdata_full(G_OBJECT(image), vips__profile_quark,
+			profile, (GDestroyNotify) vips_profile_image_free);
+	}
+
+	g_mutex_unlock(&vips__global_lock);
+}
+
+/* Operations tag their output images when they build. Operations which are
+ * built from other operations build those first, so the innermost
+ * operation keeps the image.
+ */
+void
+vips__profile_label(VipsImage *image, const char *nickname)
+{
+	VipsProfileImage *profile;
+
+	if ((profile = vips_profile_image_get(image))) {
+		g_mutex_lock(&profile->lock);
+		if (!profile->record.nickname)
+			profile->record.nickname = nickname;
+		g_mutex_unlock(&profile->lock);
+	}
+}
+
+/* CPU time for the calling thread, in microseconds, or 0 if we can't get it.
+ */
+static gint64
+vips_profile_cpu_time(void)
+{
+#ifdef G_OS_WIN32
+	FILETIME creation, exit_time, kernel, user;
+	ULARGE_INTEGER k, u;
+
+	if (!GetThreadTimes(GetCurrentThread(),
+			&creation, &exit_time, &kernel, &user))
+		return 0;
+
+	k.LowPart = kernel.dwLowDateTime;
+	k.HighPart = kernel.dwHighDateTime;
+	u.LowPart = user.dwLowDateTime;
+	u.HighPart = user.dwHighDateTime;
+
+	/* In units of 100ns.
+	 */
+	return (k.QuadPart + u.QuadPart) / 10;
+#elif defined(CLOCK_THREAD_CPUTIME_ID)
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts))
+		return 0;
+
+	return (gint64) ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+#else
+	return 0;
+#endif
+}
+
+static VipsProfileThread *
+vips_profile_thread_get(void)
+{
+	VipsProfileThread *thread;
+
+	if (!(thread = g_private_get(&vips_profile_thread_key))) {
+		thread = g_new0(VipsProfileThread, 1);
+		g_private_set(&vips_profile_thread_key, thread);
+	}
+
+	return thread;
+}
+
+/* Generate calls nest, since a generate function will prepare regions on its
+ * inputs. We save the time our caller has seen from its inputs so far, and
+ * count time from our inputs from zero, so we can find self time on stop.
+ */
+void
+vips__profile_generate_start(VipsProfileTimer *timer)
+{
+	VipsProfileThread *thread = vips_profile_thread_get();
+
+	timer->child_wall = thread->child_wall;
+	timer->child_cpu = thread->child_cpu;
+	thread->child_wall = 0;
+	thread->child_cpu = 0;
+
+	timer->wall = g_get_monotonic_time();
+	timer->cpu = vips_profile_cpu_time();
+}
+
+void
+vips__profile_generate_stop(VipsProfileTimer *timer, VipsRegion *region)
+{
+	gint64 wall = g_get_monotonic_time() - timer->wall;
+	gint64 cpu = vips_profile_cpu_time() - timer->cpu;
+	VipsProfileThread *thread = vips_profile_thread_get();
+	gint64 self_wall = wall - thread->child_wall;
+	gint64 self_cpu = cpu - thread->child_cpu;
+
+	VipsProfileImage *profile;
+
+	thread->child_wall = timer->child_wall + wall;
+	thread->child_cpu = timer->child_cpu + cpu;
+
+	if ((profile = vips_profile_image_get(region->im))) {
+		g_mutex_lock(&profile->lock);
+		profile->record.calls += 1;
+		profile->record.wall += wall;
+		profile->record.self_wall += VIPS_MAX(0, self_wall);
+		profile->record.self_cpu += VIPS_MAX(0, self_cpu);
+		profile->record.pixels +=
+			(gint64) region->valid.width * region->valid.height;
+		g_mutex_unlock(&profile->lock);
+	}
+}
+
+/* A request for pixels. hit means we found the pixels in the buffer cache
+ * and there's no need to call generate.
+ */
+void
+vips__profile_tile(VipsImage *image, gboolean hit)
+{
+	VipsProfileImage *profile;
+
+	if ((profile = vips_profile_image_get(image))) {
+		g_mutex_lock(&profile->lock);
+		profile->record.tiles += 1;
+		if (hit)
+			profile->record.cache_hits += 1;
+		g_mutex_unlock(&profile->lock);
+	}
+}
+
+/* Memory we took for a pixel buffer.
+ */
+void
+vips__profile_buffer(VipsImage *image, size_t bytes)
+{
+	VipsProfileImage *profile;
+
+	if ((profile = vips_profile_image_get(image))) {
+		g_mutex_lock(&profile->lock);
+		profile->record.buffer_bytes += bytes;
+		g_mutex_unlock(&profile->lock);
+	}
+}
+
+static void *
+vips_image_get_profile_cb(VipsImage *image, GArray *records, void *b)
+{
+	VipsProfileImage *profile;
+
+	if ((profile = vips_profile_image_get(image))) {
+		VipsProfileRecord record;
+
+		g_mutex_lock(&profile->lock);
+		record = profile->record;
+		g_mutex_unlock(&profile->lock);
+
+		record.image = image;
+		g_array_append_val(records, record);
+	}
+
+	return NULL;
+}
+
+/**
+ * vips_image_get_profile: (skip)
+ * @image: image to report on
+ * @n: (out): return the number of records here
+ *
+ * Fetch the profile records for @image and every image upstream of it, that
+ * is, the whole pipeline that computes @image. Inputs come before the
+ * images made from them.
+ *
+ * Records are only made when [func@operation_profile_set] is enabled, and
+ * counts accumulate for as long as an image exists, so an image which is
+ * reused from the operation cache will show all of its evaluations.
+ *
+ * The image pointers in the records are not referenced and are only valid
+ * for as long as @image is.
+ *
+ * Chains of unary arithmetic operations are run a line at a time from the
+ * operation they feed, and their own generate functions are never called.
+ * These images show no calls or time, and their cost is included in the
+ * record for the image at the end of the chain.
+ *
+ * ::: seealso
+ *     [func@operation_profile_set], [method@Image.get_profile_json].
+ *
+ * Returns: an array of records, free with [func@GLib.free]
+ */
+VipsProfileRecord *
+vips_image_get_profile(VipsImage *image, int *n)
+{
+	GArray *records = g_array_new(FALSE, FALSE, sizeof(VipsProfileRecord));
+
+	/* link_map walks the pipeline depth-first from image and prepends, so
+	 * sources tend to come first.
+	 */
+	vips__link_map(image, TRUE,
+		(VipsSListMap2Fn) vips_image_get_profile_cb, records, NULL);
+
+	*n = records->len;
+
+	return (VipsProfileRecord *) g_array_free(records, FALSE);
+}
+
+/**
+ * vips_image_get_profile_json:
+ * @image: image to report on
+ *
+ * As [method@Image.get_profile], but format the report as JSON, with one
+ * object per image. Times are in milliseconds. `time` includes time spent
+ * computing inputs, `self` and `cpu` do not.
+ *
+ * ::: seealso
+ *     [func@operation_profile_set], [method@Image.get_profile].
+ *
+ * Returns: (transfer full): the report, free with [func@GLib.free]
+ */
+char *
+vips_image_get_profile_json(VipsImage *image)
+{
+	VipsProfileRecord *records;
+	GString *json;
+	int n;
+	int i;
+
+	records = vips_image_get_profile(image, &n);
+
+	json = g_string_new("{\n  \"operations\": [");
+	for (i = 0; i < n; i++) {
+		VipsProfileRecord *record = &records[i];
+
+		g_string_append_printf(json,
+			"%s\n    {\"nickname\": \"%s\", "
+			"\"width\": %d, \"height\": %d, \"bands\": %d, "
+			"\"format\": \"%s\", "
+			"\"calls\": %" G_GINT64_FORMAT ", "
+			"\"time\": %.3f, \"self\": %.3f, \"cpu\": %.3f, "
+			"\"pixels\": %" G_GINT64_FORMAT ", "
+			"\"tiles\": %" G_GINT64_FORMAT ", "
+			"\"cache_hits\": %" G_GINT64_FORMAT ", "
+			"\"buffer_bytes\": %" G_GINT64_FORMAT "}",
+			i > 0 ? "," : "",
+			record->nickname ? record->nickname : "image",
+			record->image->Xsize,
+			record->image->Ysize,
+			record->image->Bands,
+			vips_enum_nick(VIPS_TYPE_BAND_FORMAT,
+				record->image->BandFmt),
+			record->calls,
+			record->wall / 1000.0,
+			record->self_wall / 1000.0,
+			record->self_cpu / 1000.0,
+			record->pixels,
+			record->tiles,
+			record->cache_hits,
+			record->buffer_bytes);
+	}
+	g_string_append(json, "\n  ]\n}\n");
+
+	g_free(records);
+
+	return g_string_free(json, FALSE);
+}
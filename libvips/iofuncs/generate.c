@@ -53,6 +53,8 @@
  * 7/7/12
  * 	- lock around link make/break so we can process an image from many
  * 	  threads
+ * 18/10/26
+ * 	- attach operation profiles in vips_image_generate()
  */
 
 /*
@@ -699,6 +701,9 @@ vips_image_generate(VipsImage *image,
 	 */
 	image->Bbits = vips_format_sizeof(image->BandFmt) << 3;
 
+	if (vips__operation_profile)
+		vips__profile_attach(image);
+
 	/* Look at output type to decide our action.
 	 */
 	switch (image->dtype) {
@@ -38,6 +38,9 @@
  * 	- add vips_image_get/set_array_int()
  * 31/1/19
  * 	- lock for metadata changes
+ * 18/10/26
+ * 	- metadata items are immutable and refcounted, so copying metadata
+ * 	  down a pipeline shares them rather than duplicating every value
  */
 
 /*
@@ -256,8 +259,8 @@ meta_sanity_on_hash(VipsMeta *meta, VipsImage *im, void *b)
 {
 	VipsMeta *found;
 
-	if (meta->im != im)
-		printf("*** field \"%s\" has incorrect im\n",
+	if (meta->ref_count <= 0)
+		printf("*** field \"%s\" has bad ref_count\n",
 			meta->name);
 
 	if (!(found = g_hash_table_lookup(im->meta, meta->name)))
@@ -278,10 +281,6 @@ meta_sanity_on_traverse(const char *name, VipsMeta *meta, VipsImage *im)
 		printf("*** field \"%s\" has incorrect name\n",
 			meta->name);
 
-	if (meta->im != im)
-		printf("*** field \"%s\" has incorrect im\n",
-			meta->name);
-
 	if (!g_slist_find(im->meta_traverse, meta))
 		printf("*** field \"%s\" is in hash but not on traverse\n",
 			meta->name);
@@ -298,36 +297,63 @@ meta_sanity(const VipsImage *im)
 }
 #endif /*DEBUG*/
 
+static VipsMeta *
+meta_ref(VipsMeta *meta)
+{
+	g_atomic_int_inc(&meta->ref_count);
+
+	return meta;
+}
+
+/* The GDestroyNotify for the meta hash. The item is removed from the traverse
+ * list by whoever removes it from the hash.
+ */
 static void
-meta_free(VipsMeta *meta)
+meta_unref(VipsMeta *meta)
 {
+	if (!g_atomic_int_dec_and_test(&meta->ref_count))
+		return;
+
 #ifdef DEBUG
 	{
 		char *str_value;
 
 		str_value = g_strdup_value_contents(&meta->value);
-		printf("meta_free: name %s, value = %s\n",
+		printf("meta_unref: freeing name %s, value = %s\n",
 			meta->name, str_value);
 		g_free(str_value);
 	}
 #endif /*DEBUG*/
 
-	if (meta->im)
-		meta->im->meta_traverse =
-			g_slist_remove(meta->im->meta_traverse, meta);
-
 	g_value_unset(&meta->value);
 	g_free(meta->name);
 	g_free(meta);
 }
 
+/* Attach a meta to an image, replacing any old item with that name.
+ */
+static void
+meta_attach(VipsImage *image, VipsMeta *meta)
+{
+	VipsMeta *old;
+
+	if ((old = g_hash_table_lookup(image->meta, meta->name)))
+		image->meta_traverse = g_slist_remove(image->meta_traverse, old);
+
+	image->meta_traverse = g_slist_append(image->meta_traverse, meta);
+	g_hash_table_replace(image->meta, meta->name, meta);
+}
+
+/* Items are never changed once made, so they can be shared between all
+ * the images in a pipeline. Setting a field always makes a new item.
+ */
 static VipsMeta *
 meta_new(VipsImage *image, const char *name, GValue *value)
 {
 	VipsMeta *meta;
 
 	meta = g_new(VipsMeta, 1);
-	meta->im = image;
+	meta->ref_count = 1;
 	meta->name = NULL;
 	memset(&meta->value, 0, sizeof(GValue));
 	meta->name = g_strdup(name);
@@ -348,8 +374,7 @@ meta_new(VipsImage *image, const char *name, GValue *value)
 	 */
 	(void) g_value_transform(value, &meta->value);
 
-	image->meta_traverse = g_slist_append(image->meta_traverse, meta);
-	g_hash_table_replace(image->meta, meta->name, meta);
+	meta_attach(image, meta);
 
 #ifdef DEBUG
 	{
@@ -370,7 +395,7 @@ void
 vips__meta_destroy(VipsImage *image)
 {
 	VIPS_FREEF(g_hash_table_destroy, image->meta);
-	g_assert(!image->meta_traverse);
+	VIPS_FREEF(g_slist_free, image->meta_traverse);
 }
 
 static void
@@ -379,7 +404,7 @@ meta_init(VipsImage *im)
 	if (!im->meta) {
 		g_assert(!im->meta_traverse);
 		im->meta = g_hash_table_new_full(g_str_hash, g_str_equal,
-			NULL, (GDestroyNotify) meta_free);
+			NULL, (GDestroyNotify) meta_unref);
 	}
 }
 
@@ -1160,42 +1185,48 @@ vips_image_init_fields(VipsImage *image, int xsize, int ysize, int bands,
 	image->Yres = VIPS_MAX(0, yres);
 }
 
-static void *
-meta_cp_field(VipsMeta *meta, VipsImage *dst, void *b)
-{
-#ifdef DEBUG
-	{
-		char *str_value;
-
-		str_value = g_strdup_value_contents(&meta->value);
-		printf("vips__meta_cp: copying name %s, value = %s\n",
-			meta->name, str_value);
-		g_free(str_value);
-	}
-#endif /*DEBUG*/
-
-	(void) meta_new(dst, meta->name, &meta->value);
-
-#ifdef DEBUG
-	meta_sanity(dst);
-#endif /*DEBUG*/
-
-	return NULL;
-}
-
-/* Copy meta on to dst.
+/* Copy meta on to dst. Items are shared, not copied.
  */
 int
 vips__image_meta_copy(VipsImage *dst, const VipsImage *src)
 {
 	if (src->meta) {
+		GSList *added;
+		GSList *p;
+
 		/* We lock with vips_image_set() to stop races in highly-
 		 * threaded applications.
 		 */
 		g_mutex_lock(&vips__meta_lock);
 		meta_init(dst);
-		vips_slist_map2(src->meta_traverse,
-			(VipsSListMap2Fn) meta_cp_field, dst, NULL);
+
+		/* Build the new part of the traverse list backwards, then join
+		 * it on in one go. Appending each item would be quadratic in
+		 * the number of fields.
+		 */
+		added = NULL;
+		for (p = src->meta_traverse; p; p = p->next) {
+			VipsMeta *meta = (VipsMeta *) p->data;
+			VipsMeta *old;
+
+			if ((old = g_hash_table_lookup(dst->meta, meta->name))) {
+				if (old == meta)
+					continue;
+
+				dst->meta_traverse =
+					g_slist_remove(dst->meta_traverse, old);
+			}
+
+			added = g_slist_prepend(added, meta);
+			g_hash_table_replace(dst->meta, meta->name, meta_ref(meta));
+		}
+		dst->meta_traverse = g_slist_concat(dst->meta_traverse,
+			g_slist_reverse(added));
+
+#ifdef DEBUG
+		meta_sanity(dst);
+#endif /*DEBUG*/
+
 		g_mutex_unlock(&vips__meta_lock);
 	}
 
@@ -1523,8 +1554,14 @@ vips_image_remove(VipsImage *image, const char *name)
 		 * racing with metadata copy on another -- this can lead to
 		 * crashes in highly-threaded applications.
 		 */
+		VipsMeta *meta;
+
 		g_mutex_lock(&vips__meta_lock);
-		result = g_hash_table_remove(image->meta, name);
+		if ((meta = g_hash_table_lookup(image->meta, name))) {
+			image->meta_traverse =
+				g_slist_remove(image->meta_traverse, meta);
+			result = g_hash_table_remove(image->meta, name);
+		}
 		g_mutex_unlock(&vips__meta_lock);
 	}
 
@@ -1542,7 +1579,8 @@ static const char *vips_image_header_deprecated[] = {
 };
 
 static void *
-vips_image_map_fn(VipsMeta *meta, VipsImageMapFn fn, void *a)
+vips_image_map_fn(VipsMeta *meta,
+	VipsImageMapFn fn, void *a, VipsImage *image, void *d)
 {
 	/* Hide deprecated fields.
 	 */
@@ -1550,7 +1588,7 @@ vips_image_map_fn(VipsMeta *meta, VipsImageMapFn fn, void *a)
 		if (strcmp(meta->name, vips_image_header_deprecated[i]) == 0)
 			return NULL;
 
-	return fn(meta->im, meta->name, &meta->value, a);
+	return fn(image, meta->name, &meta->value, a);
 }
 
 /**
@@ -1589,8 +1627,8 @@ vips_image_map(VipsImage *image, VipsImageMapFn fn, void *a)
 	}
 
 	if (image->meta_traverse &&
-		(result = vips_slist_map2(image->meta_traverse,
-			 (VipsSListMap2Fn) vips_image_map_fn, fn, a)))
+		(result = vips_slist_map4(image->meta_traverse,
+			 (VipsSListMap4Fn) vips_image_map_fn, fn, a, image, NULL)))
 		return result;
 
 	return NULL;
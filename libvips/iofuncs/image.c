@@ -376,6 +376,11 @@ int vips__progress = 0;
  */
 char *vips__disc_threshold = NULL;
 
+/* Set to spill large random-access loads to compressed tiled temp files
+ * rather than uncompressed .v files.
+ */
+gboolean vips__disc_compress = FALSE;
+
 /* Minimise needs a lock.
  */
 static GMutex vips__minimise_lock;
@@ -1892,6 +1897,12 @@ vips_filename_get_options(const char *vips_filename)
  * "m" or "g" to indicate kilobytes, megabytes or gigabytes.
  * The default threshold is 100 MB.
  *
+ * Set the `--vips-disc-compress` command-line argument or the
+ * `VIPS_DISC_COMPRESS` environment variable to spill large random access
+ * loads of sequential formats to compressed, tiled temporary files instead.
+ * These are read back through a tile cache no larger than the disc
+ * threshold.
+ *
  * For example:
  *
  * ```c
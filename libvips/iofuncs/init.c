@@ -34,6 +34,9 @@
  * 	- don't use atexit for cleanup, it's too unreliable ... users should
  * 	  call vips_shutdown explicitly if they want a clean exit, though a
  * 	  dirty exit is fine
+ * 18/10/26
+ * 	- add --vips-profile-operations and VIPS_PROFILE_OPERATIONS
+ * 	- add --vips-hugepages and VIPS_HUGEPAGES
  */
 
 /*
@@ -418,6 +421,8 @@ vips_leak(void)
 	vips_buf_append_size(&buf, vips_tracked_get_mem_highwater());
 	vips_buf_appends(&buf, "\n");
 
+	vips__buffer_pool_stats(&buf);
+
 	if (strlen(vips_error_buffer()) > 0) {
 		vips_buf_appendf(&buf, "error buffer: %s", vips_error_buffer());
 		n_leaks += strlen(vips_error_buffer());
@@ -502,6 +507,8 @@ vips_init(const char *argv0)
 		vips_verbose();
 	if (g_getenv("VIPS_PROFILE"))
 		vips_profile_set(TRUE);
+	if (g_getenv("VIPS_PROFILE_OPERATIONS"))
+		vips_operation_profile_set(TRUE);
 	if (g_getenv("VIPS_LEAK"))
 		vips_leak_set(TRUE);
 	if (g_getenv("VIPS_TRACE"))
@@ -510,6 +517,12 @@ vips_init(const char *argv0)
 	if (g_getenv("VIPS_UNLIMITED"))
 		vips_unlimited_set(TRUE);
 
+	if (g_getenv("VIPS_DISC_COMPRESS"))
+		vips__disc_compress = TRUE;
+
+	if (g_getenv("VIPS_HUGEPAGES"))
+		vips__hugepages = TRUE;
+
 	const char *pipe_read_limit;
 	if ((pipe_read_limit = g_getenv("VIPS_PIPE_READ_LIMIT")))
 		vips_pipe_read_limit_set(vips__parse_size(pipe_read_limit));
@@ -652,6 +665,8 @@ vips_init(const char *argv0)
 	 */
 	vips__vector_init();
 
+	vips__profile_quark = g_quark_from_static_string("vips-profile");
+
 #ifdef DEBUG_LEAK
 	vips__image_pixels_quark =
 		g_quark_from_static_string("vips-image-pixels");
@@ -764,6 +779,7 @@ vips_shutdown(void)
 	vips_thread_shutdown();
 	vips__thread_profile_stop();
 	vips__threadpool_shutdown();
+	vips__buffer_pool_shutdown();
 
 	VIPS_FREE(vips__argv0);
 	VIPS_FREE(vips__prgname);
@@ -912,9 +928,18 @@ static GOptionEntry option_entries[] = {
 	{ "vips-profile", 0, 0,
 		G_OPTION_ARG_NONE, &vips__thread_profile,
 		N_("profile and dump timing on exit"), NULL },
+	{ "vips-profile-operations", 0, 0,
+		G_OPTION_ARG_NONE, &vips__operation_profile,
+		N_("record time and pixel counts for each operation"), NULL },
 	{ "vips-disc-threshold", 0, 0,
 		G_OPTION_ARG_STRING, &vips__disc_threshold,
 		N_("images larger than N are decompressed to disc"), "N" },
+	{ "vips-disc-compress", 0, 0,
+		G_OPTION_ARG_NONE, &vips__disc_compress,
+		N_("compress images decompressed to disc"), NULL },
+	{ "vips-hugepages", 0, 0,
+		G_OPTION_ARG_NONE, &vips__hugepages,
+		N_("use transparent huge pages for large pixel buffers"), NULL },
 	{ "vips-novector", 0, G_OPTION_FLAG_REVERSE,
 		G_OPTION_ARG_NONE, &vips__vector_enabled,
 		N_("disable vectorised versions of operations"), NULL },
@@ -22,6 +22,9 @@
  * 21/9/11
  * 	- rename as vips_tracked_malloc() to emphasise difference from
  * 	  g_malloc()/g_free()
+ * 18/10/26
+ * 	- ask for transparent huge pages for huge-page aligned allocations,
+ * 	  if enabled with `--vips-hugepages` or `VIPS_HUGEPAGES`
  */
 
 /*
@@ -72,6 +75,9 @@
 #if defined(HAVE__ALIGNED_MALLOC) || defined(HAVE_MEMALIGN)
 #include <malloc.h>
 #endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif /*HAVE_SYS_MMAN_H*/
 
 #include <vips/vips.h>
 
@@ -94,6 +100,11 @@ static int vips_tracked_files = 0;
 static size_t vips_tracked_mem_highwater = 0;
 static GMutex vips_tracked_mutex;
 
+/* Ask for transparent huge pages for large aligned blocks. Off by default,
+ * set with `--vips-hugepages` or `VIPS_HUGEPAGES`.
+ */
+gboolean vips__hugepages = FALSE;
+
 /**
  * VIPS_NEW:
  * @OBJ: allocate memory local to @OBJ, or `NULL` for no auto-free
@@ -399,6 +410,15 @@ vips_tracked_aligned_alloc(size_t size, size_t align)
 		return NULL;
 	}
 
+#ifdef MADV_HUGEPAGE
+	/* Large blocks aligned to a huge page can be backed by them, if we ask
+	 * before the first touch.
+	 */
+	if (vips__hugepages &&
+		align >= 2 * 1024 * 1024)
+		(void) madvise(buf, size, MADV_HUGEPAGE);
+#endif /*MADV_HUGEPAGE*/
+
 	memset(buf, 0, size);
 
 	g_mutex_lock(&vips_tracked_mutex);
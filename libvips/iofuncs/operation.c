@@ -2,6 +2,9 @@
  *
  * 30/12/14
  * 	- display default/min/max for pspec in usage
+ * 18/10/26
+ * 	- add vips_prepared_call_new() and friends
+ * 	- tag output images for operation profiles
  */
 
 /*
@@ -607,6 +610,46 @@ vips_operation_build(VipsObject *object)
 	return 0;
 }
 
+static void *
+vips_operation_profile_label(VipsObject *object,
+	GParamSpec *pspec,
+	VipsArgumentClass *argument_class,
+	VipsArgumentInstance *argument_instance,
+	void *a, void *b)
+{
+	if ((argument_class->flags & VIPS_ARGUMENT_OUTPUT) &&
+		argument_instance->assigned &&
+		G_IS_PARAM_SPEC_OBJECT(pspec) &&
+		g_type_is_a(G_PARAM_SPEC_VALUE_TYPE(pspec), VIPS_TYPE_IMAGE)) {
+		VipsImage *image;
+
+		g_object_get(object, g_param_spec_get_name(pspec), &image, NULL);
+		if (image) {
+			vips__profile_label(image,
+				VIPS_OBJECT_GET_CLASS(object)->nickname);
+			g_object_unref(image);
+		}
+	}
+
+	return NULL;
+}
+
+static int
+vips_operation_postbuild(VipsObject *object, void *data)
+{
+	if (VIPS_OBJECT_CLASS(vips_operation_parent_class)
+			->postbuild(object, data))
+		return -1;
+
+	/* Output images are all set now, tag them with our name.
+	 */
+	if (vips__operation_profile)
+		vips_argument_map(object,
+			vips_operation_profile_label, NULL, NULL);
+
+	return 0;
+}
+
 static void
 vips_operation_summary_class(VipsObjectClass *object_class, VipsBuf *buf)
 {
@@ -654,6 +697,7 @@ vips_operation_class_init(VipsOperationClass *class)
 	gobject_class->dispose = vips_operation_dispose;
 
 	vobject_class->build = vips_operation_build;
+	vobject_class->postbuild = vips_operation_postbuild;
 	vobject_class->summary_class = vips_operation_summary_class;
 	vobject_class->summary = vips_operation_summary;
 	vobject_class->dump = vips_operation_dump;
@@ -1140,6 +1184,316 @@ vips_call_split_option_string(const char *operation_name,
 	return result;
 }
 
+/* One argument of a prepared call.
+ */
+typedef struct _VipsPreparedArgument {
+	GParamSpec *pspec;
+	VipsArgumentFlags flags;
+} VipsPreparedArgument;
+
+struct _VipsPreparedCall {
+	GType type;
+
+	/* We hold a ref to the class so the pspecs stay valid.
+	 */
+	VipsObjectClass *class;
+
+	int n;
+	VipsPreparedArgument *argument;
+
+	/* The hashable inputs, as indexes into argument, in the order
+	 * vips_operation_hash() walks them.
+	 */
+	int n_hash;
+	int *hash;
+};
+
+/**
+ * vips_prepared_call_new:
+ * @operation_name: name of operation to prepare
+ * @first_name: name of the first argument
+ * @...: `NULL`-terminated list of argument names
+ *
+ * Look up an operation and a set of its arguments once, ready to call it
+ * many times with [func@prepared_call_run].
+ *
+ * [func@call] finds the operation type and looks up every argument by name
+ * on every call. For small operations run very often, for example on small
+ * tiles in a server, this can be a large part of the cost. A prepared call
+ * does all the lookups here, and each run just sets values into the argument
+ * slots it already knows.
+ *
+ * List every argument you will pass or want back, both required and
+ * optional, in the order you will give their values. For example:
+ *
+ * ```c
+ * VipsPreparedCall *call;
+ * GValue values[3] = { G_VALUE_INIT, G_VALUE_INIT, G_VALUE_INIT };
+ * VipsImage *out;
+ *
+ * if (!(call = vips_prepared_call_new("invert", "in", "out", NULL)))
+ *     ... error
+ *
+ * vips_prepared_call_init_values(call, values);
+ * g_value_set_object(&values[0], in);
+ * if (vips_prepared_call_run(call, values))
+ *     ... error
+ * out = g_value_dup_object(&values[1]);
+ * g_value_unset(&values[0]);
+ * g_value_unset(&values[1]);
+ * ```
+ *
+ * Free with [func@prepared_call_free].
+ *
+ * ::: seealso
+ *     [func@call], [func@prepared_call_run].
+ *
+ * Returns: (transfer full): a new prepared call, or `NULL` on error.
+ */
+VipsPreparedCall *
+vips_prepared_call_new(const char *operation_name,
+	const char *first_name, ...)
+{
+	VipsPreparedCall *call;
+	GType type;
+	va_list ap;
+	const char *name;
+	GSList *p;
+	int i;
+
+	vips_check_init();
+
+	if (!(type = vips_type_find("VipsOperation", operation_name)) ||
+		G_TYPE_IS_ABSTRACT(type)) {
+		vips_error("VipsOperation",
+			_("class \"%s\" not found"), operation_name);
+		return NULL;
+	}
+
+	call = g_new0(VipsPreparedCall, 1);
+	call->type = type;
+	call->class = VIPS_OBJECT_CLASS(g_type_class_ref(type));
+
+	va_start(ap, first_name);
+	for (name = first_name; name; name = va_arg(ap, const char *))
+		call->n += 1;
+	va_end(ap);
+
+	call->argument = g_new0(VipsPreparedArgument, call->n);
+	call->hash = g_new0(int, call->n);
+
+	va_start(ap, first_name);
+	for (i = 0, name = first_name; name;
+		 i++, name = va_arg(ap, const char *)) {
+		GParamSpec *pspec;
+		VipsArgumentClass *argument_class;
+
+		if (!(pspec = g_object_class_find_property(
+				  G_OBJECT_CLASS(call->class), name)) ||
+			!(argument_class = (VipsArgumentClass *)
+					vips__argument_table_lookup(
+						call->class->argument_table, pspec))) {
+			vips_error(operation_name,
+				_("no argument \"%s\""), name);
+			va_end(ap);
+			vips_prepared_call_free(call);
+			return NULL;
+		}
+
+		call->argument[i].pspec = pspec;
+		call->argument[i].flags = argument_class->flags;
+	}
+	va_end(ap);
+
+	/* Note the hashable inputs in traverse order, so our hash matches the
+	 * one the cache would make.
+	 */
+	for (p = call->class->argument_table_traverse; p; p = p->next) {
+		VipsArgumentClass *argument_class =
+			(VipsArgumentClass *) p->data;
+		VipsArgumentFlags flags = argument_class->flags;
+
+		if (!(flags & VIPS_ARGUMENT_CONSTRUCT) ||
+			!(flags & VIPS_ARGUMENT_INPUT) ||
+			(flags & VIPS_ARGUMENT_NON_HASHABLE))
+			continue;
+
+		for (i = 0; i < call->n; i++)
+			if (call->argument[i].pspec ==
+				((VipsArgument *) argument_class)->pspec) {
+				call->hash[call->n_hash++] = i;
+				break;
+			}
+	}
+
+	return call;
+}
+
+/**
+ * vips_prepared_call_n_values:
+ * @call: prepared call to query
+ *
+ * Returns: the number of values [func@prepared_call_run] needs.
+ */
+int
+vips_prepared_call_n_values(VipsPreparedCall *call)
+{
+	return call->n;
+}
+
+/**
+ * vips_prepared_call_init_values:
+ * @call: prepared call to init values for
+ * @values: (array): array of zeroed values
+ *
+ * Initialise @values to the type of each argument in @call.
+ */
+void
+vips_prepared_call_init_values(VipsPreparedCall *call, GValue *values)
+{
+	int i;
+
+	for (i = 0; i < call->n; i++)
+		g_value_init(&values[i],
+			G_PARAM_SPEC_VALUE_TYPE(call->argument[i].pspec));
+}
+
+/* TRUE if @value is in range for @pspec. g_param_value_validate() fixes the
+ * value up as it goes, so check a copy and leave the caller's value alone.
+ */
+static gboolean
+vips_prepared_call_valid(GParamSpec *pspec, const GValue *value)
+{
+#if GLIB_CHECK_VERSION(2, 74, 0)
+	return g_param_value_is_valid(pspec, value);
+#else
+	GValue copy = G_VALUE_INIT;
+	gboolean valid;
+
+	g_value_init(&copy, G_VALUE_TYPE(value));
+	g_value_copy(value, &copy);
+	valid = !g_param_value_validate(pspec, &copy);
+	g_value_unset(&copy);
+
+	return valid;
+#endif
+}
+
+/**
+ * vips_prepared_call_run:
+ * @call: prepared call to run
+ * @values: (array): one value for each argument in @call
+ *
+ * Run a prepared call. Input arguments are set from @values, the operation
+ * is built (or found in the cache), and output arguments are written back
+ * to @values.
+ *
+ * Values for inputs must hold exactly the argument type, see
+ * [func@prepared_call_init_values], and be in range for the argument.
+ * Values for outputs are reset and
+ * hold a new reference on the output. The caller must unset all values
+ * when done.
+ *
+ * ::: seealso
+ *     [func@prepared_call_new].
+ *
+ * Returns: 0 on success, -1 on error
+ */
+int
+vips_prepared_call_run(VipsPreparedCall *call, GValue *values)
+{
+	VipsOperation *operation;
+	guint hash;
+	int i;
+
+	operation = VIPS_OPERATION(g_object_new(call->type, NULL));
+
+	/* Set inputs straight into their slots. We skip the name lookup and
+	 * value transform in g_object_set_property(), so types must match,
+	 * and we must check ranges ourselves.
+	 */
+	for (i = 0; i < call->n; i++) {
+		GParamSpec *pspec = call->argument[i].pspec;
+
+		if (!(call->argument[i].flags & VIPS_ARGUMENT_INPUT))
+			continue;
+
+		if (!G_VALUE_HOLDS(&values[i], G_PARAM_SPEC_VALUE_TYPE(pspec))) {
+			vips_error(VIPS_OBJECT_CLASS(call->class)->nickname,
+				_("bad type for argument \"%s\""),
+				g_param_spec_get_name(pspec));
+			vips_object_unref_outputs(VIPS_OBJECT(operation));
+			g_object_unref(operation);
+			return -1;
+		}
+
+		if (!vips_prepared_call_valid(pspec, &values[i])) {
+			vips_error(VIPS_OBJECT_CLASS(call->class)->nickname,
+				_("value out of range for argument \"%s\""),
+				g_param_spec_get_name(pspec));
+			vips_object_unref_outputs(VIPS_OBJECT(operation));
+			g_object_unref(operation);
+			return -1;
+		}
+
+		vips_object_set_property(G_OBJECT(operation),
+			pspec->param_id, &values[i], pspec);
+	}
+
+	/* The cache hash, straight from the values we were given.
+	 */
+	hash = (guint) call->type;
+	for (i = 0; i < call->n_hash; i++) {
+		int j = call->hash[i];
+
+		hash = (hash << 1) ^
+			vips__value_hash(call->argument[j].pspec, &values[j]);
+	}
+	operation->hash = hash | 1;
+	operation->found_hash = TRUE;
+
+	if (vips_cache_operation_buildp(&operation)) {
+		vips_object_unref_outputs(VIPS_OBJECT(operation));
+		g_object_unref(operation);
+		return -1;
+	}
+
+	for (i = 0; i < call->n; i++) {
+		GParamSpec *pspec = call->argument[i].pspec;
+
+		if (!(call->argument[i].flags & VIPS_ARGUMENT_OUTPUT))
+			continue;
+
+		if (G_IS_VALUE(&values[i]))
+			g_value_unset(&values[i]);
+		g_value_init(&values[i], G_PARAM_SPEC_VALUE_TYPE(pspec));
+		vips_object_get_property(G_OBJECT(operation),
+			pspec->param_id, &values[i], pspec);
+	}
+
+	/* As vips_call_by_name(), the outputs hold refs to anything they
+	 * need.
+	 */
+	g_object_unref(operation);
+
+	return 0;
+}
+
+/**
+ * vips_prepared_call_free:
+ * @call: (transfer full): prepared call to free
+ *
+ * Free a prepared call.
+ */
+void
+vips_prepared_call_free(VipsPreparedCall *call)
+{
+	VIPS_FREEF(g_type_class_unref, call->class);
+	VIPS_FREE(call->argument);
+	VIPS_FREE(call->hash);
+	g_free(call);
+}
+
 static void *
 vips_call_find_pspec(VipsObject *object,
 	GParamSpec *pspec,
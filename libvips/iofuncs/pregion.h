@@ -0,0 +1,55 @@
+/* private region declarations
+ *
+ * 18/10/26
+ * 	- add Highway 2x2 shrink
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+#ifndef VIPS_PREGION_H
+#define VIPS_PREGION_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif /*__cplusplus*/
+
+#include <vips/vips.h>
+
+/* 2x2 shrink of a line of @width output pixels, reading lines @p and @p1.
+ * Uchar, ushort and float images with 1 to 4 bands only.
+ */
+void vips_region_shrink_mean_hwy(VipsPel *q, VipsPel *p, VipsPel *p1,
+	int width, int bands, VipsBandFormat format);
+void vips_region_shrink_median_hwy(VipsPel *q, VipsPel *p, VipsPel *p1,
+	int width, int bands, VipsBandFormat format);
+
+#ifdef __cplusplus
+}
+#endif /*__cplusplus*/
+
+#endif /*VIPS_PREGION_H*/
@@ -51,6 +51,9 @@
  * 22/2/21 f1ac
  * 	- fix int overflow in vips_region_copy(), could cause crashes with
  * 	  very wide images
+ * 18/10/26
+ * 	- add Highway paths for mean and median shrink
+ * 	- count tiles, cache hits and generate time for operation profiles
  */
 
 /*
@@ -101,9 +104,12 @@
 #include <string.h>
 
 #include <vips/vips.h>
+#include <vips/vector.h>
 #include <vips/internal.h>
 #include <vips/debug.h>
 
+#include "pregion.h"
+
 /**
  * VipsRegion:
  *
@@ -860,6 +866,7 @@ vips_region_fill(VipsRegion *reg,
 	 */
 	if (vips_region_buffer(reg, r))
 		return -1;
+	VIPS_PROFILE_TILE(reg->im, reg->buffer->done);
 
 	/* Evaluate into out_region, if we've not got calculated pixels.
 	 */
@@ -1405,12 +1412,58 @@ VIPS_REGION_SHRINK(MODE);
 VIPS_REGION_SHRINK(MEDIAN);
 VIPS_REGION_SHRINK(NEAREST);
 
+#ifdef HAVE_HWY
+/* Mean and median for the formats pyramid builders usually see. TRUE if we
+ * did the shrink.
+ */
+static gboolean
+vips_region_shrink_uncoded_hwy(VipsRegion *from,
+	VipsRegion *to, const VipsRect *target, VipsRegionShrink method)
+{
+	int ls = VIPS_REGION_LSKIP(from);
+	int nb = from->im->Bands;
+	VipsBandFormat format = from->im->BandFmt;
+
+	int y;
+
+	if (!vips_vector_isenabled() ||
+		nb > 4 ||
+		(format != VIPS_FORMAT_UCHAR &&
+			format != VIPS_FORMAT_USHORT &&
+			format != VIPS_FORMAT_FLOAT) ||
+		(method != VIPS_REGION_SHRINK_MEAN &&
+			method != VIPS_REGION_SHRINK_MEDIAN))
+		return FALSE;
+
+	for (y = 0; y < target->height; y++) {
+		VipsPel *p = VIPS_REGION_ADDR(from,
+			target->left * 2, (target->top + y) * 2);
+		VipsPel *q = VIPS_REGION_ADDR(to,
+			target->left, target->top + y);
+
+		if (method == VIPS_REGION_SHRINK_MEAN)
+			vips_region_shrink_mean_hwy(q, p, p + ls,
+				target->width, nb, format);
+		else
+			vips_region_shrink_median_hwy(q, p, p + ls,
+				target->width, nb, format);
+	}
+
+	return TRUE;
+}
+#endif /*HAVE_HWY*/
+
 /* Generate area @target in @to using pixels in @from. Non-complex.
  */
 static void
 vips_region_shrink_uncoded(VipsRegion *from,
 	VipsRegion *to, const VipsRect *target, VipsRegionShrink method)
 {
+#ifdef HAVE_HWY
+	if (vips_region_shrink_uncoded_hwy(from, to, target, method))
+		return;
+#endif /*HAVE_HWY*/
+
 	switch (method) {
 	case VIPS_REGION_SHRINK_MEAN:
 		vips_region_shrink_uncoded_mean(from, to, target);
@@ -1600,8 +1653,11 @@ static int
 vips_region_generate(VipsRegion *reg, void *a)
 {
 	VipsImage *im = reg->im;
+	gboolean profile = vips__operation_profile;
 
 	gboolean stop;
+	VipsProfileTimer timer;
+	int result;
 
 	/* Start new sequence, if necessary.
 	 */
@@ -1611,7 +1667,12 @@ vips_region_generate(VipsRegion *reg, void *a)
 	/* Ask for evaluation.
 	 */
 	stop = FALSE;
-	if (im->generate_fn(reg, reg->seq, im->client1, im->client2, &stop))
+	if (profile)
+		vips__profile_generate_start(&timer);
+	result = im->generate_fn(reg, reg->seq, im->client1, im->client2, &stop);
+	if (profile)
+		vips__profile_generate_stop(&timer, reg);
+	if (result)
 		return -1;
 	if (stop) {
 		vips_error("vips_region_generate", "%s", _("stop requested"));
@@ -1727,6 +1788,7 @@ vips_region_prepare_to_generate(VipsRegion *reg,
 
 	if (vips_region_region(reg, dest, r, x, y))
 		return -1;
+	VIPS_PROFILE_TILE(im, FALSE);
 
 	/* Remember where reg is pointing now.
 	 */
@@ -0,0 +1,424 @@
+/* 18/10/26
+ * 	- from shrinkh_hwy.cpp
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+
+#include <vips/vips.h>
+#include <vips/vector.h>
+#include <vips/debug.h>
+#include <vips/internal.h>
+
+#include "pregion.h"
+
+#ifdef HAVE_HWY
+
+#undef HWY_TARGET_INCLUDE
+#define HWY_TARGET_INCLUDE "libvips/iofuncs/region_hwy.cpp"
+#include <hwy/foreach_target.h>
+#include <hwy/highway.h>
+
+namespace HWY_NAMESPACE {
+
+using namespace hwy::HWY_NAMESPACE;
+
+/* We work in a wider type so sums can't overflow. Float is summed in float,
+ * since that's what the C path does.
+ */
+template <typename T>
+struct ShrinkTraits;
+
+template <>
+struct ShrinkTraits<uint8_t> {
+	using DW = ScalableTag<uint16_t>;
+};
+
+template <>
+struct ShrinkTraits<uint16_t> {
+	using DW = ScalableTag<uint32_t>;
+};
+
+template <>
+struct ShrinkTraits<float> {
+	using DW = ScalableTag<float>;
+};
+
+template <class DW, class DT>
+HWY_ATTR HWY_INLINE VFromD<DW>
+shrink_widen(DW dw, DT, VFromD<DT> v)
+{
+	return PromoteTo(dw, v);
+}
+
+HWY_ATTR HWY_INLINE VFromD<ScalableTag<float>>
+shrink_widen(ScalableTag<float>, ScalableTag<float>,
+	VFromD<ScalableTag<float>> v)
+{
+	return v;
+}
+
+template <class DT, class DW>
+HWY_ATTR HWY_INLINE VFromD<DT>
+shrink_narrow(DT dt, DW, VFromD<DW> v)
+{
+	return DemoteTo(dt, v);
+}
+
+HWY_ATTR HWY_INLINE VFromD<ScalableTag<float>>
+shrink_narrow(ScalableTag<float>, ScalableTag<float>,
+	VFromD<ScalableTag<float>> v)
+{
+	return v;
+}
+
+/* The rounding here must match SHRINK_TYPE_MEAN_INT() in region.c.
+ */
+struct ShrinkMeanInt {
+	template <class DW, class V>
+	HWY_ATTR HWY_INLINE V
+	operator()(DW dw, V a, V b, V c, V d) const
+	{
+		return ShiftRight<2>(Add(Add(Add(Add(a, b), c), d), Set(dw, 2)));
+	}
+
+	template <typename T>
+	static T
+	scalar(T a, T b, T c, T d)
+	{
+		return (T) ((a + b + c + d + 2) >> 2);
+	}
+};
+
+/* Sum in the same order as SHRINK_TYPE_MEAN_FLOAT(), so we get the same
+ * result.
+ */
+struct ShrinkMeanFloat {
+	template <class DW, class V>
+	HWY_ATTR HWY_INLINE V
+	operator()(DW dw, V a, V b, V c, V d) const
+	{
+		return Mul(Add(Add(Add(a, b), c), d), Set(dw, 0.25f));
+	}
+
+	template <typename T>
+	static T
+	scalar(T a, T b, T c, T d)
+	{
+		double tot = a + b + c + d;
+
+		return (T) (tot / 4);
+	}
+};
+
+/* As SHRINK_TYPE_MEDIAN().
+ */
+struct ShrinkMedian {
+	template <class DW, class V>
+	HWY_ATTR HWY_INLINE V
+	operator()(DW, V a, V b, V c, V d) const
+	{
+		return Min(Max(a, b), Max(c, d));
+	}
+
+	template <typename T>
+	static T
+	scalar(T a, T b, T c, T d)
+	{
+		return std::min(std::max(a, b), std::max(c, d));
+	}
+};
+
+/* Reduce one band of 2N input pixels on two lines to N output pixels.
+ * lo and hi are the first and second N input pixels of each line.
+ */
+template <class DW, class DT, class Op>
+HWY_ATTR HWY_INLINE VFromD<DT>
+shrink_band(DW dw, DT dt, const Op &op,
+	VFromD<DT> lo0, VFromD<DT> hi0, VFromD<DT> lo1, VFromD<DT> hi1)
+{
+	const auto a = shrink_widen(dw, dt, ConcatEven(dt, hi0, lo0));
+	const auto b = shrink_widen(dw, dt, ConcatOdd(dt, hi0, lo0));
+	const auto c = shrink_widen(dw, dt, ConcatEven(dt, hi1, lo1));
+	const auto d = shrink_widen(dw, dt, ConcatOdd(dt, hi1, lo1));
+
+	return shrink_narrow(dt, dw, op(dw, a, b, c, d));
+}
+
+/* Each of these does as many output pixels as it can with whole vectors
+ * and returns the number it did.
+ */
+template <typename T, class Op>
+HWY_ATTR HWY_INLINE int32_t
+shrink_line1(const Op &op, T *HWY_RESTRICT q,
+	const T *HWY_RESTRICT p, const T *HWY_RESTRICT p1, int32_t width)
+{
+	using DW = typename ShrinkTraits<T>::DW;
+	const DW dw;
+	const Rebind<T, DW> dt;
+	const int32_t N = Lanes(dw);
+
+	int32_t x;
+
+	for (x = 0; x + N <= width; x += N) {
+		const T *s0 = p + 2 * x;
+		const T *s1 = p1 + 2 * x;
+
+		StoreU(shrink_band(dw, dt, op,
+				   LoadU(dt, s0), LoadU(dt, s0 + N),
+				   LoadU(dt, s1), LoadU(dt, s1 + N)),
+			dt, q + x);
+	}
+
+	return x;
+}
+
+template <typename T, class Op>
+HWY_ATTR HWY_INLINE int32_t
+shrink_line2(const Op &op, T *HWY_RESTRICT q,
+	const T *HWY_RESTRICT p, const T *HWY_RESTRICT p1, int32_t width)
+{
+	using DW = typename ShrinkTraits<T>::DW;
+	const DW dw;
+	const Rebind<T, DW> dt;
+	const int32_t N = Lanes(dw);
+
+	int32_t x;
+
+	for (x = 0; x + N <= width; x += N) {
+		const T *s0 = p + 4 * x;
+		const T *s1 = p1 + 4 * x;
+		VFromD<decltype(dt)> l0a, l0b, h0a, h0b;
+		VFromD<decltype(dt)> l1a, l1b, h1a, h1b;
+
+		LoadInterleaved2(dt, s0, l0a, l0b);
+		LoadInterleaved2(dt, s0 + 2 * N, h0a, h0b);
+		LoadInterleaved2(dt, s1, l1a, l1b);
+		LoadInterleaved2(dt, s1 + 2 * N, h1a, h1b);
+
+		StoreInterleaved2(
+			shrink_band(dw, dt, op, l0a, h0a, l1a, h1a),
+			shrink_band(dw, dt, op, l0b, h0b, l1b, h1b),
+			dt, q + 2 * x);
+	}
+
+	return x;
+}
+
+template <typename T, class Op>
+HWY_ATTR HWY_INLINE int32_t
+shrink_line3(const Op &op, T *HWY_RESTRICT q,
+	const T *HWY_RESTRICT p, const T *HWY_RESTRICT p1, int32_t width)
+{
+	using DW = typename ShrinkTraits<T>::DW;
+	const DW dw;
+	const Rebind<T, DW> dt;
+	const int32_t N = Lanes(dw);
+
+	int32_t x;
+
+	for (x = 0; x + N <= width; x += N) {
+		const T *s0 = p + 6 * x;
+		const T *s1 = p1 + 6 * x;
+		VFromD<decltype(dt)> l0a, l0b, l0c, h0a, h0b, h0c;
+		VFromD<decltype(dt)> l1a, l1b, l1c, h1a, h1b, h1c;
+
+		LoadInterleaved3(dt, s0, l0a, l0b, l0c);
+		LoadInterleaved3(dt, s0 + 3 * N, h0a, h0b, h0c);
+		LoadInterleaved3(dt, s1, l1a, l1b, l1c);
+		LoadInterleaved3(dt, s1 + 3 * N, h1a, h1b, h1c);
+
+		StoreInterleaved3(
+			shrink_band(dw, dt, op, l0a, h0a, l1a, h1a),
+			shrink_band(dw, dt, op, l0b, h0b, l1b, h1b),
+			shrink_band(dw, dt, op, l0c, h0c, l1c, h1c),
+			dt, q + 3 * x);
+	}
+
+	return x;
+}
+
+template <typename T, class Op>
+HWY_ATTR HWY_INLINE int32_t
+shrink_line4(const Op &op, T *HWY_RESTRICT q,
+	const T *HWY_RESTRICT p, const T *HWY_RESTRICT p1, int32_t width)
+{
+	using DW = typename ShrinkTraits<T>::DW;
+	const DW dw;
+	const Rebind<T, DW> dt;
+	const int32_t N = Lanes(dw);
+
+	int32_t x;
+
+	for (x = 0; x + N <= width; x += N) {
+		const T *s0 = p + 8 * x;
+		const T *s1 = p1 + 8 * x;
+		VFromD<decltype(dt)> l0a, l0b, l0c, l0d, h0a, h0b, h0c, h0d;
+		VFromD<decltype(dt)> l1a, l1b, l1c, l1d, h1a, h1b, h1c, h1d;
+
+		LoadInterleaved4(dt, s0, l0a, l0b, l0c, l0d);
+		LoadInterleaved4(dt, s0 + 4 * N, h0a, h0b, h0c, h0d);
+		LoadInterleaved4(dt, s1, l1a, l1b, l1c, l1d);
+		LoadInterleaved4(dt, s1 + 4 * N, h1a, h1b, h1c, h1d);
+
+		StoreInterleaved4(
+			shrink_band(dw, dt, op, l0a, h0a, l1a, h1a),
+			shrink_band(dw, dt, op, l0b, h0b, l1b, h1b),
+			shrink_band(dw, dt, op, l0c, h0c, l1c, h1c),
+			shrink_band(dw, dt, op, l0d, h0d, l1d, h1d),
+			dt, q + 4 * x);
+	}
+
+	return x;
+}
+
+template <typename T, class Op>
+HWY_ATTR HWY_INLINE void
+shrink_line(const Op &op, VipsPel *pq, VipsPel *pp, VipsPel *pp1,
+	int32_t width, int32_t bands)
+{
+	T *HWY_RESTRICT q = (T *) pq;
+	const T *HWY_RESTRICT p = (T *) pp;
+	const T *HWY_RESTRICT p1 = (T *) pp1;
+
+	int32_t x = 0;
+
+#if HWY_TARGET != HWY_SCALAR
+	switch (bands) {
+	case 1:
+		x = shrink_line1(op, q, p, p1, width);
+		break;
+	case 2:
+		x = shrink_line2(op, q, p, p1, width);
+		break;
+	case 3:
+		x = shrink_line3(op, q, p, p1, width);
+		break;
+	case 4:
+		x = shrink_line4(op, q, p, p1, width);
+		break;
+
+	default:
+		break;
+	}
+#endif
+
+	/* Any leftover pixels at the right.
+	 */
+	for (; x < width; x++) {
+		const T *tp = p + 2 * x * bands;
+		const T *tp1 = p1 + 2 * x * bands;
+		T *tq = q + x * bands;
+
+		for (int32_t z = 0; z < bands; z++)
+			tq[z] = Op::scalar(tp[z], tp[z + bands],
+				tp1[z], tp1[z + bands]);
+	}
+}
+
+HWY_ATTR void
+vips_region_shrink_mean_hwy(VipsPel *q, VipsPel *p, VipsPel *p1,
+	int32_t width, int32_t bands, VipsBandFormat format)
+{
+	switch (format) {
+	case VIPS_FORMAT_UCHAR:
+		shrink_line<uint8_t>(ShrinkMeanInt(), q, p, p1, width, bands);
+		break;
+
+	case VIPS_FORMAT_USHORT:
+		shrink_line<uint16_t>(ShrinkMeanInt(), q, p, p1, width, bands);
+		break;
+
+	case VIPS_FORMAT_FLOAT:
+		shrink_line<float>(ShrinkMeanFloat(), q, p, p1, width, bands);
+		break;
+
+	default:
+		g_assert_not_reached();
+	}
+}
+
+HWY_ATTR void
+vips_region_shrink_median_hwy(VipsPel *q, VipsPel *p, VipsPel *p1,
+	int32_t width, int32_t bands, VipsBandFormat format)
+{
+	switch (format) {
+	case VIPS_FORMAT_UCHAR:
+		shrink_line<uint8_t>(ShrinkMedian(), q, p, p1, width, bands);
+		break;
+
+	case VIPS_FORMAT_USHORT:
+		shrink_line<uint16_t>(ShrinkMedian(), q, p, p1, width, bands);
+		break;
+
+	case VIPS_FORMAT_FLOAT:
+		shrink_line<float>(ShrinkMedian(), q, p, p1, width, bands);
+		break;
+
+	default:
+		g_assert_not_reached();
+	}
+}
+
+} /*namespace HWY_NAMESPACE*/
+
+#if HWY_ONCE
+HWY_EXPORT(vips_region_shrink_mean_hwy);
+HWY_EXPORT(vips_region_shrink_median_hwy);
+
+void
+vips_region_shrink_mean_hwy(VipsPel *q, VipsPel *p, VipsPel *p1,
+	int width, int bands, VipsBandFormat format)
+{
+	/* clang-format off */
+	HWY_DYNAMIC_DISPATCH(vips_region_shrink_mean_hwy)(q, p, p1,
+		width, bands, format);
+	/* clang-format on */
+}
+
+void
+vips_region_shrink_median_hwy(VipsPel *q, VipsPel *p, VipsPel *p1,
+	int width, int bands, VipsBandFormat format)
+{
+	/* clang-format off */
+	HWY_DYNAMIC_DISPATCH(vips_region_shrink_median_hwy)(q, p, p1,
+		width, bands, format);
+	/* clang-format on */
+}
+#endif /*HWY_ONCE*/
+
+#endif /*HAVE_HWY*/
@@ -10,6 +10,8 @@
  * 1/12/15
  * 	- don't do anything to out or mask after they have closed
  * 	- only run the bg render thread when there's work to do
+ * 18/10/26
+ * 	- add vips_sink_screen_set_viewport()
  */
 
 /*
@@ -147,6 +149,12 @@ typedef struct _Render {
 	 */
 	GSList *dirty;
 
+	/* The area the user can see, if they've told us. Dirty tiles are then
+	 * painted nearest the centre of the viewport first.
+	 */
+	gboolean has_viewport;
+	VipsRect viewport;
+
 	/* Hash of tiles with positions. Tiles can be dirty or painted.
 	 */
 	GHashTable *tiles;
@@ -327,7 +335,23 @@ render_unref(Render *render)
 	return 0;
 }
 
-/* Get the next tile to paint off the dirty list.
+/* Squared distance from the centre of a tile to the centre of the viewport.
+ */
+static gint64
+tile_viewport_distance(Tile *tile)
+{
+	Render *render = tile->render;
+	VipsRect *viewport = &render->viewport;
+	gint64 dx = (gint64) 2 * tile->area.left + tile->area.width -
+		(2 * viewport->left + viewport->width);
+	gint64 dy = (gint64) 2 * tile->area.top + tile->area.height -
+		(2 * viewport->top + viewport->height);
+
+	return dx * dx + dy * dy;
+}
+
+/* Get the next tile to paint off the dirty list. With a viewport, that's the
+ * tile nearest the centre, otherwise it's the most recently requested.
  */
 static Tile *
 render_tile_dirty_get(Render *render)
@@ -338,6 +362,22 @@ render_tile_dirty_get(Render *render)
 		tile = NULL;
 	else {
 		tile = (Tile *) render->dirty->data;
+
+		if (render->has_viewport) {
+			gint64 best = tile_viewport_distance(tile);
+			GSList *p;
+
+			for (p = render->dirty->next; p; p = p->next) {
+				Tile *this = (Tile *) p->data;
+				gint64 distance = tile_viewport_distance(this);
+
+				if (distance < best) {
+					best = distance;
+					tile = this;
+				}
+			}
+		}
+
 		g_assert(tile->dirty);
 		render->dirty = g_slist_remove(render->dirty, tile);
 		tile->dirty = FALSE;
@@ -864,6 +904,163 @@ render_tile_request(Render *render, VipsRegion *reg, VipsRect *area)
 	return tile;
 }
 
+/* The viewport, expanded by a tile all round and by the scroll velocity
+ * ahead of the motion. Tiles outside this are not worth painting.
+ */
+static void
+render_prefetch_area(Render *render, int dx, int dy, VipsRect *area)
+{
+	VipsRect image;
+
+	*area = render->viewport;
+	vips_rect_marginadjust(area, VIPS_MAX(render->tile_width,
+		render->tile_height));
+
+	if (dx < 0)
+		area->left += dx;
+	area->width += abs(dx);
+	if (dy < 0)
+		area->top += dy;
+	area->height += abs(dy);
+
+	image.left = 0;
+	image.top = 0;
+	image.width = render->in->Xsize;
+	image.height = render->in->Ysize;
+	vips_rect_intersectrect(area, &image, area);
+}
+
+/* Drop dirty tiles which have left @area. They have never been painted, so
+ * there's nothing worth keeping: free them, and the slots can go to tiles
+ * in view. render_tile_request() will make them again if they are asked for.
+ */
+static void
+render_cancel_stale(Render *render, VipsRect *area)
+{
+	GSList *p;
+	GSList *next;
+
+	for (p = render->dirty; p; p = next) {
+		Tile *tile = (Tile *) p->data;
+
+		next = p->next;
+
+		if (!vips_rect_overlapsrect(&tile->area, area)) {
+			VIPS_DEBUG_MSG_GREEN("render_cancel_stale: dropping %p\n",
+				tile);
+			render->dirty = g_slist_delete_link(render->dirty, p);
+			g_hash_table_remove(render->tiles, &tile->area);
+			render->all = g_slist_remove(render->all, tile);
+			render->ntiles -= 1;
+			(void) tile_free(tile, NULL, NULL);
+		}
+	}
+}
+
+/* Queue tiles in @area we don't have yet. We only make new tiles, we never
+ * evict painted ones for prefetch.
+ */
+static void
+render_prefetch(Render *render, VipsRect *area)
+{
+	int tile_width = render->tile_width;
+	int tile_height = render->tile_height;
+	int xs = (area->left / tile_width) * tile_width;
+	int ys = (area->top / tile_height) * tile_height;
+
+	int x, y;
+
+	for (y = ys; y < VIPS_RECT_BOTTOM(area); y += tile_height)
+		for (x = xs; x < VIPS_RECT_RIGHT(area); x += tile_width) {
+			VipsRect tile_area;
+			Tile *tile;
+
+			if (render->max_tiles != -1 &&
+				render->ntiles >= render->max_tiles)
+				return;
+
+			tile_area.left = x;
+			tile_area.top = y;
+			tile_area.width = tile_width;
+			tile_area.height = tile_height;
+			if (render_tile_lookup(render, &tile_area))
+				continue;
+
+			if (!(tile = tile_new(render)))
+				return;
+			render_tile_add(tile, &tile_area);
+			tile_queue(tile, NULL);
+		}
+}
+
+static int image_fill(VipsRegion *out,
+	void *seq, void *a, void *b, gboolean *stop);
+
+/**
+ * vips_sink_screen_set_viewport: (method)
+ * @out: output image from [method@Image.sink_screen]
+ * @viewport: the area of @out that is visible
+ * @dx: horizontal scroll velocity in pixels
+ * @dy: vertical scroll velocity in pixels
+ *
+ * Tell a background render which part of @out the user can see.
+ *
+ * Tiles waiting to be painted are then done nearest the centre of @viewport
+ * first, rather than most recently requested first. Queued tiles more than
+ * a tile outside @viewport are dropped, so a fast pan does not leave the
+ * workers busy with tiles no one will see. Spare workers prefetch the ring
+ * of tiles around @viewport, plus @dx, @dy pixels ahead of the motion, but
+ * only while the cache has room for new tiles.
+ *
+ * Renders with a private threadpool (a negative priority) reorder their
+ * queue, but never drop tiles from it.
+ *
+ * Call this again whenever the view moves. Pass a `NULL` @viewport to go
+ * back to the default scheduling.
+ *
+ * This only affects asynchronous renders, ie. those with a notify callback.
+ *
+ * ::: seealso
+ *     [method@Image.sink_screen].
+ */
+void
+vips_sink_screen_set_viewport(VipsImage *out, const VipsRect *viewport,
+	int dx, int dy)
+{
+	Render *render;
+	VipsRect area;
+
+	/* out must be the output of vips_sink_screen().
+	 */
+	if (out->generate_fn != image_fill)
+		return;
+	render = (Render *) out->client2;
+
+	if (!render->notify)
+		return;
+
+	g_mutex_lock(&render->lock);
+
+	if (!viewport)
+		render->has_viewport = FALSE;
+	else {
+		render->has_viewport = TRUE;
+		render->viewport = *viewport;
+
+		render_prefetch_area(render, dx, dy, &area);
+
+		/* Private renders count dirty tiles with a semaphore, so we
+		 * can't drop them.
+		 */
+		if (!render->private_threadpool)
+			render_cancel_stale(render, &area);
+
+		render_prefetch(render, &area);
+	}
+
+	g_mutex_unlock(&render->lock);
+}
+
 /* Copy what we can from the tile into the region.
  */
 static void
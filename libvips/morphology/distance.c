@@ -0,0 +1,445 @@
+/* distance.c
+ *
+ * 18/10/26
+ * 	- from nearest.c
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+/*
+#define DEBUG
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <stdio.h>
+#include <math.h>
+
+#include <vips/vips.h>
+#include <vips/internal.h>
+
+#include "pmorphology.h"
+
+/* Pixels with no feature in range start with this squared distance.
+ */
+#define DISTANCE_INF (1e20)
+
+/* Each work unit is this many columns or lines. We use pos.left and
+ * pos.width for the range whichever direction we are scanning.
+ */
+#define DISTANCE_CHUNK (16)
+
+typedef struct _VipsDistance {
+	VipsMorphology parent_instance;
+
+	VipsImage *out;
+	gboolean signed_distance;
+
+} VipsDistance;
+
+typedef VipsMorphologyClass VipsDistanceClass;
+
+G_DEFINE_TYPE(VipsDistance, vips_distance, VIPS_TYPE_MORPHOLOGY);
+
+/* Our state during a transform.
+ */
+typedef struct _DistanceScan {
+	/* The uchar mask, the squared distance after the column pass, and
+	 * the float output.
+	 */
+	VipsImage *mask;
+	VipsImage *d2;
+	VipsImage *out;
+
+	/* Find distance to non-zero mask pixels, or to zero pixels.
+	 */
+	gboolean invert;
+
+	/* Subtract from out, rather than set it.
+	 */
+	gboolean subtract;
+
+	/* Allocate the next chunk here.
+	 */
+	int pos;
+	int size;
+} DistanceScan;
+
+/* Scratch for a 1D transform of up to n elements.
+ */
+typedef struct _DistanceBuffer {
+	double *f;
+	double *d;
+	double *z;
+	int *v;
+} DistanceBuffer;
+
+static int
+distance_buffer_init(DistanceBuffer *buf, int n)
+{
+	buf->f = VIPS_ARRAY(NULL, n, double);
+	buf->d = VIPS_ARRAY(NULL, n, double);
+	buf->z = VIPS_ARRAY(NULL, n + 1, double);
+	buf->v = VIPS_ARRAY(NULL, n, int);
+	if (!buf->f ||
+		!buf->d ||
+		!buf->z ||
+		!buf->v)
+		return -1;
+
+	return 0;
+}
+
+static void
+distance_buffer_free(DistanceBuffer *buf)
+{
+	VIPS_FREE(buf->f);
+	VIPS_FREE(buf->d);
+	VIPS_FREE(buf->z);
+	VIPS_FREE(buf->v);
+}
+
+/* The 1D squared distance transform of sampled functions from Felzenszwalb
+ * and Huttenlocher, "Distance Transforms of Sampled Functions", 2012.
+ *
+ * Find the lower envelope of the parabolas rooted at each f[q], then read
+ * d[] off the envelope. Linear time in n.
+ */
+static void
+distance_transform_1d(DistanceBuffer *buf, int n)
+{
+	double *f = buf->f;
+	double *d = buf->d;
+	double *z = buf->z;
+	int *v = buf->v;
+
+	int k, q;
+
+	k = 0;
+	v[0] = 0;
+	z[0] = -DISTANCE_INF;
+	z[1] = DISTANCE_INF;
+	for (q = 1; q < n; q++) {
+		double s;
+
+		/* z[0] is below any intersection, so k never goes negative.
+		 */
+		for (;;) {
+			int p = v[k];
+
+			s = ((f[q] + (double) q * q) - (f[p] + (double) p * p)) /
+				(2.0 * q - 2.0 * p);
+			if (s > z[k])
+				break;
+			k -= 1;
+		}
+
+		k += 1;
+		v[k] = q;
+		z[k] = s;
+		z[k + 1] = DISTANCE_INF;
+	}
+
+	k = 0;
+	for (q = 0; q < n; q++) {
+		while (z[k + 1] < q)
+			k += 1;
+
+		d[q] = (double) (q - v[k]) * (q - v[k]) + f[v[k]];
+	}
+}
+
+static int
+vips_distance_allocate(VipsThreadState *state, void *a, gboolean *stop)
+{
+	DistanceScan *scan = (DistanceScan *) a;
+
+	if (scan->pos >= scan->size) {
+		*stop = TRUE;
+		return 0;
+	}
+
+	state->pos.left = scan->pos;
+	state->pos.width = VIPS_MIN(DISTANCE_CHUNK, scan->size - scan->pos);
+	scan->pos += DISTANCE_CHUNK;
+
+	return 0;
+}
+
+/* Transform down a set of columns of the mask into d2.
+ */
+static int
+vips_distance_columns(VipsThreadState *state, void *a)
+{
+	DistanceScan *scan = (DistanceScan *) a;
+	VipsImage *mask = scan->mask;
+	const int height = mask->Ysize;
+	const VipsPel hit = scan->invert ? 0 : 255;
+
+	DistanceBuffer buf;
+	int x, y;
+
+	if (distance_buffer_init(&buf, height)) {
+		distance_buffer_free(&buf);
+		return -1;
+	}
+
+	for (x = state->pos.left; x < VIPS_RECT_RIGHT(&state->pos); x++) {
+		for (y = 0; y < height; y++)
+			buf.f[y] = *VIPS_IMAGE_ADDR(mask, x, y) == hit
+				? 0.0
+				: DISTANCE_INF;
+
+		distance_transform_1d(&buf, height);
+
+		for (y = 0; y < height; y++)
+			*((double *) VIPS_IMAGE_ADDR(scan->d2, x, y)) = buf.d[y];
+	}
+
+	distance_buffer_free(&buf);
+
+	return 0;
+}
+
+/* Transform along a set of lines of d2 into out.
+ */
+static int
+vips_distance_lines(VipsThreadState *state, void *a)
+{
+	DistanceScan *scan = (DistanceScan *) a;
+	const int width = scan->d2->Xsize;
+
+	DistanceBuffer buf;
+	int x, y;
+
+	if (distance_buffer_init(&buf, width)) {
+		distance_buffer_free(&buf);
+		return -1;
+	}
+
+	for (y = state->pos.left; y < VIPS_RECT_RIGHT(&state->pos); y++) {
+		double *p = (double *) VIPS_IMAGE_ADDR(scan->d2, 0, y);
+		float *q = (float *) VIPS_IMAGE_ADDR(scan->out, 0, y);
+
+		for (x = 0; x < width; x++)
+			buf.f[x] = p[x];
+
+		distance_transform_1d(&buf, width);
+
+		if (scan->subtract)
+			for (x = 0; x < width; x++)
+				q[x] -= sqrt(buf.d[x]);
+		else
+			for (x = 0; x < width; x++)
+				q[x] = sqrt(buf.d[x]);
+	}
+
+	distance_buffer_free(&buf);
+
+	return 0;
+}
+
+/* Exact Euclidean distance from every pixel to the nearest feature pixel. The
+ * transform is separable, so we run it down every column, then along every
+ * line of that.
+ */
+static int
+vips_distance_transform(DistanceScan *scan)
+{
+	scan->pos = 0;
+	scan->size = scan->mask->Xsize;
+	if (vips_threadpool_run(scan->mask,
+			vips_thread_state_new,
+			vips_distance_allocate,
+			vips_distance_columns,
+			NULL,
+			scan))
+		return -1;
+
+	scan->pos = 0;
+	scan->size = scan->mask->Ysize;
+	if (vips_threadpool_run(scan->mask,
+			vips_thread_state_new,
+			vips_distance_allocate,
+			vips_distance_lines,
+			NULL,
+			scan))
+		return -1;
+
+	return 0;
+}
+
+static int
+vips_distance_build(VipsObject *object)
+{
+	VipsMorphology *morphology = VIPS_MORPHOLOGY(object);
+	VipsDistance *distance = (VipsDistance *) object;
+	VipsImage **t = (VipsImage **) vips_object_local_array(object, 6);
+
+	VipsImage *in;
+	DistanceScan scan;
+
+	if (VIPS_OBJECT_CLASS(vips_distance_parent_class)->build(object))
+		return -1;
+
+	in = morphology->in;
+
+	if (vips_image_decode(in, &t[0]))
+		return -1;
+	in = t[0];
+
+	/* Any non-zero band makes a feature pixel.
+	 */
+	if (vips_notequal_const1(in, &t[1], 0.0, NULL) ||
+		vips_bandor(t[1], &t[2], NULL) ||
+		!(t[3] = vips_image_copy_memory(t[2])))
+		return -1;
+	in = t[3];
+
+	t[4] = vips_image_new_memory();
+	vips_image_init_fields(t[4],
+		in->Xsize, in->Ysize, 1,
+		VIPS_FORMAT_DOUBLE, VIPS_CODING_NONE, VIPS_INTERPRETATION_B_W,
+		in->Xres, in->Yres);
+	if (vips_image_write_prepare(t[4]))
+		return -1;
+
+	t[5] = vips_image_new_memory();
+	vips_image_init_fields(t[5],
+		in->Xsize, in->Ysize, 1,
+		VIPS_FORMAT_FLOAT, VIPS_CODING_NONE, VIPS_INTERPRETATION_B_W,
+		in->Xres, in->Yres);
+	if (vips_image_write_prepare(t[5]))
+		return -1;
+
+	scan.mask = in;
+	scan.d2 = t[4];
+	scan.out = t[5];
+	scan.invert = FALSE;
+	scan.subtract = FALSE;
+	if (vips_distance_transform(&scan))
+		return -1;
+
+	/* For a signed distance field, subtract the distance to the
+	 * background, so feature pixels are negative.
+	 */
+	if (distance->signed_distance) {
+		scan.invert = TRUE;
+		scan.subtract = TRUE;
+		if (vips_distance_transform(&scan))
+			return -1;
+	}
+
+	g_object_set(object, "out", vips_image_new(), NULL);
+	if (vips_image_write(t[5], distance->out))
+		return -1;
+
+	return 0;
+}
+
+static void
+vips_distance_class_init(VipsDistanceClass *class)
+{
+	GObjectClass *gobject_class = G_OBJECT_CLASS(class);
+	VipsObjectClass *vobject_class = VIPS_OBJECT_CLASS(class);
+
+	gobject_class->set_property = vips_object_set_property;
+	gobject_class->get_property = vips_object_get_property;
+
+	vobject_class->nickname = "distance";
+	vobject_class->description =
+		_("find the distance to the nearest non-zero pixel");
+	vobject_class->build = vips_distance_build;
+
+	VIPS_ARG_IMAGE(class, "out", 2,
+		_("Out"),
+		_("Distance image"),
+		VIPS_ARGUMENT_REQUIRED_OUTPUT,
+		G_STRUCT_OFFSET(VipsDistance, out));
+
+	VIPS_ARG_BOOL(class, "signed", 3,
+		_("Signed"),
+		_("Make a signed distance field"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsDistance, signed_distance),
+		FALSE);
+}
+
+static void
+vips_distance_init(VipsDistance *distance)
+{
+}
+
+/**
+ * vips_distance: (method)
+ * @in: image to test
+ * @out: (out): distance image
+ * @...: `NULL`-terminated list of optional named arguments
+ *
+ * Find the exact Euclidean distance from each pixel in @in to the nearest
+ * non-zero pixel. Non-zero pixels are at distance zero. A pixel is non-zero
+ * if any of its bands is non-zero.
+ *
+ * Set @signed to make a signed distance field instead. Pixels outside
+ * objects are the distance to the nearest object pixel, as before, and
+ * pixels inside objects are minus the distance to the nearest zero pixel.
+ * This is the convention used by [ctor@Image.sdf].
+ *
+ * If there are no non-zero pixels (or, for @signed, no zero pixels), the
+ * distances are set to a very large value.
+ *
+ * @out is a 1-band [enum@Vips.BandFormat.FLOAT] image of the same size as
+ * @in.
+ *
+ * This uses the linear-time algorithm from Felzenszwalb and Huttenlocher,
+ * run down the columns and then along the lines of the image on the
+ * threadpool. The whole image is processed in memory.
+ *
+ * ::: tip "Optional arguments"
+ *     * @signed: `gboolean`, make a signed distance field
+ *
+ * ::: seealso
+ *     [method@Image.fill_nearest], [ctor@Image.sdf].
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+int
+vips_distance(VipsImage *in, VipsImage **out, ...)
+{
+	va_list ap;
+	int result;
+
+	va_start(ap, out);
+	result = vips_call_split("distance", ap, in, out);
+	va_end(ap);
+
+	return result;
+}
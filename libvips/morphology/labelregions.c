@@ -4,6 +4,9 @@
  *	- renamed from im_segment()
  * 11/2/14
  * 	- redo as a class
+ * 18/10/26
+ * 	- parallel union-find labelling
+ * 	- add "stats" output
  */
 
 /*
@@ -39,6 +42,7 @@
 #include <glib/gi18n-lib.h>
 
 #include <stdio.h>
+#include <limits.h>
 
 #include <vips/vips.h>
 #include <vips/internal.h>
@@ -50,59 +54,329 @@ typedef struct _VipsLabelregions {
 
 	VipsImage *mask;
 	int segments;
+	VipsImage *stats;
 } VipsLabelregions;
 
 typedef VipsMorphologyClass VipsLabelregionsClass;
 
 G_DEFINE_TYPE(VipsLabelregions, vips_labelregions, VIPS_TYPE_MORPHOLOGY);
 
+/* Label in tiles of this size on the threadpool.
+ */
+#define LABEL_TILE_SIZE (256)
+
+/* The columns of the stats matrix.
+ */
+#define LABEL_N_STATS (7)
+
+/* Our state during the first pass.
+ */
+typedef struct _Label {
+	VipsImage *in;
+
+	/* The union-find forest, one element per pixel. Each element holds the
+	 * index of its parent, and roots point to themselves. We always link
+	 * the larger root to the smaller, so a parent always has a smaller
+	 * index than its children, and the root of a set is the first pixel
+	 * of that set in scan order.
+	 */
+	int *m;
+
+	/* Allocate the next tile here.
+	 */
+	int x;
+	int y;
+} Label;
+
+/* Accumulate stats for a label here.
+ */
+typedef struct _LabelStats {
+	guint64 area;
+	int left;
+	int top;
+	int right;
+	int bottom;
+	double sx;
+	double sy;
+} LabelStats;
+
+static inline int
+label_find(int *m, int i)
+{
+	/* Path halving.
+	 */
+	while (m[i] != i) {
+		m[i] = m[m[i]];
+		i = m[i];
+	}
+
+	return i;
+}
+
+static inline void
+label_union(int *m, int i, int j)
+{
+	i = label_find(m, i);
+	j = label_find(m, j);
+
+	if (i < j)
+		m[j] = i;
+	else if (j < i)
+		m[i] = j;
+}
+
+static inline gboolean
+label_equal(VipsPel *p, VipsPel *q, int ps)
+{
+	int i;
+
+	for (i = 0; i < ps; i++)
+		if (p[i] != q[i])
+			return FALSE;
+
+	return TRUE;
+}
+
+static int
+vips_labelregions_allocate(VipsThreadState *state, void *a, gboolean *stop)
+{
+	Label *label = (Label *) a;
+	VipsImage *in = label->in;
+
+	VipsRect image;
+
+	if (label->y >= in->Ysize) {
+		*stop = TRUE;
+		return 0;
+	}
+
+	image.left = 0;
+	image.top = 0;
+	image.width = in->Xsize;
+	image.height = in->Ysize;
+	state->pos.left = label->x;
+	state->pos.top = label->y;
+	state->pos.width = LABEL_TILE_SIZE;
+	state->pos.height = LABEL_TILE_SIZE;
+	vips_rect_intersectrect(&image, &state->pos, &state->pos);
+
+	label->x += LABEL_TILE_SIZE;
+	if (label->x >= in->Xsize) {
+		label->x = 0;
+		label->y += LABEL_TILE_SIZE;
+	}
+
+	return 0;
+}
+
+/* Build the forest for one tile. We only link pixels within the tile, so
+ * workers never touch each other's part of m.
+ */
+static int
+vips_labelregions_work(VipsThreadState *state, void *a)
+{
+	Label *label = (Label *) a;
+	VipsImage *in = label->in;
+	int *m = label->m;
+	VipsRect *r = &state->pos;
+	const int ps = VIPS_IMAGE_SIZEOF_PEL(in);
+	const int ls = VIPS_IMAGE_SIZEOF_LINE(in);
+
+	int x, y;
+
+	for (y = r->top; y < VIPS_RECT_BOTTOM(r); y++) {
+		VipsPel *p = VIPS_IMAGE_ADDR(in, r->left, y);
+		int i = y * in->Xsize + r->left;
+
+		for (x = r->left; x < VIPS_RECT_RIGHT(r); x++) {
+			m[i] = i;
+
+			if (x > r->left &&
+				label_equal(p, p - ps, ps))
+				label_union(m, i, i - 1);
+			if (y > r->top &&
+				label_equal(p, p - ls, ps))
+				label_union(m, i, i - in->Xsize);
+
+			p += ps;
+			i += 1;
+		}
+	}
+
+	return 0;
+}
+
+/* Join the tiles up along their edges, then number the sets in scan order.
+ */
+static void
+vips_labelregions_resolve(VipsImage *in, int *m, GArray *stats)
+{
+	const int ps = VIPS_IMAGE_SIZEOF_PEL(in);
+	const int ls = VIPS_IMAGE_SIZEOF_LINE(in);
+
+	int serial;
+	int x, y, i;
+
+	for (y = 0; y < in->Ysize; y++)
+		for (x = LABEL_TILE_SIZE; x < in->Xsize; x += LABEL_TILE_SIZE) {
+			VipsPel *p = VIPS_IMAGE_ADDR(in, x, y);
+
+			i = y * in->Xsize + x;
+			if (label_equal(p, p - ps, ps))
+				label_union(m, i, i - 1);
+		}
+
+	for (y = LABEL_TILE_SIZE; y < in->Ysize; y += LABEL_TILE_SIZE) {
+		VipsPel *p = VIPS_IMAGE_ADDR(in, 0, y);
+
+		i = y * in->Xsize;
+		for (x = 0; x < in->Xsize; x++) {
+			if (label_equal(p, p - ls, ps))
+				label_union(m, i, i - in->Xsize);
+
+			p += ps;
+			i += 1;
+		}
+	}
+
+	/* Parents always come before their children, so by the time we reach
+	 * a pixel its parent has been replaced by the final label. Roots get
+	 * the next serial number, so we number regions in the same order as a
+	 * scan-order flood fill would.
+	 */
+	serial = 1;
+	i = 0;
+	for (y = 0; y < in->Ysize; y++)
+		for (x = 0; x < in->Xsize; x++) {
+			LabelStats *s;
+			int v;
+
+			if (m[i] == i) {
+				v = serial++;
+
+				g_array_set_size(stats, serial);
+				s = &g_array_index(stats, LabelStats, v);
+				s->area = 0;
+				s->left = x;
+				s->top = y;
+				s->right = x;
+				s->bottom = y;
+				s->sx = 0.0;
+				s->sy = 0.0;
+			}
+			else
+				v = m[m[i]];
+
+			m[i] = v;
+			i += 1;
+
+			s = &g_array_index(stats, LabelStats, v);
+			s->area += 1;
+			s->left = VIPS_MIN(s->left, x);
+			s->right = VIPS_MAX(s->right, x);
+			s->bottom = y;
+			s->sx += x;
+			s->sy += y;
+		}
+}
+
 static int
 vips_labelregions_build(VipsObject *object)
 {
+	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(object);
 	VipsMorphology *morphology = VIPS_MORPHOLOGY(object);
 	VipsImage *in = morphology->in;
-	VipsImage **t = (VipsImage **) vips_object_local_array(object, 2);
-	VipsImage *mask;
+	VipsImage **t = (VipsImage **) vips_object_local_array(object, 4);
 
+	VipsImage *mask;
+	VipsImage *stats;
+	GArray *label_stats;
+	Label label;
 	int segments;
-	int *m;
-	int x, y;
+	int i;
 
 	if (VIPS_OBJECT_CLASS(vips_labelregions_parent_class)->build(object))
 		return -1;
 
-	/* Create the zero mask image in memory.
+	if (vips_check_coding_known(class->nickname, in))
+		return -1;
+
+	/* We index pixels with int.
 	 */
-	if (vips_black(&t[0], in->Xsize, in->Ysize, NULL) ||
-		vips_cast(t[0], &t[1], VIPS_FORMAT_INT, NULL) ||
-		!(t[2] = vips_image_copy_memory(t[1])))
+	if (VIPS_IMAGE_N_PELS(in) >= INT_MAX) {
+		vips_error(class->nickname, "%s", _("image too large"));
 		return -1;
+	}
 
-	mask = t[2];
-	g_object_set(object,
-		"mask", mask,
-		NULL);
+	if (!(t[0] = vips_image_copy_memory(in)))
+		return -1;
+	in = t[0];
 
-	segments = 1;
-	m = (int *) mask->data;
-	for (y = 0; y < mask->Ysize; y++) {
-		for (x = 0; x < mask->Xsize; x++) {
-			if (!m[x]) {
-				/* Use a direct path for speed.
-				 */
-				if (vips__draw_flood_direct(mask, in,
-						segments, x, y))
-					return -1;
-
-				segments += 1;
-			}
-		}
+	/* The forest is built in the mask, then replaced by the labels.
+	 */
+	t[1] = vips_image_new_memory();
+	vips_image_init_fields(t[1],
+		in->Xsize, in->Ysize, 1,
+		VIPS_FORMAT_INT, VIPS_CODING_NONE, VIPS_INTERPRETATION_B_W,
+		1.0, 1.0);
+	if (vips_image_write_prepare(t[1]))
+		return -1;
+	mask = t[1];
+
+	label.in = in;
+	label.m = (int *) mask->data;
+	label.x = 0;
+	label.y = 0;
+
+	/* We don't want threadpool_run to minimise on completion, we might
+	 * have been handed a pipeline with a cache on.
+	 */
+	if (vips_copy(in, &t[2], NULL))
+		return -1;
+	vips_image_set_int(t[2], "vips-no-minimise", 1);
+
+	if (vips_threadpool_run(t[2],
+			vips_thread_state_new,
+			vips_labelregions_allocate,
+			vips_labelregions_work,
+			NULL,
+			&label))
+		return -1;
+
+	label_stats = g_array_new(FALSE, FALSE, sizeof(LabelStats));
+	g_array_set_size(label_stats, 1);
+	vips_labelregions_resolve(in, label.m, label_stats);
+	segments = label_stats->len;
 
-		m += mask->Xsize;
+	/* Row n is the stats for label n, so row 0 is unused.
+	 */
+	if (!(t[3] = vips_image_new_matrix(LABEL_N_STATS, segments))) {
+		g_array_free(label_stats, TRUE);
+		return -1;
+	}
+	stats = t[3];
+
+	for (i = 0; i < LABEL_N_STATS; i++)
+		*VIPS_MATRIX(stats, i, 0) = 0.0;
+
+	for (i = 1; i < segments; i++) {
+		LabelStats *s = &g_array_index(label_stats, LabelStats, i);
+
+		*VIPS_MATRIX(stats, 0, i) = s->area;
+		*VIPS_MATRIX(stats, 1, i) = s->left;
+		*VIPS_MATRIX(stats, 2, i) = s->top;
+		*VIPS_MATRIX(stats, 3, i) = s->right - s->left + 1;
+		*VIPS_MATRIX(stats, 4, i) = s->bottom - s->top + 1;
+		*VIPS_MATRIX(stats, 5, i) = s->sx / s->area;
+		*VIPS_MATRIX(stats, 6, i) = s->sy / s->area;
 	}
 
+	g_array_free(label_stats, TRUE);
+
 	g_object_set(object,
+		"mask", mask,
 		"segments", segments,
+		"stats", stats,
 		NULL);
 
 	return 0;
@@ -132,7 +406,13 @@ vips_labelregions_class_init(VipsLabelregionsClass *class)
 		_("Number of discrete contiguous regions"),
 		VIPS_ARGUMENT_OPTIONAL_OUTPUT,
 		G_STRUCT_OFFSET(VipsLabelregions, segments),
-		0, 1000000000, 0);
+		0, INT_MAX, 0);
+
+	VIPS_ARG_IMAGE(class, "stats", 4,
+		_("Stats"),
+		_("Area, bounding box and centroid of each region"),
+		VIPS_ARGUMENT_OPTIONAL_OUTPUT,
+		G_STRUCT_OFFSET(VipsLabelregions, stats));
 }
 
 static void
@@ -148,11 +428,20 @@ vips_labelregions_init(VipsLabelregions *labelregions)
  *
  * Label regions of equal pixels in an image.
  *
- * Repeatedly scans @in for regions of 4-connected pixels
- * with the same pixel value. Every time a region is discovered, those
- * pixels are marked in @mask with a unique serial number. Once all pixels
- * have been labelled, the operation returns, setting @segments to the number
- * of discrete regions which were detected.
+ * Scans @in for regions of 4-connected pixels
+ * with the same pixel value. Each region is marked in @mask with a unique
+ * serial number, starting from 1, numbered in the order in which the first
+ * pixel of each region appears in a top-to-bottom, left-to-right scan.
+ * @segments is set to one more than the number of discrete regions which
+ * were detected.
+ *
+ * Regions are found with a two-pass union-find algorithm. Tiles are labelled
+ * in parallel, joined along their edges, and the labels are then resolved in a
+ * final pass.
+ *
+ * @stats is set to a matrix with one row for each label. Row n has the
+ * area, left, top, width, height, x centroid and y centroid of region n. Row
+ * 0 is unused.
  *
  * @mask is always a 1-band [enum@Vips.BandFormat.INT] image of the same
  * dimensions as @in.
@@ -165,6 +454,8 @@ vips_labelregions_init(VipsLabelregions *labelregions)
  *
  * ::: tip "Optional arguments"
  *     * @segments: `gint`, output, number of regions found
+ *     * @stats: [class@Image], output, area, bounding box and centroid of each
+ *       region
  *
  * ::: seealso
  *     [method@Image.hist_find_indexed].
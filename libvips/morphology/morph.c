@@ -26,6 +26,8 @@
  * 25/2/20 kleisauke
  * 	- rewritten as a class
  * 	- merged with hitmiss
+ * 18/10/26
+ * 	- use van Herk/Gil-Werman for large rectangular masks
  */
 
 /*
@@ -66,6 +68,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <limits.h>
 
 #include <vips/vips.h>
@@ -107,6 +110,11 @@ typedef struct {
 } Pass;
 #endif /*HAVE_ORC*/
 
+/* Solid rectangles with at least this many elements use van Herk/Gil-Werman
+ * rather than visiting every mask element.
+ */
+#define VHGW_MIN_POINTS (49)
+
 /**
  * VipsOperationMorphology:
  * @VIPS_OPERATION_MORPHOLOGY_ERODE: true if all set
@@ -133,6 +141,12 @@ typedef struct {
 
 	guint8 *coeff; /* Mask coefficients */
 
+	/* Set if the mask is a solid rectangle of 255, perhaps with a border
+	 * of don't-care elements, and box is the rectangle within the mask.
+	 */
+	gboolean rect;
+	VipsRect box;
+
 #ifdef HAVE_ORC
 	/* The passes we generate for this mask.
 	 */
@@ -157,6 +171,11 @@ typedef struct {
 
 	int last_bpl; /* Avoid recalcing offsets, if we can */
 
+	/* Scratch for the van Herk/Gil-Werman path.
+	 */
+	VipsPel *vhgw;
+	size_t vhgw_size;
+
 #ifdef HAVE_ORC
 	/* In vector mode we need a pair of intermediate buffers to keep the
 	 * results of each pass in.
@@ -188,6 +207,7 @@ vips_morph_stop(void *vseq, void *a, void *b)
 	VipsMorphSequence *seq = (VipsMorphSequence *) vseq;
 
 	VIPS_UNREF(seq->ir);
+	VIPS_FREE(seq->vhgw);
 #ifdef HAVE_ORC
 	VIPS_FREE(seq->t1);
 	VIPS_FREE(seq->t2);
@@ -218,6 +238,8 @@ vips_morph_start(VipsImage *out, void *a, void *b)
 	seq->nn128 = 0;
 	seq->coeff = NULL;
 	seq->last_bpl = -1;
+	seq->vhgw = NULL;
+	seq->vhgw_size = 0;
 #ifdef HAVE_ORC
 	seq->t1 = NULL;
 	seq->t2 = NULL;
@@ -651,6 +673,202 @@ vips_morph_gen_vector(VipsRegion *out_region,
 }
 #endif /*HAVE_HWY*/
 
+/* van Herk/Gil-Werman for solid rectangular masks.
+ *
+ * The mask is separable, so we filter along each line of the input, then
+ * down each column of that. Each 1D filter splits the line into blocks the
+ * size of the window and computes a running AND (or OR) forwards and
+ * backwards within each block. Each output is then a single AND of one value
+ * from each scan, so cost is about three ops per pixel per pass, whatever the
+ * size of the mask.
+ */
+
+#define VHGW_LINE(OP) \
+	{ \
+		int start, i; \
+\
+		for (start = 0; start < ne; start += ke) { \
+			int end = VIPS_MIN(start + ke, ne); \
+\
+			for (i = start; i < start + bands; i++) \
+				pre[i] = p[i]; \
+			for (; i < end; i++) \
+				pre[i] = pre[i - bands] OP p[i]; \
+\
+			for (i = end - 1; i >= end - bands; i--) \
+				suf[i] = p[i]; \
+			for (; i >= start; i--) \
+				suf[i] = suf[i + bands] OP p[i]; \
+		} \
+\
+		for (i = 0; i < sz; i++) \
+			q[i] = suf[i] OP pre[i + ke - bands]; \
+	}
+
+/* Filter a line of sz output elements from sz + (k - 1) * bands input
+ * elements.
+ */
+static void
+vips_morph_vhgw_line(VipsMorph *morph,
+	VipsPel *q, VipsPel *p, int sz, int bands, VipsPel *pre, VipsPel *suf)
+{
+	const int ke = morph->box.width * bands;
+	const int ne = sz + ke - bands;
+
+	if (morph->morph == VIPS_OPERATION_MORPHOLOGY_DILATE)
+		VHGW_LINE(|)
+	else
+		VHGW_LINE(&)
+}
+
+/* q = a OP b, elementwise.
+ */
+static void
+vips_morph_vhgw_combine(VipsMorph *morph,
+	VipsPel *q, VipsPel *a, VipsPel *b, int sz)
+{
+	int i;
+
+#ifdef HAVE_HWY
+	if (vips_vector_isenabled()) {
+		vips_morph_combine_uchar_hwy(q, a, b, sz,
+			morph->morph == VIPS_OPERATION_MORPHOLOGY_DILATE);
+		return;
+	}
+#endif /*HAVE_HWY*/
+
+	if (morph->morph == VIPS_OPERATION_MORPHOLOGY_DILATE)
+		for (i = 0; i < sz; i++)
+			q[i] = a[i] | b[i];
+	else
+		for (i = 0; i < sz; i++)
+			q[i] = a[i] & b[i];
+}
+
+static int
+vips_morph_vhgw_gen(VipsRegion *out_region,
+	void *vseq, void *a, void *b, gboolean *stop)
+{
+	VipsMorphSequence *seq = (VipsMorphSequence *) vseq;
+	VipsMorph *morph = (VipsMorph *) b;
+	VipsRegion *ir = seq->ir;
+	VipsRect *r = &out_region->valid;
+	const int bands = ir->im->Bands;
+	const int sz = VIPS_REGION_N_ELEMENTS(out_region);
+	const int kh = morph->box.height;
+	const int rows = r->height + kh - 1;
+	const int ne = sz + (morph->box.width - 1) * bands;
+	const size_t lsk = sz;
+
+	VipsRect s;
+	size_t size;
+	VipsPel *h, *pre, *lpre, *lsuf;
+	int start, y;
+
+	/* We only need the part of the input under the rectangle, not the
+	 * whole mask.
+	 */
+	s.left = r->left + morph->box.left;
+	s.top = r->top + morph->box.top;
+	s.width = r->width + morph->box.width - 1;
+	s.height = rows;
+	if (vips_region_prepare(ir, &s))
+		return -1;
+
+#ifdef DEBUG_VERBOSE
+	printf("vips_morph_vhgw_gen: preparing %dx%d@%dx%d pixels\n",
+		s.width, s.height, s.left, s.top);
+#endif /*DEBUG_VERBOSE*/
+
+	/* The horizontal result and the vertical forward scan, plus a pair of
+	 * line buffers for the horizontal scans.
+	 */
+	size = 2 * lsk * rows + 2 * (size_t) ne;
+	if (size > seq->vhgw_size) {
+		VIPS_FREE(seq->vhgw);
+		if (!(seq->vhgw = VIPS_ARRAY(NULL, size, VipsPel)))
+			return -1;
+		seq->vhgw_size = size;
+	}
+	h = seq->vhgw;
+	pre = h + lsk * rows;
+	lpre = pre + lsk * rows;
+	lsuf = lpre + ne;
+
+	VIPS_GATE_START("vips_morph_vhgw_gen: work");
+
+	for (y = 0; y < rows; y++)
+		vips_morph_vhgw_line(morph, h + y * lsk,
+			VIPS_REGION_ADDR(ir, s.left, s.top + y),
+			sz, bands, lpre, lsuf);
+
+	/* Now the same down the columns, but a whole line at a time. The
+	 * backwards scan can run in place in h.
+	 */
+	for (start = 0; start < rows; start += kh) {
+		int end = VIPS_MIN(start + kh, rows);
+
+		memcpy(pre + start * lsk, h + start * lsk, lsk);
+		for (y = start + 1; y < end; y++)
+			vips_morph_vhgw_combine(morph, pre + y * lsk,
+				pre + (y - 1) * lsk, h + y * lsk, sz);
+
+		for (y = end - 2; y >= start; y--)
+			vips_morph_vhgw_combine(morph, h + y * lsk,
+				h + (y + 1) * lsk, h + y * lsk, sz);
+	}
+
+	for (y = 0; y < r->height; y++)
+		vips_morph_vhgw_combine(morph,
+			VIPS_REGION_ADDR(out_region, r->left, r->top + y),
+			h + y * lsk, pre + (y + kh - 1) * lsk, sz);
+
+	VIPS_GATE_STOP("vips_morph_vhgw_gen: work");
+
+	VIPS_COUNT_PIXELS(out_region, "vips_morph_vhgw_gen");
+
+	return 0;
+}
+
+/* Is the mask a solid rectangle of 255, perhaps surrounded by don't-care
+ * elements? Set box to the rectangle.
+ */
+static gboolean
+vips_morph_is_rect(VipsMorph *morph)
+{
+	VipsImage *M = morph->M;
+
+	int left, top, right, bottom;
+	int x, y;
+
+	left = M->Xsize;
+	top = M->Ysize;
+	right = -1;
+	bottom = -1;
+	for (y = 0; y < M->Ysize; y++)
+		for (x = 0; x < M->Xsize; x++)
+			if (morph->coeff[x + y * M->Xsize] != 128) {
+				left = VIPS_MIN(left, x);
+				top = VIPS_MIN(top, y);
+				right = VIPS_MAX(right, x);
+				bottom = VIPS_MAX(bottom, y);
+			}
+	if (right < 0)
+		return FALSE;
+
+	for (y = top; y <= bottom; y++)
+		for (x = left; x <= right; x++)
+			if (morph->coeff[x + y * M->Xsize] != 255)
+				return FALSE;
+
+	morph->box.left = left;
+	morph->box.top = top;
+	morph->box.width = right - left + 1;
+	morph->box.height = bottom - top + 1;
+
+	return TRUE;
+}
+
 /* Dilate!
  */
 static int
@@ -891,6 +1109,17 @@ vips_morph_build(VipsObject *object)
 		morph->coeff[i] = (guint8) coeff[i];
 	}
 
+	/* Large solid rectangles (and lines) are separable and can use
+	 * van Herk/Gil-Werman.
+	 */
+	morph->rect = vips_morph_is_rect(morph) &&
+		morph->box.width * morph->box.height >= VHGW_MIN_POINTS;
+
+	if (morph->rect) {
+		generate = vips_morph_vhgw_gen;
+		g_info("morph: using van Herk/Gil-Werman path");
+	}
+	else
 	/* Try to make a vector path.
 	 */
 #ifdef HAVE_HWY
@@ -1021,6 +1250,11 @@ vips_morph_init(VipsMorph *morph)
  * and [method@Image.eorimage]
  * for analogues of the usual set difference and set union operations.
  *
+ * Masks which are a solid rectangle of 255 (perhaps surrounded by 128), for
+ * example a horizontal or vertical line, or a square, are decomposed into a
+ * horizontal and a vertical pass and computed with the van Herk/Gil-Werman
+ * algorithm. Cost is then independent of the mask size.
+ *
  * Operations are performed using the processor's vector unit,
  * if possible. Disable this with `--vips-novector` or `VIPS_NOVECTOR` or
  * [func@vector_set_enabled].
@@ -2,6 +2,8 @@
  * 	- initial implementation
  * 20/08/23 kleisauke
  * 	- speed-up implementation
+ * 18/10/26
+ * 	- add vips_morph_combine_uchar_hwy() for van Herk/Gil-Werman
  */
 
 /*
@@ -168,11 +170,35 @@ vips_erode_uchar_hwy(VipsRegion *out_region, VipsRegion *ir, VipsRect *r,
 	}
 }
 
+HWY_ATTR void
+vips_morph_combine_uchar_hwy(uint8_t *q,
+	const uint8_t *a, const uint8_t *b, int32_t sz, int32_t dilate)
+{
+	HWY_LANES_CONSTEXPR int32_t N = Lanes(du8);
+
+	/* q may alias a or b, so no HWY_RESTRICT.
+	 */
+	int32_t x = 0;
+	if (dilate)
+		for (; x + N <= sz; x += N)
+			StoreU(Or(LoadU(du8, a + x), LoadU(du8, b + x)), du8, q + x);
+	else
+		for (; x + N <= sz; x += N)
+			StoreU(And(LoadU(du8, a + x), LoadU(du8, b + x)), du8, q + x);
+
+	/* `sz` was not a multiple of the vector length `N`;
+	 * proceed one by one.
+	 */
+	for (; x < sz; ++x)
+		q[x] = dilate ? a[x] | b[x] : a[x] & b[x];
+}
+
 } /*namespace HWY_NAMESPACE*/
 
 #if HWY_ONCE
 HWY_EXPORT(vips_dilate_uchar_hwy);
 HWY_EXPORT(vips_erode_uchar_hwy);
+HWY_EXPORT(vips_morph_combine_uchar_hwy);
 
 void
 vips_dilate_uchar_hwy(VipsRegion *out_region, VipsRegion *ir, VipsRect *r,
@@ -193,6 +219,16 @@ vips_erode_uchar_hwy(VipsRegion *out_region, VipsRegion *ir, VipsRect *r,
 		nn128, offsets, coeff);
 	/* clang-format on */
 }
+
+void
+vips_morph_combine_uchar_hwy(guint8 *q, guint8 *a, guint8 *b,
+	int sz, gboolean dilate)
+{
+	/* clang-format off */
+	HWY_DYNAMIC_DISPATCH(vips_morph_combine_uchar_hwy)(q, a, b, sz,
+		dilate);
+	/* clang-format on */
+}
 #endif /*HWY_ONCE*/
 
 #endif /*HAVE_HWY*/
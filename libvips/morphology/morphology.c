@@ -93,10 +93,12 @@ vips_morphology_operation_init(void)
 	extern GType vips_countlines_get_type(void);
 	extern GType vips_labelregions_get_type(void);
 	extern GType vips_fill_nearest_get_type(void);
+	extern GType vips_distance_get_type(void);
 
 	vips_morph_get_type();
 	vips_rank_get_type();
 	vips_countlines_get_type();
 	vips_labelregions_get_type();
 	vips_fill_nearest_get_type();
+	vips_distance_get_type();
 }
@@ -71,6 +71,9 @@ void vips_dilate_uchar_hwy(VipsRegion *out_region, VipsRegion *ir, VipsRect *r,
 void vips_erode_uchar_hwy(VipsRegion *out_region, VipsRegion *ir, VipsRect *r,
 	int sz, int nn128, int *restrict offsets, guint8 *restrict coeff);
 
+void vips_morph_combine_uchar_hwy(guint8 *q, guint8 *a, guint8 *b,
+	int sz, gboolean dilate);
+
 #ifdef __cplusplus
 }
 #endif /*__cplusplus*/
@@ -17,6 +17,8 @@
  * 	- gtk-doc
  * 18/6/20 kleisauke
  * 	- convert to vips8
+ * 18/10/26
+ * 	- search for tie points in parallel
  */
 
 /*
@@ -182,16 +184,79 @@ vips__correl(VipsImage *ref, VipsImage *sec,
 	return 0;
 }
 
-int
-vips__chkpair(VipsImage *ref, VipsImage *sec, TiePoints *points)
-{
+/* Our state during a tie point search.
+ */
+typedef struct _ChkpairScan {
+	VipsImage *ref;
+	VipsImage *sec;
+	TiePoints *points;
+
+	/* Allocate the next point here.
+	 */
 	int i;
-	int x, y;
-	double correlation;
+} ChkpairScan;
+
+static int
+vips_chkpair_allocate(VipsThreadState *state, void *a, gboolean *stop)
+{
+	ChkpairScan *scan = (ChkpairScan *) a;
 
+	if (scan->i >= scan->points->nopoints) {
+		*stop = TRUE;
+		return 0;
+	}
+
+	state->x = scan->i;
+	scan->i += 1;
+
+	return 0;
+}
+
+/* Search for one point. Each point writes only its own slots, so there's no
+ * need to lock.
+ */
+static int
+vips_chkpair_work(VipsThreadState *state, void *a)
+{
+	ChkpairScan *scan = (ChkpairScan *) a;
+	TiePoints *points = scan->points;
+	int i = state->x;
 	const int hcor = points->halfcorsize;
 	const int harea = points->halfareasize;
 
+	int x, y;
+	double correlation;
+
+	/* Find correlation point.
+	 */
+	if (vips__correl(scan->ref, scan->sec,
+			points->x_reference[i], points->y_reference[i],
+			points->x_reference[i], points->y_reference[i],
+			hcor, harea,
+			&correlation, &x, &y))
+		return -1;
+
+	/* And note in x_secondary.
+	 */
+	points->x_secondary[i] = x;
+	points->y_secondary[i] = y;
+	points->correlation[i] = correlation;
+
+	/* Note each dx, dy too.
+	 */
+	points->dx[i] =
+		points->x_secondary[i] - points->x_reference[i];
+	points->dy[i] =
+		points->y_secondary[i] - points->y_reference[i];
+
+	return 0;
+}
+
+int
+vips__chkpair(VipsImage *ref, VipsImage *sec, TiePoints *points)
+{
+	ChkpairScan scan;
+
 	/* Check images.
 	 */
 	if (vips_image_wio_input(ref) || vips_image_wio_input(sec))
@@ -206,29 +271,19 @@ vips__chkpair(VipsImage *ref, VipsImage *sec, TiePoints *points)
 		return -1;
 	}
 
-	for (i = 0; i < points->nopoints; i++) {
-		/* Find correlation point.
-		 */
-		if (vips__correl(ref, sec,
-				points->x_reference[i], points->y_reference[i],
-				points->x_reference[i], points->y_reference[i],
-				hcor, harea,
-				&correlation, &x, &y))
-			return -1;
-
-		/* And note in x_secondary.
-		 */
-		points->x_secondary[i] = x;
-		points->y_secondary[i] = y;
-		points->correlation[i] = correlation;
-
-		/* Note each dx, dy too.
-		 */
-		points->dx[i] =
-			points->x_secondary[i] - points->x_reference[i];
-		points->dy[i] =
-			points->y_secondary[i] - points->y_reference[i];
-	}
+	/* The points are independent, so search for them on the threadpool.
+	 */
+	scan.ref = ref;
+	scan.sec = sec;
+	scan.points = points;
+	scan.i = 0;
+	if (vips_threadpool_run(ref,
+			vips_thread_state_new,
+			vips_chkpair_allocate,
+			vips_chkpair_work,
+			NULL,
+			&scan))
+		return -1;
 
 	return 0;
 }
@@ -0,0 +1,796 @@
+/* merge an array of placed images in a single pass
+ *
+ * 18/10/26
+ * 	- from merge.c and arrayjoin.c
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+/*
+#define DEBUG
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vips/vips.h>
+#include <vips/internal.h>
+#include <vips/debug.h>
+
+#include "pmosaicing.h"
+
+/* Size of the cells in the spatial index.
+ */
+#define MERGEARRAY_CELL_SIZE (512)
+
+typedef struct _VipsMergearray {
+	VipsOperation parent_instance;
+
+	VipsArrayImage *in;
+	VipsImage *out;
+	VipsArrayInt *x;
+	VipsArrayInt *y;
+	int mblend;
+
+	/* Inputs, cast to a common format and number of bands, and the
+	 * position of each one in the output.
+	 */
+	VipsImage **ready;
+	VipsRect *rects;
+	int n;
+
+	/* A grid of cells over the output, with the inputs touching each cell
+	 * packed into index. Cell i has entries start[i] to start[i + 1].
+	 */
+	int cells_across;
+	int cells_down;
+	int *start;
+	int *index;
+
+} VipsMergearray;
+
+typedef VipsOperationClass VipsMergearrayClass;
+
+G_DEFINE_TYPE(VipsMergearray, vips_mergearray, VIPS_TYPE_OPERATION);
+
+/* Our per-thread state.
+ */
+typedef struct _VipsMergearraySequence {
+	VipsMergearray *mergearray;
+
+	/* A region on each input, made the first time this thread needs it.
+	 */
+	VipsRegion **ir;
+
+	/* Inputs which touch the current region.
+	 */
+	int *hit;
+	int n_hit;
+
+	/* Mark inputs we've seen for this region with stamp, since they can
+	 * appear in more than one cell.
+	 */
+	int *seen;
+	int stamp;
+
+	/* Per-pixel weighted sums and total weight, plus the weight for each
+	 * column and row of the current input.
+	 */
+	double *sum;
+	double *weight;
+	double *wx;
+	double *wy;
+	int size;
+	int width;
+	int height;
+} VipsMergearraySequence;
+
+static int
+vips_mergearray_stop(void *vseq, void *a, void *b)
+{
+	VipsMergearraySequence *seq = (VipsMergearraySequence *) vseq;
+
+	if (seq->ir) {
+		int i;
+
+		for (i = 0; i < seq->mergearray->n; i++)
+			VIPS_UNREF(seq->ir[i]);
+		VIPS_FREE(seq->ir);
+	}
+	VIPS_FREE(seq->hit);
+	VIPS_FREE(seq->seen);
+	VIPS_FREE(seq->sum);
+	VIPS_FREE(seq->weight);
+	VIPS_FREE(seq->wx);
+	VIPS_FREE(seq->wy);
+	VIPS_FREE(seq);
+
+	return 0;
+}
+
+static void *
+vips_mergearray_start(VipsImage *out, void *a, void *b)
+{
+	VipsMergearray *mergearray = (VipsMergearray *) b;
+
+	VipsMergearraySequence *seq;
+
+	if (!(seq = VIPS_NEW(NULL, VipsMergearraySequence)))
+		return NULL;
+
+	seq->mergearray = mergearray;
+	seq->ir = VIPS_ARRAY(NULL, mergearray->n, VipsRegion *);
+	if (seq->ir)
+		memset(seq->ir, 0, mergearray->n * sizeof(VipsRegion *));
+	seq->hit = VIPS_ARRAY(NULL, mergearray->n, int);
+	seq->n_hit = 0;
+	seq->seen = VIPS_ARRAY(NULL, mergearray->n, int);
+	seq->stamp = 0;
+	seq->sum = NULL;
+	seq->weight = NULL;
+	seq->wx = NULL;
+	seq->wy = NULL;
+	seq->size = 0;
+	seq->width = 0;
+	seq->height = 0;
+
+	if (!seq->ir ||
+		!seq->hit ||
+		!seq->seen) {
+		vips_mergearray_stop(seq, NULL, NULL);
+		return NULL;
+	}
+	memset(seq->seen, 0, mergearray->n * sizeof(int));
+
+	return seq;
+}
+
+/* The region on input i for this thread. We can have thousands of inputs,
+ * so only make regions on the ones a thread actually touches.
+ */
+static VipsRegion *
+vips_mergearray_input(VipsMergearraySequence *seq, int i)
+{
+	if (!seq->ir[i])
+		seq->ir[i] = vips_region_new(seq->mergearray->ready[i]);
+
+	return seq->ir[i];
+}
+
+/* Make sure the accumulators can hold r.
+ */
+static int
+vips_mergearray_sequence_alloc(VipsMergearraySequence *seq, VipsRect *r)
+{
+	int bands = seq->mergearray->out->Bands;
+	int size = r->width * r->height;
+
+	if (size > seq->size) {
+		VIPS_FREE(seq->sum);
+		VIPS_FREE(seq->weight);
+		if (!(seq->sum = VIPS_ARRAY(NULL, size * bands, double)) ||
+			!(seq->weight = VIPS_ARRAY(NULL, size, double)))
+			return -1;
+		seq->size = size;
+	}
+
+	if (r->width > seq->width) {
+		VIPS_FREE(seq->wx);
+		if (!(seq->wx = VIPS_ARRAY(NULL, r->width, double)))
+			return -1;
+		seq->width = r->width;
+	}
+
+	if (r->height > seq->height) {
+		VIPS_FREE(seq->wy);
+		if (!(seq->wy = VIPS_ARRAY(NULL, r->height, double)))
+			return -1;
+		seq->height = r->height;
+	}
+
+	return 0;
+}
+
+/* The range of cells a rect touches, in cell coordinates.
+ */
+static void
+vips_mergearray_cells(VipsRect *rect, VipsRect *cells)
+{
+	cells->left = rect->left / MERGEARRAY_CELL_SIZE;
+	cells->top = rect->top / MERGEARRAY_CELL_SIZE;
+	cells->width = (VIPS_RECT_RIGHT(rect) - 1) / MERGEARRAY_CELL_SIZE -
+		cells->left + 1;
+	cells->height = (VIPS_RECT_BOTTOM(rect) - 1) / MERGEARRAY_CELL_SIZE -
+		cells->top + 1;
+}
+
+static int
+vips_mergearray_compare(const void *a, const void *b)
+{
+	return *((int *) a) - *((int *) b);
+}
+
+/* Find the inputs which touch r from the cells it covers.
+ */
+static void
+vips_mergearray_find(VipsMergearraySequence *seq, VipsRect *r)
+{
+	VipsMergearray *mergearray = seq->mergearray;
+
+	VipsRect cells;
+	int cx, cy, j;
+
+	vips_mergearray_cells(r, &cells);
+	seq->stamp += 1;
+	seq->n_hit = 0;
+
+	for (cy = cells.top; cy < VIPS_RECT_BOTTOM(&cells); cy++)
+		for (cx = cells.left; cx < VIPS_RECT_RIGHT(&cells); cx++) {
+			int c = cx + cy * mergearray->cells_across;
+
+			for (j = mergearray->start[c];
+				 j < mergearray->start[c + 1]; j++) {
+				int i = mergearray->index[j];
+
+				if (seq->seen[i] != seq->stamp) {
+					seq->seen[i] = seq->stamp;
+					if (vips_rect_overlapsrect(
+							&mergearray->rects[i], r))
+						seq->hit[seq->n_hit++] = i;
+				}
+			}
+		}
+
+	/* Always blend in input order, so the result doesn't depend on the
+	 * cell layout.
+	 */
+	qsort(seq->hit, seq->n_hit, sizeof(int), vips_mergearray_compare);
+}
+
+/* Weight for a pixel d pixels in from the nearest edge of its image: a raised
+ * cosine over the first mblend pixels. Edge pixels get a small weight so that
+ * areas covered by just one image are never zero.
+ */
+static double
+vips_mergearray_ramp(VipsMergearray *mergearray, int d)
+{
+	int i;
+
+	if (d >= mergearray->mblend)
+		return 1.0;
+
+	i = (d + 1) * (BLEND_SIZE - 1) / (mergearray->mblend + 1);
+
+	return vips__coef2[VIPS_MAX(1, i)];
+}
+
+/* Add the nonzero pixels of ir, weighted, to the accumulators. Pixels with all
+ * bands zero are transparent, as in merge.
+ */
+#define ACCUMULATE(TYPE) \
+	{ \
+		for (y = 0; y < clip.height; y++) { \
+			TYPE *restrict p = (TYPE *) VIPS_REGION_ADDR(ir, \
+				clip.left - rect->left, clip.top - rect->top + y); \
+			int o = (clip.top - r->top + y) * r->width + \
+				clip.left - r->left; \
+			double *restrict s = seq->sum + o * bands; \
+			double *restrict w = seq->weight + o; \
+			double wy = seq->wy[y]; \
+\
+			for (x = 0; x < clip.width; x++) { \
+				gboolean nonzero; \
+\
+				nonzero = FALSE; \
+				for (k = 0; k < bands; k++) \
+					if (p[k]) \
+						nonzero = TRUE; \
+\
+				if (nonzero) { \
+					double wt = seq->wx[x] * wy; \
+\
+					for (k = 0; k < bands; k++) \
+						s[k] += wt * p[k]; \
+					w[x] += wt; \
+				} \
+\
+				p += bands; \
+				s += bands; \
+			} \
+		} \
+	}
+
+#define WRITE(TYPE, ROUND) \
+	{ \
+		for (y = 0; y < r->height; y++) { \
+			TYPE *restrict q = (TYPE *) \
+				VIPS_REGION_ADDR(out_region, r->left, r->top + y); \
+			double *restrict s = seq->sum + y * r->width * bands; \
+			double *restrict w = seq->weight + y * r->width; \
+\
+			for (x = 0; x < r->width; x++) { \
+				if (w[x] > 0.0) \
+					for (k = 0; k < bands; k++) \
+						q[k] = ROUND(s[k] / w[x]); \
+				else \
+					for (k = 0; k < bands; k++) \
+						q[k] = 0; \
+\
+				q += bands; \
+				s += bands; \
+			} \
+		} \
+	}
+
+#define NOROUND(V) (V)
+
+static int
+vips_mergearray_blend(VipsMergearraySequence *seq, VipsRegion *out_region)
+{
+	VipsMergearray *mergearray = seq->mergearray;
+	VipsRect *r = &out_region->valid;
+	int bands = out_region->im->Bands;
+
+	int i, j, x, y, k;
+
+	if (vips_mergearray_sequence_alloc(seq, r))
+		return -1;
+	memset(seq->sum, 0, r->width * r->height * bands * sizeof(double));
+	memset(seq->weight, 0, r->width * r->height * sizeof(double));
+
+	for (i = 0; i < seq->n_hit; i++) {
+		VipsRect *rect = &mergearray->rects[seq->hit[i]];
+
+		VipsRect clip;
+		VipsRect need;
+		VipsRegion *ir;
+
+		vips_rect_intersectrect(r, rect, &clip);
+		need = clip;
+		need.left -= rect->left;
+		need.top -= rect->top;
+
+		if (!(ir = vips_mergearray_input(seq, seq->hit[i])) ||
+			vips_region_prepare(ir, &need))
+			return -1;
+
+		for (x = 0; x < clip.width; x++) {
+			int d = clip.left - rect->left + x;
+
+			j = VIPS_MIN(d, rect->width - 1 - d);
+			seq->wx[x] = vips_mergearray_ramp(mergearray, j);
+		}
+		for (y = 0; y < clip.height; y++) {
+			int d = clip.top - rect->top + y;
+
+			j = VIPS_MIN(d, rect->height - 1 - d);
+			seq->wy[y] = vips_mergearray_ramp(mergearray, j);
+		}
+
+		switch (out_region->im->BandFmt) {
+		case VIPS_FORMAT_UCHAR:
+			ACCUMULATE(unsigned char);
+			break;
+
+		case VIPS_FORMAT_CHAR:
+			ACCUMULATE(signed char);
+			break;
+
+		case VIPS_FORMAT_USHORT:
+			ACCUMULATE(unsigned short);
+			break;
+
+		case VIPS_FORMAT_SHORT:
+			ACCUMULATE(signed short);
+			break;
+
+		case VIPS_FORMAT_UINT:
+			ACCUMULATE(unsigned int);
+			break;
+
+		case VIPS_FORMAT_INT:
+			ACCUMULATE(signed int);
+			break;
+
+		case VIPS_FORMAT_FLOAT:
+			ACCUMULATE(float);
+			break;
+
+		case VIPS_FORMAT_DOUBLE:
+			ACCUMULATE(double);
+			break;
+
+		default:
+			g_assert_not_reached();
+		}
+	}
+
+	switch (out_region->im->BandFmt) {
+	case VIPS_FORMAT_UCHAR:
+		WRITE(unsigned char, VIPS_RINT);
+		break;
+
+	case VIPS_FORMAT_CHAR:
+		WRITE(signed char, VIPS_RINT);
+		break;
+
+	case VIPS_FORMAT_USHORT:
+		WRITE(unsigned short, VIPS_RINT);
+		break;
+
+	case VIPS_FORMAT_SHORT:
+		WRITE(signed short, VIPS_RINT);
+		break;
+
+	case VIPS_FORMAT_UINT:
+		WRITE(unsigned int, VIPS_RINT);
+		break;
+
+	case VIPS_FORMAT_INT:
+		WRITE(signed int, VIPS_RINT);
+		break;
+
+	case VIPS_FORMAT_FLOAT:
+		WRITE(float, NOROUND);
+		break;
+
+	case VIPS_FORMAT_DOUBLE:
+		WRITE(double, NOROUND);
+		break;
+
+	default:
+		g_assert_not_reached();
+	}
+
+	return 0;
+}
+
+static int
+vips_mergearray_gen(VipsRegion *out_region,
+	void *vseq, void *a, void *b, gboolean *stop)
+{
+	VipsMergearraySequence *seq = (VipsMergearraySequence *) vseq;
+	VipsMergearray *mergearray = (VipsMergearray *) b;
+	VipsRect *r = &out_region->valid;
+
+	vips_mergearray_find(seq, r);
+
+	VIPS_DEBUG_MSG("vips_mergearray_gen: %d inputs for "
+				   "left = %d, top = %d, width = %d, height = %d\n",
+		seq->n_hit, r->left, r->top, r->width, r->height);
+
+	if (seq->n_hit == 0)
+		vips_region_black(out_region);
+	else if (seq->n_hit == 1 &&
+		vips_rect_includesrect(&mergearray->rects[seq->hit[0]], r)) {
+		/* Just one input covers the whole region, so the weights
+		 * cancel and we can copy it straight through.
+		 */
+		VipsRect *rect = &mergearray->rects[seq->hit[0]];
+
+		VipsRect need;
+		VipsRegion *ir;
+
+		need = *r;
+		need.left -= rect->left;
+		need.top -= rect->top;
+
+		if (!(ir = vips_mergearray_input(seq, seq->hit[0])) ||
+			vips_region_prepare_to(ir, out_region,
+				&need, r->left, r->top))
+			return -1;
+	}
+	else if (vips_mergearray_blend(seq, out_region))
+		return -1;
+
+	return 0;
+}
+
+/* Build the spatial index: count the inputs in each cell, turn the counts
+ * into offsets, then fill.
+ */
+static int
+vips_mergearray_index(VipsMergearray *mergearray)
+{
+	VipsObject *object = VIPS_OBJECT(mergearray);
+	int across = mergearray->cells_across;
+	int n_cells = across * mergearray->cells_down;
+
+	int *fill;
+	int i, c, cx, cy;
+
+	if (!(mergearray->start = VIPS_ARRAY(object, n_cells + 1, int)) ||
+		!(fill = VIPS_ARRAY(object, n_cells, int)))
+		return -1;
+	memset(mergearray->start, 0, (n_cells + 1) * sizeof(int));
+
+	for (i = 0; i < mergearray->n; i++) {
+		VipsRect cells;
+
+		vips_mergearray_cells(&mergearray->rects[i], &cells);
+		for (cy = cells.top; cy < VIPS_RECT_BOTTOM(&cells); cy++)
+			for (cx = cells.left; cx < VIPS_RECT_RIGHT(&cells); cx++)
+				mergearray->start[cx + cy * across + 1] += 1;
+	}
+
+	for (c = 0; c < n_cells; c++) {
+		mergearray->start[c + 1] += mergearray->start[c];
+		fill[c] = mergearray->start[c];
+	}
+
+	if (!(mergearray->index =
+				VIPS_ARRAY(object, mergearray->start[n_cells] + 1, int)))
+		return -1;
+
+	for (i = 0; i < mergearray->n; i++) {
+		VipsRect cells;
+
+		vips_mergearray_cells(&mergearray->rects[i], &cells);
+		for (cy = cells.top; cy < VIPS_RECT_BOTTOM(&cells); cy++)
+			for (cx = cells.left; cx < VIPS_RECT_RIGHT(&cells); cx++) {
+				c = cx + cy * across;
+				mergearray->index[fill[c]++] = i;
+			}
+	}
+
+	return 0;
+}
+
+static int
+vips_mergearray_build(VipsObject *object)
+{
+	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(object);
+	VipsMergearray *mergearray = (VipsMergearray *) object;
+
+	VipsImage **in;
+	VipsImage **format;
+	VipsImage **band;
+	int *x;
+	int *y;
+	int n, nx, ny;
+	int left, top, right, bottom;
+	int i;
+
+	if (VIPS_OBJECT_CLASS(vips_mergearray_parent_class)->build(object))
+		return -1;
+
+	in = vips_array_image_get(mergearray->in, &n);
+	/* Array length zero means error.
+	 */
+	if (n == 0)
+		return -1;
+
+	x = vips_array_int_get(mergearray->x, &nx);
+	y = vips_array_int_get(mergearray->y, &ny);
+	if (nx != n ||
+		ny != n) {
+		vips_error(class->nickname,
+			_("must be %d x and y coordinates"), n);
+		return -1;
+	}
+
+	for (i = 0; i < n; i++)
+		if (vips_image_pio_input(in[i]) ||
+			vips_check_uncoded(class->nickname, in[i]) ||
+			vips_check_noncomplex(class->nickname, in[i]))
+			return -1;
+
+	/* Move all input images to a common format and number of bands.
+	 */
+	format = (VipsImage **) vips_object_local_array(object, n);
+	if (vips__formatalike_vec(in, format, n))
+		return -1;
+	in = format;
+
+	band = (VipsImage **) vips_object_local_array(object, n);
+	if (vips__bandalike_vec(class->nickname, in, band, n, 0))
+		return -1;
+	in = band;
+
+	/* The output is the bounding box of all the inputs.
+	 */
+	left = x[0];
+	top = y[0];
+	right = x[0] + in[0]->Xsize;
+	bottom = y[0] + in[0]->Ysize;
+	for (i = 1; i < n; i++) {
+		left = VIPS_MIN(left, x[i]);
+		top = VIPS_MIN(top, y[i]);
+		right = VIPS_MAX(right, x[i] + in[i]->Xsize);
+		bottom = VIPS_MAX(bottom, y[i] + in[i]->Ysize);
+	}
+
+	mergearray->ready = in;
+	mergearray->n = n;
+	if (!(mergearray->rects = VIPS_ARRAY(object, n, VipsRect)))
+		return -1;
+	for (i = 0; i < n; i++) {
+		mergearray->rects[i].left = x[i] - left;
+		mergearray->rects[i].top = y[i] - top;
+		mergearray->rects[i].width = in[i]->Xsize;
+		mergearray->rects[i].height = in[i]->Ysize;
+	}
+
+	mergearray->cells_across =
+		VIPS_ROUND_UP(right - left, MERGEARRAY_CELL_SIZE) /
+		MERGEARRAY_CELL_SIZE;
+	mergearray->cells_down =
+		VIPS_ROUND_UP(bottom - top, MERGEARRAY_CELL_SIZE) /
+		MERGEARRAY_CELL_SIZE;
+	if (vips_mergearray_index(mergearray))
+		return -1;
+
+	if (vips__make_blend_luts())
+		return -1;
+
+	g_object_set(mergearray, "out", vips_image_new(), NULL);
+
+	if (vips_image_pipeline_array(mergearray->out,
+			VIPS_DEMAND_STYLE_SMALLTILE, in))
+		return -1;
+
+	mergearray->out->Xsize = right - left;
+	mergearray->out->Ysize = bottom - top;
+	mergearray->out->Xoffset = -left;
+	mergearray->out->Yoffset = -top;
+
+	/* Don't use start_many -- there can be thousands of inputs and we
+	 * only want regions on the few which touch each tile.
+	 */
+	if (vips_image_generate(mergearray->out,
+			vips_mergearray_start, vips_mergearray_gen,
+			vips_mergearray_stop, in, mergearray))
+		return -1;
+
+	return 0;
+}
+
+static void
+vips_mergearray_class_init(VipsMergearrayClass *class)
+{
+	GObjectClass *gobject_class = G_OBJECT_CLASS(class);
+	VipsObjectClass *object_class = (VipsObjectClass *) class;
+	VipsOperationClass *operation_class = VIPS_OPERATION_CLASS(class);
+
+	gobject_class->set_property = vips_object_set_property;
+	gobject_class->get_property = vips_object_get_property;
+
+	object_class->nickname = "mergearray";
+	object_class->description = _("merge an array of placed images");
+	object_class->build = vips_mergearray_build;
+
+	operation_class->flags = VIPS_OPERATION_SEQUENTIAL;
+
+	VIPS_ARG_BOXED(class, "in", 0,
+		_("Input"),
+		_("Array of input images"),
+		VIPS_ARGUMENT_REQUIRED_INPUT,
+		G_STRUCT_OFFSET(VipsMergearray, in),
+		VIPS_TYPE_ARRAY_IMAGE);
+
+	VIPS_ARG_IMAGE(class, "out", 1,
+		_("Output"),
+		_("Output image"),
+		VIPS_ARGUMENT_REQUIRED_OUTPUT,
+		G_STRUCT_OFFSET(VipsMergearray, out));
+
+	VIPS_ARG_BOXED(class, "x", 2,
+		_("x coordinates"),
+		_("Array of x coordinates to place each image at"),
+		VIPS_ARGUMENT_REQUIRED_INPUT,
+		G_STRUCT_OFFSET(VipsMergearray, x),
+		VIPS_TYPE_ARRAY_INT);
+
+	VIPS_ARG_BOXED(class, "y", 3,
+		_("y coordinates"),
+		_("Array of y coordinates to place each image at"),
+		VIPS_ARGUMENT_REQUIRED_INPUT,
+		G_STRUCT_OFFSET(VipsMergearray, y),
+		VIPS_TYPE_ARRAY_INT);
+
+	VIPS_ARG_INT(class, "mblend", 4,
+		_("Max blend"),
+		_("Maximum blend size"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsMergearray, mblend),
+		0, 10000, 10);
+}
+
+static void
+vips_mergearray_init(VipsMergearray *mergearray)
+{
+	mergearray->mblend = 10;
+}
+
+/**
+ * vips_mergearray:
+ * @in: (array length=n) (transfer none): array of input images
+ * @out: (out): output image
+ * @n: number of input images
+ * @x: (array length=n): x position of each image
+ * @y: (array length=n): y position of each image
+ * @...: `NULL`-terminated list of optional named arguments
+ *
+ * Merge an array of images in a single operation. Image i is placed with
+ * its top-left corner at (@x[i], @y[i]), and @out is the bounding box of all
+ * the images, with its offset set to the position of the origin.
+ *
+ * Each output tile is made from just the images which overlap it, found
+ * with a spatial index, so this is much faster than a tree of
+ * [method@Image.merge] for large mosaics.
+ *
+ * Where images overlap, they are blended with a raised cosine over
+ * @mblend pixels in from the edge of each image. An @mblend of 0 averages
+ * overlapping pixels.
+ *
+ * Pixels with all bands equal to zero are "transparent", that
+ * is, zero pixels in the overlap area do not contribute to the merge.
+ *
+ * The input images are cast up to the smallest common type and number of
+ * bands, see [method@Image.merge].
+ *
+ * Unlike [method@Image.merge], the output cannot be rebalanced with
+ * [method@Image.globalbalance].
+ *
+ * ::: tip "Optional arguments"
+ *     * @mblend: `gint`, maximum blend size
+ *
+ * ::: seealso
+ *     [method@Image.merge], [func@Image.arrayjoin].
+ *
+ * Returns: 0 on success, -1 on error
+ */
+int
+vips_mergearray(VipsImage **in, VipsImage **out, int n,
+	int *x, int *y, ...)
+{
+	VipsArrayImage *image_array;
+	VipsArrayInt *x_array;
+	VipsArrayInt *y_array;
+	va_list ap;
+	int result;
+
+	image_array = vips_array_image_new(in, n);
+	x_array = vips_array_int_new(x, n);
+	y_array = vips_array_int_new(y, n);
+	va_start(ap, y);
+	result = vips_call_split("mergearray", ap,
+		image_array, out, x_array, y_array);
+	va_end(ap);
+	vips_area_unref(VIPS_AREA(image_array));
+	vips_area_unref(VIPS_AREA(x_array));
+	vips_area_unref(VIPS_AREA(y_array));
+
+	return result;
+}
@@ -52,6 +52,7 @@ void
 vips_mosaicing_operation_init(void)
 {
 	extern GType vips_merge_get_type(void);
+	extern GType vips_mergearray_get_type(void);
 	extern GType vips_mosaic_get_type(void);
 	extern GType vips_mosaic1_get_type(void);
 	extern GType vips_match_get_type(void);
@@ -61,6 +62,7 @@ vips_mosaicing_operation_init(void)
 	extern GType vips_remosaic_get_type(void);
 
 	vips_merge_get_type();
+	vips_mergearray_get_type();
 	vips_mosaic_get_type();
 	vips_mosaic1_get_type();
 	vips_matrixinvert_get_type();
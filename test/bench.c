@@ -0,0 +1,460 @@
+/* Time a set of kernels and pipelines and write the results as JSON.
+ *
+ * Run with "meson test --benchmark --suite bench" or "ninja bench", or
+ * directly, for example:
+ *
+ * 	./vips_bench --json bench.json --threads 1,4 --filter conv
+ *
+ * Compare two runs with bench_compare.py.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vips/vips.h>
+#include <vips/vector.h>
+
+/* Run each benchmark for at least this long, and at least this many times.
+ */
+#define BENCH_MIN_SECONDS (0.5)
+#define BENCH_MIN_RUNS (3)
+#define BENCH_MAX_RUNS (1000)
+
+/* Test images, made once.
+ */
+typedef struct _BenchContext {
+	VipsImage *rgb;
+	VipsImage *rgb2;
+	VipsImage *rgba;
+
+	void *jpeg;
+	size_t jpeg_length;
+} BenchContext;
+
+/* Build a pipeline on ctx and run it to completion. Images go into local,
+ * which is unreffed after every run.
+ */
+typedef int (*BenchFn)(BenchContext *ctx, VipsObject *local);
+
+typedef struct _Bench {
+	const char *name;
+	const char *group;
+
+	/* Skip the benchmark if this operation is missing.
+	 */
+	const char *needs;
+
+	BenchFn fn;
+} Bench;
+
+static int
+bench_sink_gen(VipsRegion *region, void *seq, void *a, void *b,
+	gboolean *stop)
+{
+	return 0;
+}
+
+/* Compute every pixel of image, but don't keep them.
+ */
+static int
+bench_sink(VipsImage *image)
+{
+	return vips_sink(image, NULL, bench_sink_gen, NULL, NULL, NULL);
+}
+
+static int
+bench_add(BenchContext *ctx, VipsObject *local)
+{
+	VipsImage **t = (VipsImage **) vips_object_local_array(local, 1);
+
+	return vips_add(ctx->rgb, ctx->rgb2, &t[0], NULL) ||
+		bench_sink(t[0]);
+}
+
+static int
+bench_cast(BenchContext *ctx, VipsObject *local)
+{
+	VipsImage **t = (VipsImage **) vips_object_local_array(local, 1);
+
+	return vips_cast_float(ctx->rgb, &t[0], NULL) ||
+		bench_sink(t[0]);
+}
+
+static int
+bench_conv(BenchContext *ctx, VipsObject *local)
+{
+	VipsImage **t = (VipsImage **) vips_object_local_array(local, 1);
+
+	return vips_gaussblur(ctx->rgb, &t[0], 2.0, NULL) ||
+		bench_sink(t[0]);
+}
+
+static int
+bench_reduce(BenchContext *ctx, VipsObject *local)
+{
+	VipsImage **t = (VipsImage **) vips_object_local_array(local, 1);
+
+	return vips_reduce(ctx->rgb, &t[0], 2.5, 2.5, NULL) ||
+		bench_sink(t[0]);
+}
+
+static int
+bench_colour(BenchContext *ctx, VipsObject *local)
+{
+	VipsImage **t = (VipsImage **) vips_object_local_array(local, 1);
+
+	return vips_colourspace(ctx->rgb, &t[0],
+			   VIPS_INTERPRETATION_LAB, NULL) ||
+		bench_sink(t[0]);
+}
+
+static int
+bench_composite(BenchContext *ctx, VipsObject *local)
+{
+	VipsImage **t = (VipsImage **) vips_object_local_array(local, 1);
+
+	return vips_composite2(ctx->rgb, ctx->rgba, &t[0],
+			   VIPS_BLEND_MODE_OVER, NULL) ||
+		bench_sink(t[0]);
+}
+
+static int
+bench_thumbnail(BenchContext *ctx, VipsObject *local)
+{
+	VipsImage **t = (VipsImage **) vips_object_local_array(local, 1);
+
+	return vips_thumbnail_buffer(ctx->jpeg, ctx->jpeg_length, &t[0], 256,
+			   NULL) ||
+		bench_sink(t[0]);
+}
+
+static int
+bench_dzsave(BenchContext *ctx, VipsObject *local)
+{
+	void *buf;
+	size_t length;
+
+	if (vips_dzsave_buffer(ctx->rgb, &buf, &length, NULL))
+		return -1;
+	g_free(buf);
+
+	return 0;
+}
+
+static int
+bench_tiffsave(BenchContext *ctx, VipsObject *local)
+{
+	void *buf;
+	size_t length;
+
+	if (vips_tiffsave_buffer(ctx->rgb, &buf, &length,
+			"tile", TRUE,
+			"pyramid", TRUE,
+			"compression", VIPS_FOREIGN_TIFF_COMPRESSION_DEFLATE,
+			NULL))
+		return -1;
+	g_free(buf);
+
+	return 0;
+}
+
+static Bench bench_table[] = {
+	{ "add", "kernel", NULL, bench_add },
+	{ "cast", "kernel", NULL, bench_cast },
+	{ "conv", "kernel", NULL, bench_conv },
+	{ "reduce", "kernel", NULL, bench_reduce },
+	{ "colour", "kernel", NULL, bench_colour },
+	{ "composite", "kernel", NULL, bench_composite },
+	{ "thumbnail", "pipeline", "jpegsave_buffer", bench_thumbnail },
+	{ "dzsave", "pipeline", "dzsave_buffer", bench_dzsave },
+	{ "tiffsave", "pipeline", "tiffsave_buffer", bench_tiffsave },
+};
+
+static int
+bench_context_init(BenchContext *ctx, int size)
+{
+	VipsObject *local = VIPS_OBJECT(vips_image_new());
+	VipsImage **t = (VipsImage **) vips_object_local_array(local, 6);
+
+	/* Noise, so that nothing can take a shortcut.
+	 */
+	if (vips_gaussnoise(&t[0], size, size,
+			"mean", 128.0, "sigma", 40.0, "seed", 1, NULL) ||
+		vips_gaussnoise(&t[1], size, size,
+			"mean", 128.0, "sigma", 40.0, "seed", 2, NULL) ||
+		vips_gaussnoise(&t[2], size, size,
+			"mean", 128.0, "sigma", 40.0, "seed", 3, NULL) ||
+		vips_bandjoin(t, &t[3], 3, NULL) ||
+		vips_cast_uchar(t[3], &t[4], NULL) ||
+		vips_copy(t[4], &t[5],
+			"interpretation", VIPS_INTERPRETATION_sRGB, NULL) ||
+		!(ctx->rgb = vips_image_copy_memory(t[5]))) {
+		g_object_unref(local);
+		return -1;
+	}
+	g_object_unref(local);
+
+	local = VIPS_OBJECT(vips_image_new());
+	t = (VipsImage **) vips_object_local_array(local, 3);
+	if (vips_flip(ctx->rgb, &t[0], VIPS_DIRECTION_HORIZONTAL, NULL) ||
+		!(ctx->rgb2 = vips_image_copy_memory(t[0])) ||
+		vips_bandjoin_const1(ctx->rgb2, &t[1], 128.0, NULL) ||
+		vips_copy(t[1], &t[2],
+			"interpretation", VIPS_INTERPRETATION_sRGB, NULL) ||
+		!(ctx->rgba = vips_image_copy_memory(t[2]))) {
+		g_object_unref(local);
+		return -1;
+	}
+	g_object_unref(local);
+
+	if (vips_type_find("VipsOperation", "jpegsave_buffer") &&
+		vips_jpegsave_buffer(ctx->rgb, &ctx->jpeg, &ctx->jpeg_length,
+			"Q", 85, NULL))
+		return -1;
+
+	return 0;
+}
+
+static void
+bench_context_free(BenchContext *ctx)
+{
+	VIPS_UNREF(ctx->rgb);
+	VIPS_UNREF(ctx->rgb2);
+	VIPS_UNREF(ctx->rgba);
+	VIPS_FREE(ctx->jpeg);
+}
+
+static int
+bench_compare_double(const void *a, const void *b)
+{
+	double x = *((double *) a);
+	double y = *((double *) b);
+
+	return x < y ? -1 : x > y ? 1 : 0;
+}
+
+/* Run one benchmark once, in seconds.
+ */
+static int
+bench_run_once(Bench *bench, BenchContext *ctx, double *seconds)
+{
+	VipsObject *local = VIPS_OBJECT(vips_image_new());
+	gint64 start = g_get_monotonic_time();
+	int result;
+
+	result = bench->fn(ctx, local);
+	*seconds = (g_get_monotonic_time() - start) / 1e6;
+	g_object_unref(local);
+
+	return result;
+}
+
+static int
+bench_run(FILE *fp, gboolean *first,
+	Bench *bench, BenchContext *ctx, int threads)
+{
+	double times[BENCH_MAX_RUNS];
+	double total;
+	double seconds;
+	double mpels;
+	int runs;
+
+	fprintf(fp, "%s\n    {\"name\": \"%s\", \"group\": \"%s\", "
+				"\"threads\": %d, ",
+		*first ? "" : ",", bench->name, bench->group, threads);
+	*first = FALSE;
+
+	if (bench->needs &&
+		!vips_type_find("VipsOperation", bench->needs)) {
+		fprintf(fp, "\"skipped\": true}");
+		printf("%-10s %3d threads: skipped, no %s\n",
+			bench->name, threads, bench->needs);
+		return 0;
+	}
+
+	/* A warm-up run to fill caches and start threads.
+	 */
+	if (bench_run_once(bench, ctx, &seconds))
+		return -1;
+
+	total = 0.0;
+	for (runs = 0; runs < BENCH_MAX_RUNS; runs++) {
+		if (runs >= BENCH_MIN_RUNS &&
+			total >= BENCH_MIN_SECONDS)
+			break;
+
+		if (bench_run_once(bench, ctx, &times[runs]))
+			return -1;
+		total += times[runs];
+	}
+
+	qsort(times, runs, sizeof(double), bench_compare_double);
+	mpels = VIPS_IMAGE_N_PELS(ctx->rgb) / 1e6;
+
+	fprintf(fp, "\"runs\": %d, \"best_ms\": %g, \"median_ms\": %g, "
+				"\"mean_ms\": %g, \"mpels_per_s\": %g}",
+		runs, times[0] * 1000, times[runs / 2] * 1000,
+		total / runs * 1000, mpels / times[0]);
+	printf("%-10s %3d threads: %8.2f ms best, %8.2f ms median, "
+		   "%8.1f Mpels/s\n",
+		bench->name, threads, times[0] * 1000, times[runs / 2] * 1000,
+		mpels / times[0]);
+
+	return 0;
+}
+
+/* Write str as a quoted JSON string.
+ */
+static void
+bench_json_string(FILE *fp, const char *str)
+{
+	const unsigned char *p;
+
+	fputc('"', fp);
+	for (p = (const unsigned char *) str; *p; p++)
+		if (*p == '"' ||
+			*p == '\\')
+			fprintf(fp, "\\%c", *p);
+		else if (*p < 0x20)
+			fprintf(fp, "\\u%04x", *p);
+		else
+			fputc(*p, fp);
+	fputc('"', fp);
+}
+
+/* Parse a list like "1,2,4". The default is powers of two up to the
+ * concurrency, then the concurrency itself.
+ */
+static int *
+bench_threads(const char *str, int *n)
+{
+	int max = vips_concurrency_get();
+
+	int *threads;
+	int i;
+
+	if (str) {
+		char **list = g_strsplit(str, ",", -1);
+
+		*n = g_strv_length(list);
+		threads = g_new(int, *n);
+		for (i = 0; i < *n; i++)
+			threads[i] = VIPS_MAX(1, atoi(list[i]));
+		g_strfreev(list);
+	}
+	else {
+		threads = g_new(int, 32);
+		*n = 0;
+		for (i = 1; i < max && *n < 31; i *= 2)
+			threads[(*n)++] = i;
+		threads[(*n)++] = max;
+	}
+
+	return threads;
+}
+
+static char *json_filename = NULL;
+static char *threads_str = NULL;
+static char *filter = NULL;
+static char *label = NULL;
+static int size = 4096;
+static gboolean novector = FALSE;
+
+static GOptionEntry options[] = {
+	{ "json", 'j', 0, G_OPTION_ARG_FILENAME, &json_filename,
+		"write results to FILE", "FILE" },
+	{ "threads", 't', 0, G_OPTION_ARG_STRING, &threads_str,
+		"comma-separated list of thread counts", "LIST" },
+	{ "filter", 'f', 0, G_OPTION_ARG_STRING, &filter,
+		"only run benchmarks whose name contains STRING", "STRING" },
+	{ "label", 'l', 0, G_OPTION_ARG_STRING, &label,
+		"tag results with LABEL, eg. a commit hash", "LABEL" },
+	{ "size", 's', 0, G_OPTION_ARG_INT, &size,
+		"test images are SIZE x SIZE pixels", "SIZE" },
+	{ "novector", 'n', 0, G_OPTION_ARG_NONE, &novector,
+		"disable SIMD paths", NULL },
+	{ NULL }
+};
+
+int
+main(int argc, char **argv)
+{
+	GOptionContext *context;
+	GOptionGroup *main_group;
+	GError *error = NULL;
+	BenchContext ctx = { 0 };
+	FILE *fp;
+	gboolean first;
+	int *threads;
+	int n_threads;
+	int i, j;
+
+	if (VIPS_INIT(argv[0]))
+		vips_error_exit("unable to start");
+
+	context = g_option_context_new("- benchmark libvips");
+	main_group = g_option_group_new(NULL, NULL, NULL, NULL, NULL);
+	g_option_group_add_entries(main_group, options);
+	vips_add_option_entries(main_group);
+	g_option_context_set_main_group(context, main_group);
+	if (!g_option_context_parse(context, &argc, &argv, &error)) {
+		fprintf(stderr, "%s\n", error->message);
+		g_error_free(error);
+		g_option_context_free(context);
+		return 1;
+	}
+	g_option_context_free(context);
+
+	/* Every run must recompute.
+	 */
+	vips_cache_set_max(0);
+	if (novector)
+		vips_vector_set_enabled(FALSE);
+
+	if (bench_context_init(&ctx, VIPS_MAX(64, size)))
+		vips_error_exit("unable to make test images");
+
+	if (!json_filename)
+		fp = stdout;
+	else if (!(fp = fopen(json_filename, "w")))
+		vips_error_exit("unable to open \"%s\"", json_filename);
+
+	threads = bench_threads(threads_str, &n_threads);
+
+	fprintf(fp, "{\n  \"version\": ");
+	bench_json_string(fp, vips_version_string());
+	fprintf(fp, ",\n  \"label\": ");
+	bench_json_string(fp, label ? label : "");
+	fprintf(fp, ",\n");
+	fprintf(fp, "  \"vector\": %s,\n",
+		vips_vector_isenabled() ? "true" : "false");
+	fprintf(fp, "  \"concurrency\": %d,\n", vips_concurrency_get());
+	fprintf(fp, "  \"size\": %d,\n", ctx.rgb->Xsize);
+	fprintf(fp, "  \"results\": [");
+
+	first = TRUE;
+	for (i = 0; i < VIPS_NUMBER(bench_table); i++) {
+		Bench *bench = &bench_table[i];
+
+		if (filter &&
+			!strstr(bench->name, filter))
+			continue;
+
+		for (j = 0; j < n_threads; j++) {
+			vips_concurrency_set(threads[j]);
+			if (bench_run(fp, &first, bench, &ctx, threads[j]))
+				vips_error_exit("%s failed", bench->name);
+		}
+	}
+
+	fprintf(fp, "\n  ]\n}\n");
+	if (fp != stdout)
+		fclose(fp);
+
+	g_free(threads);
+	bench_context_free(&ctx);
+	vips_shutdown();
+
+	return 0;
+}
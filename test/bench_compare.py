@@ -0,0 +1,66 @@
+#!/usr/bin/env python3
+
+# compare two JSON files from vips_bench
+#
+# usage: bench_compare.py before.json after.json [--threshold 0.1]
+#
+# exit with an error if any benchmark is slower by more than threshold
+
+import argparse
+import json
+import sys
+
+
+def load(filename):
+    with open(filename) as f:
+        data = json.load(f)
+
+    results = {}
+    for result in data["results"]:
+        if "best_ms" in result:
+            results[(result["name"], result["threads"])] = result
+
+    return data, results
+
+
+def main():
+    parser = argparse.ArgumentParser(description="compare vips_bench runs")
+    parser.add_argument("before", help="JSON from the baseline")
+    parser.add_argument("after", help="JSON from the change")
+    parser.add_argument("--threshold", type=float, default=0.1,
+                        help="fail if slower by more than this fraction")
+    args = parser.parse_args()
+
+    before_data, before = load(args.before)
+    after_data, after = load(args.after)
+
+    print(f"before: {before_data['version']} {before_data['label']}")
+    print(f"after:  {after_data['version']} {after_data['label']}")
+    print(f"{'name':<12} {'threads':>7} {'before ms':>10} "
+          f"{'after ms':>10} {'speedup':>8}")
+
+    regressions = []
+    for key in sorted(before.keys() & after.keys()):
+        name, threads = key
+        old = before[key]["best_ms"]
+        new = after[key]["best_ms"]
+        speedup = old / new if new > 0 else float("inf")
+        flag = ""
+        if new > old * (1 + args.threshold):
+            regressions.append(key)
+            flag = " *"
+
+        print(f"{name:<12} {threads:>7} {old:>10.2f} "
+              f"{new:>10.2f} {speedup:>8.2f}{flag}")
+
+    for key in sorted(before.keys() ^ after.keys()):
+        print(f"{key[0]} with {key[1]} threads is only in one run")
+
+    if regressions:
+        print(f"{len(regressions)} benchmarks slower by more than "
+              f"{args.threshold * 100:.0f}%")
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
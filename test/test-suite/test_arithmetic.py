@@ -285,6 +285,24 @@ class TestArithmetic:
         self.run_unary(self.all_images, my_invert,
                        fmt=[pyvips.BandFormat.UCHAR])
 
+    def test_chain(self):
+        # chains of unary operations are run directly by the sequence of the
+        # operation they feed ... copy_memory() between steps stops that
+        def chain(x, step):
+            x = step((x * 2 + 1).abs())
+            x = step(x.sqrt().sin())
+            x = step((-x).floor())
+            return x + step(x.invert())
+
+        for im in self.all_images:
+            for fmt in [pyvips.BandFormat.UCHAR, pyvips.BandFormat.FLOAT]:
+                x = im.cast(fmt)
+                fused = chain(x, lambda y: y)
+                reference = chain(x, lambda y: y.copy_memory())
+
+                assert fused.format == reference.format
+                assert (fused - reference).abs().max() == 0
+
     # test the rest of VipsArithmetic
 
     def test_avg(self):
@@ -672,6 +690,35 @@ class TestArithmetic:
         assert width == 50
         assert height == 60
 
+        # two objects, so no single edge line holds the whole box
+        test = pyvips.Image.black(300, 200) + 255
+        test = test.draw_rect(0, 150, 40, 20, 20, fill=True)
+        test = test.draw_rect(0, 70, 160, 30, 10, fill=True)
+        left, top, width, height = test.find_trim(line_art=True)
+        assert left == 70
+        assert top == 40
+        assert width == 100
+        assert height == 130
+
+        test = pyvips.Image.black(100, 100) + 255
+        left, top, width, height = test.find_trim()
+        assert width == 0
+        assert height == 0
+
+    @skip_if_no("pngload")
+    def test_find_trim_sequential(self):
+        im = pyvips.Image.black(50, 60) + 100
+        test = im.embed(10, 20, 200, 300, extend="white").cast("uchar")
+        buf = test.write_to_buffer(".png")
+
+        # sequential images can only be read once, top to bottom
+        test = pyvips.Image.new_from_buffer(buf, "", access="sequential")
+        left, top, width, height = test.find_trim()
+        assert left == 10
+        assert top == 20
+        assert width == 50
+        assert height == 60
+
     def test_profile(self):
         test = pyvips.Image.black(100, 100).draw_rect(100, 40, 50, 1, 1)
 
@@ -700,6 +747,31 @@ class TestArithmetic:
 
             assert_almost_equal_objects(rows(0, 10), [50 * 10])
 
+    @skip_if_no("integral")
+    def test_integral(self):
+        # tall enough to need several strips
+        im = pyvips.Image.black(50, 300, bands=2) + [1, 2]
+
+        for fmt in noncomplex_formats:
+            sat = im.cast(fmt).integral()
+            assert sat.format == pyvips.BandFormat.DOUBLE
+            assert sat.width == im.width
+            assert sat.height == im.height
+            assert sat.bands == 2
+            assert_almost_equal_objects(sat(0, 0), [1, 2])
+            assert_almost_equal_objects(sat(9, 199), [10 * 200, 2 * 10 * 200])
+            assert_almost_equal_objects(sat(49, 299),
+                                        [50 * 300, 2 * 50 * 300])
+
+        sat = im.integral(squared=True)
+        assert_almost_equal_objects(sat(49, 299), [50 * 300, 4 * 50 * 300])
+
+        test = pyvips.Image.gaussnoise(100, 200).cast("uchar")
+        sat = test.integral()
+        assert pytest.approx(sat(99, 199)[0]) == test.avg() * 100 * 200
+        assert pytest.approx(sat(99, 130)[0]) == \
+            test.crop(0, 0, 100, 131).avg() * 100 * 131
+
     def test_stats(self):
         im = pyvips.Image.black(50, 50)
         test = im.insert(im + 10, 50, 0, expand=True)
@@ -722,6 +794,24 @@ class TestArithmetic:
             assert_almost_equal_objects(matrix(4, 1), [a.avg()])
             assert_almost_equal_objects(matrix(5, 1), [a.deviate()])
 
+    def test_stats_percent(self):
+        for fmt in ["uchar", "ushort", "float"]:
+            im = self.colour.cast(fmt)
+            matrix, opts = im.stats(percent=[1, 50, 99], hist=True)
+            hist = opts["hist"]
+
+            assert hist.width == im.hist_find().width
+            assert (hist - im.hist_find()).abs().max() == 0
+
+            for i, p in enumerate([1, 50, 99]):
+                for b in range(im.bands):
+                    assert matrix(10 + i, b + 1)[0] == \
+                        im.extract_band(b).percent(p)
+
+        matrix, opts = self.colour.stats(percent=[], hist=True)
+        assert matrix.width == 10
+        assert opts["hist"].bands == self.colour.bands
+
     def test_sum(self):
         for fmt in all_formats:
             im = pyvips.Image.black(50, 50)
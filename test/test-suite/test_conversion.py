@@ -440,6 +440,45 @@ class TestConversion:
         assert_almost_equal_objects(comp(0, 0), [51.8, 52.8, 53.8, 255],
                                     threshold=0.1)
 
+    def test_composite_uchar(self):
+        base = (self.colour + 100).cast("uchar").bandjoin(200)
+        overlay = (self.colour * 2).cast("uchar").bandjoin(128)
+        opaque = self.colour.cast("uchar").bandjoin(255)
+        clear = self.colour.cast("uchar").bandjoin(0)
+
+        for mode in ["over", "multiply", "screen"]:
+            comp = base.composite(overlay, mode)
+            ref = base.cast("float").composite(overlay.cast("float"), mode)
+            assert (comp - ref).abs().max() < 1.0
+
+            # fully transparent and fully opaque layers
+            comp = base.composite([overlay, clear], [mode, mode])
+            assert (comp - base.composite(overlay, mode)).abs().max() == 0
+            comp = base.composite([overlay, opaque], [mode, "over"])
+            assert (comp - opaque).abs().max() <= 1
+
+    def test_composite_sparse(self):
+        base = (pyvips.Image.black(600, 600, bands=3) + [10, 20, 30]) \
+            .bandjoin(255).copy(interpretation="srgb").cast("uchar")
+        overlay = (pyvips.Image.black(10, 10, bands=3) + [200, 100, 50]) \
+            .bandjoin(255).copy(interpretation="srgb").cast("uchar")
+        positions = [(37 * i % 590, 53 * i % 590) for i in range(100)]
+
+        comp = base.composite([overlay] * len(positions), "over",
+                              x=[x for x, y in positions],
+                              y=[y for x, y in positions])
+
+        for x, y in positions[:10]:
+            assert comp(x + 5, y + 5) == [200, 100, 50, 255]
+        assert comp(599, 599) == [10, 20, 30, 255]
+
+        # pixels outside every overlay pass straight through
+        mask = pyvips.Image.black(600, 600)
+        for x, y in positions:
+            mask = mask.draw_rect(255, x, y, 10, 10, fill=True)
+        diff = (comp - base).abs().bandmean()
+        assert (diff & (mask == 0)).max() == 0
+
     def _lum(self, c):
         return 0.3 * c[0] + 0.59 * c[1] + 0.11 * c[2]
 
@@ -178,6 +178,53 @@ class TestConvolution:
                 assert x == 25
                 assert y == 50
 
+    def test_correlation_large(self):
+        # large refs can switch to the frequency domain path
+        for im in self.all_images:
+            small = im.crop(40, 60, 41, 41)
+
+            cor = im.spcor(small)
+            v, x, y = cor.maxpos()
+            assert abs(v - 1.0) < 1e-5
+            assert x == 60
+            assert y == 80
+
+            cor = im.cast("uchar").fastcor(small.cast("uchar"))
+            v, x, y = cor.minpos()
+            assert v == 0
+            assert x == 60
+            assert y == 80
+
+    def test_spcor_offset(self):
+        # a large DC level must not swamp the window variance
+        for im in self.all_images:
+            offset = (im.cast("float") + 1e6).copy_memory()
+            for size in [10, 41]:
+                small = offset.crop(40, 60, size, size)
+                cor = offset.spcor(small)
+                v, x, y = cor.maxpos()
+                assert abs(v - 1.0) < 1e-3
+                assert x == 40 + size // 2
+                assert y == 60 + size // 2
+
+    def test_box(self):
+        for im in self.all_images:
+            # the mean is a 3x3 blur away from the edges
+            a = im.box(3, 3)
+            b = im.conv(self.blur, precision=pyvips.Precision.FLOAT)
+            assert a.width == im.width
+            assert a.height == im.height
+            assert_almost_equal_objects(a(25, 50), b(25, 50), threshold=1e-4)
+
+            # variance is E(x^2) - E(x)^2
+            a = im.box(5, 5, variance=True)
+            b = (im * im).box(5, 5) - im.box(5, 5) ** 2
+            assert_almost_equal_objects(a(25, 50), b(25, 50), threshold=1e-3)
+
+            # and must survive a large DC level
+            b = (im + 1e6).box(5, 5, variance=True)
+            assert_almost_equal_objects(a(25, 50), b(25, 50), threshold=1e-2)
+
     def test_gaussblur(self):
         for im in self.all_images:
             for prec in [pyvips.Precision.INTEGER, pyvips.Precision.FLOAT]:
@@ -77,6 +77,20 @@ class TestCreate:
         im = pyvips.Image.black(2, 1)
         im.fwfft()
 
+    @skip_if_no("fwfft")
+    def test_fwfft_disc(self):
+        im = pyvips.Image.gaussnoise(101, 64)
+        mem = im.fwfft()
+        disc = im.fwfft(disc=True)
+        assert disc.width == mem.width
+        assert disc.height == mem.height
+        assert disc.format == pyvips.BandFormat.DPCOMPLEX
+        assert (mem - disc).abs().max() < 0.001
+
+        back = disc.invfft(real=True, disc=True)
+        assert back.format == pyvips.BandFormat.DOUBLE
+        assert (back - im).abs().max() < 0.001
+
     @skip_if_no("fwfft")
     def test_fractsurf(self):
         im = pyvips.Image.fractsurf(100, 90, 2.5)
@@ -953,6 +953,17 @@ class TestForeign:
             z = y.hist_find(band=0)
             assert z(0, 0)[0] + z(255, 0)[0] == y.width * y.height
 
+        # the vector paths for uchar mean and median should match the C
+        # path we use for int
+        x = pyvips.Image.new_from_file(TIF_FILE)
+        for shrink in ["mean", "median"]:
+            buf = x.tiffsave_buffer(pyramid=True, region_shrink=shrink)
+            buf2 = x.cast("int").tiffsave_buffer(pyramid=True,
+                                                 region_shrink=shrink)
+            a = pyvips.Image.new_from_buffer(buf, "", page=1)
+            b = pyvips.Image.new_from_buffer(buf2, "", page=1)
+            assert (a - b).abs().max() == 0
+
         # metadata tile-width and tile-height should be correct
         x = pyvips.Image.new_from_file(TIF_FILE)
         buf = x.tiffsave_buffer(tile=True, tile_width=192, tile_height=224)
@@ -1714,6 +1725,15 @@ class TestForeign:
         # check whether the *.dzi file is Deflate-compressed
         assert buf1.find(b'http://schemas.microsoft.com/deepzoom/2008') != -1
         assert buf2.find(b'http://schemas.microsoft.com/deepzoom/2008') == -1
+        # tiles are already compressed, so they should be stored
+        import zipfile
+        with zipfile.ZipFile(filename2) as z:
+            assert z.testzip() is None
+            for info in z.infolist():
+                if info.filename.endswith(".jpeg"):
+                    assert info.compress_type == zipfile.ZIP_STORED
+                elif info.filename.endswith(".dzi"):
+                    assert info.compress_type == zipfile.ZIP_DEFLATED
 
         # test suffix
         filename = temp_filename(self.tempdir, '')
@@ -1722,6 +1742,27 @@ class TestForeign:
         x = pyvips.Image.new_from_file(filename + "_files/9/0_0.png")
         assert x.width == 255
 
+        # test preview ... should be the 73x111 level, level 7
+        filename = temp_filename(self.tempdir, '')
+        opts = self.colour.dzsave(filename, suffix=".png",
+                                  preview_size=128, preview=True)
+        preview = opts["preview"]
+        assert preview.width == 73
+        assert preview.height == 111
+        x = pyvips.Image.new_from_file(filename + "_files/7/0_0.png")
+        assert (x - preview).abs().max() == 0
+
+        # with depth=one we shrink on down for the preview, but only save
+        # the top level
+        filename = temp_filename(self.tempdir, '')
+        opts = self.colour.dzsave(filename, suffix=".png", depth="one",
+                                  preview_size=128, preview=True)
+        preview2 = opts["preview"]
+        assert preview2.width == 73
+        assert preview2.height == 111
+        assert (preview2 - preview).abs().max() == 0
+        assert os.listdir(filename + "_files") == ["0"]
+
         # test overlap
         filename = temp_filename(self.tempdir, '')
         self.colour.dzsave(filename, overlap=200)
@@ -108,6 +108,27 @@ class TestHistogram:
         # new mean should be closer to target mean
         assert abs(im.avg() - 128) > abs(im2.avg() - 128)
 
+        # windows can be larger than 256x256
+        im2 = im.stdif(200, 300)
+        assert im.width == im2.width
+        assert im.height == im2.height
+        assert abs(im.avg() - 128) > abs(im2.avg() - 128)
+
+    def test_threshold_local(self):
+        im = pyvips.Image.new_from_file(JPEG_FILE)
+
+        im2 = im.threshold_local(15, 15)
+
+        assert im.width == im2.width
+        assert im.height == im2.height
+        assert im2.format == pyvips.BandFormat.UCHAR
+        assert im2.min() == 0
+        assert im2.max() == 255
+
+        # with k = 0, this is a threshold against the box mean
+        im3 = im > im.box(15, 15)
+        assert (im2 != im3).avg() < 1
+
     def test_case(self):
         # slice into two at 128, we should get 50% of pixels in each half
         x = pyvips.Image.grey(256, 256, uchar=True)
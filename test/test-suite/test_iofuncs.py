@@ -60,6 +60,30 @@ class TestIofuncs:
         assert len(fields) > 10
         assert fields[0] == 'width'
 
+    def test_meta_copy(self):
+        im = pyvips.Image.black(10, 10)
+        for i in range(100):
+            im.set_type(pyvips.GValue.gint_type, f"field{i}", i)
+        im.set_type(pyvips.GValue.blob_type, "blob", b"12345")
+
+        # metadata is shared down the pipeline, setting or removing on the
+        # output must not change the input
+        im2 = im.invert().copy()
+        assert im2.get_fields()[-101:] == im.get_fields()[-101:]
+        im2.set_type(pyvips.GValue.gint_type, "field50", 1000)
+        im2.remove("field10")
+        im2.set_type(pyvips.GValue.blob_type, "blob", b"abc")
+
+        assert im.get("field50") == 50
+        assert im.get("field10") == 10
+        assert im.get("blob") == b"12345"
+        assert im2.get("field50") == 1000
+        assert im2.get_typeof("field10") == 0
+        assert im2.get("blob") == b"abc"
+
+        # replacing a field moves it to the end
+        assert im2.get_fields()[-2:] == ["field50", "blob"]
+
     def test_write_to_memory(self):
         s = bytearray(200)
         im = pyvips.Image.new_from_memory(s, 20, 10, 1, 'uchar')
@@ -19,6 +19,32 @@ class TestMorphology:
         assert opts['segments'] == 3
         assert mask.max() == 2
 
+        # regions which cross the edges of the labelling tiles
+        im = pyvips.Image.black(700, 600)
+        im = im.draw_circle(255, 300, 300, 200, fill=True)
+        im = im.draw_circle(0, 300, 300, 100, fill=True)
+        im = im.draw_rect(128, 10, 10, 5, 580, fill=True)
+        mask, opts = im.labelregions(segments=True, stats=True)
+
+        assert opts['segments'] == 5
+        assert mask.max() == 4
+        stats = opts['stats']
+        assert stats.width == 7
+        assert stats.height == 5
+        # the background, then the stripe, then the ring, then the hole
+        assert stats(0, 2)[0] == 5 * 580
+        assert stats(1, 2)[0] == 10
+        assert stats(2, 2)[0] == 10
+        assert stats(3, 2)[0] == 5
+        assert stats(4, 2)[0] == 580
+        assert abs(stats(5, 3)[0] - 300) < 1
+        assert abs(stats(6, 3)[0] - 300) < 1
+        assert abs(stats(5, 4)[0] - 300) < 1
+        assert mask(300, 300)[0] == 4
+        assert mask(300, 150)[0] == 3
+        assert mask(0, 0)[0] == 1
+        assert mask(699, 599)[0] == 1
+
     def test_erode(self):
         im = pyvips.Image.black(100, 100)
         im = im.draw_circle(255, 50, 50, 25, fill=True)
@@ -41,6 +67,66 @@ class TestMorphology:
         assert im.bands == im2.bands
         assert im2.avg() > im.avg()
 
+    def test_morph_rect(self):
+        # large solid rectangles use van Herk/Gil-Werman, check against a
+        # pair of small line masks, which go through the direct path
+        im = pyvips.Image.gaussnoise(123, 97).cast("uchar").bandjoin(
+            pyvips.Image.black(123, 97).draw_circle(255, 50, 50, 25, fill=True))
+        square = [[255] * 9] * 9
+        row = [[255] * 9]
+        col = [[255]] * 9
+        padded = [[128] * 11] + \
+            [[128] + [255] * 9 + [128]] * 9 + \
+            [[128] * 11]
+
+        for op in ["erode", "dilate"]:
+            ref = getattr(getattr(im, op)(row), op)(col)
+            im2 = getattr(im, op)(square)
+            assert im2.width == im.width
+            assert im2.height == im.height
+            assert im2.bands == im.bands
+            assert (im2 - ref).abs().max() == 0
+
+            im3 = getattr(im, op)(padded)
+            assert (im3 - ref).abs().max() == 0
+
+            # a long line, as the union of two shorter ones
+            line = [[255] * 61]
+            left = getattr(im, op)([[255] * 31 + [128] * 30])
+            right = getattr(im, op)([[128] * 30 + [255] * 31])
+            ref = left & right if op == "erode" else left | right
+            assert (getattr(im, op)(line) - ref).abs().max() == 0
+
+    def test_distance(self):
+        im = pyvips.Image.black(100, 100)
+        im = im.draw_rect(255, 0, 0, 1, 1)
+        d = im.distance()
+        assert d.width == im.width
+        assert d.height == im.height
+        assert d.bands == 1
+        assert d.format == "float"
+        assert d(0, 0)[0] == 0
+        assert d(3, 4)[0] == pytest.approx(5)
+        assert d(99, 99)[0] == pytest.approx(99 * 2 ** 0.5, abs=0.01)
+
+        # compare to a brute-force EDT from a pair of points
+        im = im.draw_rect(255, 70, 20, 1, 1)
+        xy = pyvips.Image.xyz(100, 100)
+        x = xy[0]
+        y = xy[1]
+        a = (x * x + y * y) ** 0.5
+        b = ((x - 70) ** 2 + (y - 20) ** 2) ** 0.5
+        ref = (a < b).ifthenelse(a, b)
+        assert (im.distance() - ref).abs().max() < 0.01
+
+        # signed distance is negative inside objects
+        im = pyvips.Image.black(100, 100)
+        im = im.draw_rect(255, 20, 20, 60, 60, fill=True)
+        d = im.distance(signed=True)
+        assert d(50, 50)[0] == pytest.approx(-30)
+        assert d(20, 20)[0] == pytest.approx(-1)
+        assert d(10, 50)[0] == pytest.approx(10)
+
     def test_rank(self):
         im = pyvips.Image.black(100, 100)
         im = im.draw_circle(255, 50, 50, 25, fill=True)
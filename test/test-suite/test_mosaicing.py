@@ -25,6 +25,27 @@ class TestMosaicing:
         assert join.height == top.height + bottom.height - 10
         assert join.bands == 1
 
+    def test_mergearray(self):
+        im = pyvips.Image.new_from_file(MOSAIC_FILES[0])
+        w = im.width // 2
+        h = im.height // 2
+
+        # overlapping tiles of one image should merge back to that image
+        tiles = []
+        xs = []
+        ys = []
+        for y in [0, h - 20]:
+            for x in [0, w - 20]:
+                tiles.append(im.crop(x, y, w + 20, h + 20))
+                xs.append(x)
+                ys.append(y)
+        join = pyvips.Image.mergearray(tiles, xs, ys)
+
+        assert join.width == w * 2
+        assert join.height == h * 2
+        assert join.bands == 1
+        assert (join - im.crop(0, 0, w * 2, h * 2)).abs().max() == 0
+
     def test_lrmosaic(self):
         left = pyvips.Image.new_from_file(MOSAIC_FILES[0])
         right = pyvips.Image.new_from_file(MOSAIC_FILES[1])
@@ -102,3 +102,33 @@ if $vips black $tmp/t1.v 1000 1000 > /dev/null 2>&1; then
 fi
 echo ok
 unset VIPS_MAX_COORD
+
+echo -n "testing --profile-report ... "
+$vips --profile-report=$tmp/profile.json invert $image $tmp/t1.v
+if ! grep -q '"nickname": "invert"' $tmp/profile.json; then
+  echo "FAIL"
+  echo "--profile-report has no record for invert"
+  exit 1
+fi
+if ! grep -q '^"out": {' $tmp/profile.json; then
+  echo "FAIL"
+  echo "--profile-report is not keyed by output name"
+  exit 1
+fi
+echo ok
+
+# a random access load of a large jpg with a tiny disc threshold will spill to
+# a compressed temp file ... check we get the right pixels and that the temp
+# has gone
+echo -n "testing VIPS_DISC_COMPRESS ... "
+mkdir -p $tmp/spill
+TMPDIR=$tmp/spill VIPS_DISC_COMPRESS=1 VIPS_DISC_THRESHOLD=1k \
+  $vips rot $image $tmp/t1.v d90
+$vips rot $image $tmp/t2.v d90
+test_difference $tmp/t1.v $tmp/t2.v 0
+if [ -n "$(ls -A $tmp/spill)" ]; then
+  echo "FAIL"
+  echo "spill file was not removed"
+  exit 1
+fi
+echo ok
@@ -0,0 +1,71 @@
+/* Check that prepared calls match vips_call() and share its cache.
+ */
+
+#include <stdio.h>
+
+#include <vips/vips.h>
+
+int
+main(int argc, char **argv)
+{
+	VipsPreparedCall *call;
+	GValue values[3] = { G_VALUE_INIT, G_VALUE_INIT, G_VALUE_INIT };
+	VipsImage *in;
+	VipsImage *out;
+	VipsImage *prepared;
+	double a, b;
+
+	if (VIPS_INIT(argv[0]))
+		vips_error_exit(NULL);
+
+	if (vips_xyz(&in, 64, 64, NULL) ||
+		vips_extract_band(in, &out, 1, NULL))
+		vips_error_exit(NULL);
+
+	if (!(call = vips_prepared_call_new("extract_band",
+			  "in", "band", "out", NULL)))
+		vips_error_exit(NULL);
+	vips_prepared_call_init_values(call, values);
+	g_value_set_object(&values[0], in);
+	g_value_set_int(&values[1], 1);
+	if (vips_prepared_call_run(call, values))
+		vips_error_exit(NULL);
+	prepared = VIPS_IMAGE(g_value_dup_object(&values[2]));
+
+	/* Same args, so the prepared call must have found the vips_call()
+	 * operation in the cache.
+	 */
+	if (prepared != out) {
+		printf("prepared call missed the cache\n");
+		return 1;
+	}
+
+	if (vips_avg(prepared, &a, NULL) ||
+		vips_avg(out, &b, NULL))
+		vips_error_exit(NULL);
+	if (a != b) {
+		printf("prepared call result differs\n");
+		return 1;
+	}
+	g_object_unref(prepared);
+
+	/* Out of range values must fail, not be set.
+	 */
+	g_value_set_int(&values[1], -1);
+	if (!vips_prepared_call_run(call, values)) {
+		printf("prepared call accepted band -1\n");
+		return 1;
+	}
+	vips_error_clear();
+
+	g_value_unset(&values[0]);
+	g_value_unset(&values[1]);
+	g_value_unset(&values[2]);
+	vips_prepared_call_free(call);
+	g_object_unref(out);
+	g_object_unref(in);
+
+	vips_shutdown();
+
+	return 0;
+}
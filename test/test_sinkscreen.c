@@ -0,0 +1,106 @@
+/* Pan a small-cache background render across a large image and check that
+ * every view gets painted.
+ */
+
+#include <stdio.h>
+
+#include <vips/vips.h>
+
+#define TILE_SIZE 64
+#define MAX_TILES 8
+#define VIEW_SIZE (2 * TILE_SIZE)
+#define TIMEOUT_SECONDS 10
+
+static void
+notify_callback(VipsImage *image, VipsRect *rect, void *a)
+{
+}
+
+/* Ask for the view and wait for the mask to show it all painted.
+ */
+static gboolean
+view_paints(VipsRegion *image_region, VipsRegion *mask_region,
+	VipsRect *view)
+{
+	gint64 end = g_get_monotonic_time() +
+		TIMEOUT_SECONDS * G_TIME_SPAN_SECOND;
+
+	while (g_get_monotonic_time() < end) {
+		int min;
+		int x, y;
+
+		if (vips_region_prepare(image_region, view) ||
+			vips_region_prepare(mask_region, view))
+			return FALSE;
+
+		min = 255;
+		for (y = 0; y < view->height; y++) {
+			VipsPel *p = VIPS_REGION_ADDR(mask_region,
+				view->left, view->top + y);
+
+			for (x = 0; x < view->width; x++)
+				min = VIPS_MIN(min, p[x]);
+		}
+		if (min == 255)
+			return TRUE;
+
+		g_usleep(10000);
+	}
+
+	return FALSE;
+}
+
+int
+main(int argc, char **argv)
+{
+	VipsImage *black;
+	VipsImage *in;
+	VipsImage *image;
+	VipsImage *mask;
+	VipsRegion *image_region;
+	VipsRegion *mask_region;
+	VipsRect view;
+	int x;
+
+	if (VIPS_INIT(argv[0]))
+		vips_error_exit(NULL);
+
+	if (vips_black(&black, 64 * TILE_SIZE, VIEW_SIZE, NULL) ||
+		vips_linear1(black, &in, 0.0, 128.0, "uchar", TRUE, NULL))
+		vips_error_exit(NULL);
+	g_object_unref(black);
+
+	image = vips_image_new();
+	mask = vips_image_new();
+	if (vips_sink_screen(in, image, mask,
+			TILE_SIZE, TILE_SIZE, MAX_TILES, 0, notify_callback, NULL))
+		vips_error_exit(NULL);
+	image_region = vips_region_new(image);
+	mask_region = vips_region_new(mask);
+
+	/* Each step the prefetch ring fills the cache with tiles which the
+	 * next step then drops as out of view.
+	 */
+	for (x = 0; x + VIEW_SIZE <= in->Xsize; x += TILE_SIZE) {
+		view.left = x;
+		view.top = 0;
+		view.width = VIEW_SIZE;
+		view.height = VIEW_SIZE;
+		vips_sink_screen_set_viewport(image, &view, TILE_SIZE, 0);
+
+		if (!view_paints(image_region, mask_region, &view)) {
+			printf("view at %d not painted\n", x);
+			return 1;
+		}
+	}
+
+	g_object_unref(mask_region);
+	g_object_unref(image_region);
+	g_object_unref(mask);
+	g_object_unref(image);
+	g_object_unref(in);
+
+	vips_shutdown();
+
+	return 0;
+}
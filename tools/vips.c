@@ -49,6 +49,8 @@
  * 	- add --targets
  * 1/11/22
  * 	- add "-c" flag
+ * 18/10/26
+ * 	- add --profile-report
  */
 
 /*
@@ -106,6 +108,7 @@
 static char *main_option_plugin = NULL;
 static gboolean main_option_targets;
 static gboolean main_option_version;
+static char *main_option_profile_report = NULL;
 
 static void *
 list_class(GType type, void *user_data)
@@ -299,6 +302,10 @@ static GOptionEntry main_option[] = {
 		N_("PLUGIN") },
 	{ "version", 'v', 0, G_OPTION_ARG_NONE, &main_option_version,
 		N_("print version"), NULL },
+	{ "profile-report", 0, 0, G_OPTION_ARG_FILENAME,
+		&main_option_profile_report,
+		N_("write an operation profile to FILE, \"-\" for stderr"),
+		N_("FILE") },
 	{ "completion", 'c', G_OPTION_FLAG_OPTIONAL_ARG, G_OPTION_ARG_CALLBACK,
 		(GOptionArgFunc) parse_main_option_completion,
 		N_("print completions"),
@@ -306,6 +313,63 @@ static GOptionEntry main_option[] = {
 	{ NULL }
 };
 
+/* Add the profile for each output image of an operation to the report,
+ * keyed by the output name.
+ */
+static void *
+profile_report_arg(VipsObject *object, GParamSpec *pspec,
+	VipsArgumentClass *argument_class,
+	VipsArgumentInstance *argument_instance,
+	void *a, void *b)
+{
+	GString *report = (GString *) a;
+
+	if ((argument_class->flags & VIPS_ARGUMENT_OUTPUT) &&
+		argument_instance->assigned &&
+		G_IS_PARAM_SPEC_OBJECT(pspec) &&
+		g_type_is_a(G_PARAM_SPEC_VALUE_TYPE(pspec), VIPS_TYPE_IMAGE)) {
+		const char *name = g_param_spec_get_name(pspec);
+
+		VipsImage *image;
+
+		g_object_get(object, name, &image, NULL);
+		if (image) {
+			char *json = vips_image_get_profile_json(image);
+
+			g_string_append_printf(report, "%s\"%s\": %s",
+				report->len > 2 ? ",\n" : "", name, g_strchomp(json));
+			g_free(json);
+			g_object_unref(image);
+		}
+	}
+
+	return NULL;
+}
+
+static int
+profile_report(VipsOperation *operation)
+{
+	GString *report = g_string_new("{\n");
+	GError *error = NULL;
+
+	vips_argument_map(VIPS_OBJECT(operation),
+		profile_report_arg, report, NULL);
+	g_string_append(report, "\n}\n");
+
+	if (strcmp(main_option_profile_report, "-") == 0)
+		fprintf(stderr, "%s", report->str);
+	else if (!g_file_set_contents(main_option_profile_report,
+				 report->str, report->len, &error)) {
+		vips_g_error(&error);
+		g_string_free(report, TRUE);
+		return -1;
+	}
+
+	g_string_free(report, TRUE);
+
+	return 0;
+}
+
 #ifdef ENABLE_DEPRECATED
 typedef void *(*map_name_fn)(im_function *);
 
@@ -793,6 +857,9 @@ main(int argc, char **argv)
 	if (main_option_version)
 		printf("vips-%s\n", vips_version_string());
 
+	if (main_option_profile_report)
+		vips_operation_profile_set(TRUE);
+
 	/* Re-enable help and unknown option detection ready for the second
 	 * option parse.
 	 */
@@ -908,6 +975,14 @@ main(int argc, char **argv)
 				vips_error_exit(NULL);
 		}
 
+		if (main_option_profile_report &&
+			profile_report(operation)) {
+			vips_object_unref_outputs(VIPS_OBJECT(operation));
+			g_object_unref(operation);
+			g_option_context_free(context);
+			vips_error_exit(NULL);
+		}
+
 		vips_object_unref_outputs(VIPS_OBJECT(operation));
 		g_object_unref(operation);
 